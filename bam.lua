@@ -271,6 +271,13 @@ function build(settings)
 	server_exe = Link(server_settings, "teewar_srv", engine, server,
 		game_shared, game_server, zlib, md5, server_link_other, json, teeuniverses)
 
+	-- build the benchmarks, one program per source file
+	bench = {}
+	for i,v in ipairs(Collect("src/bench/*.cpp")) do
+		bench[i] = Link(server_settings, "bench_"..PathFilename(PathBase(v)), Compile(server_settings, v),
+			engine, zlib, md5, json)
+	end
+
 	serverlaunch = {}
 	if platform == "macosx" then
 		serverlaunch = Link(launcher_settings, "serverlaunch", server_osxlaunch)
@@ -278,6 +285,7 @@ function build(settings)
 
 	-- make targets
 	s = PseudoTarget("server".."_"..settings.config_name, server_exe, serverlaunch, icu_depends)
+	t = PseudoTarget("bench".."_"..settings.config_name, bench)
 
 	all = PseudoTarget(settings.config_name, c, s, v, m, t)
 	return all
@@ -134,6 +134,22 @@
 #endif
 
 
+/* vector instructions */
+#if defined(__SSE2__) || defined(CONF_ARCH_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CONF_SSE2 1
+#endif
+
+/* avx2 code is compiled per function and only run when cpu_features() reports it */
+#if defined(CONF_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+	#define CONF_AVX2 1
+	#if defined(__GNUC__)
+		#define CONF_TARGET_AVX2 __attribute__((target("avx2")))
+	#else
+		#define CONF_TARGET_AVX2
+	#endif
+#endif
+
+
 #ifndef CONF_FAMILY_STRING
 #define CONF_FAMILY_STRING "unknown"
 #endif
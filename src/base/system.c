@@ -1,11 +1,15 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE /* recvmmsg/sendmmsg */
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <signal.h>
 
 #include "system.h"
 
@@ -31,16 +35,23 @@
 		#include <Carbon/Carbon.h>
 	#endif
 
+	#if defined(CONF_PLATFORM_LINUX)
+		#include <sys/epoll.h>
+		#include <sys/timerfd.h>
+	#endif
+
 #elif defined(CONF_FAMILY_WINDOWS)
 	#define WIN32_LEAN_AND_MEAN
-	#define _WIN32_WINNT 0x0501 /* required for mingw to get getaddrinfo to work */
+	#define _WIN32_WINNT 0x0600 /* required for mingw to get getaddrinfo and condition variables to work */
 	#include <windows.h>
 	#include <winsock2.h>
 	#include <ws2tcpip.h>
 	#include <fcntl.h>
+	#include <io.h>
 	#include <direct.h>
 	#include <errno.h>
 	#include <wincrypt.h>
+	#include <intrin.h>
 #else
 	#error NOT IMPLEMENTED
 #endif
@@ -57,17 +68,33 @@ IOHANDLE io_stdin() { return (IOHANDLE)stdin; }
 IOHANDLE io_stdout() { return (IOHANDLE)stdout; }
 IOHANDLE io_stderr() { return (IOHANDLE)stderr; }
 
-static DBG_LOGGER loggers[16];
-static int num_loggers = 0;
+typedef struct
+{
+	DBG_LOGGER logger;
+	void (*flush)();
+	int fd; /* written to directly by the crash handler, -1 if none */
+} LOGGER_ENTRY;
+
+static LOGGER_ENTRY loggers[16];
+static volatile int num_loggers = 0;
 
 static NETSTATS network_stats = {0};
 static MEMSTATS memory_stats = {0};
 
 static NETSOCKET invalid_socket = {NETTYPE_INVALID, -1, -1};
 
+static void dbg_logger_add(DBG_LOGGER logger, void (*flush)(), int fd)
+{
+	int i = num_loggers;
+	loggers[i].logger = logger;
+	loggers[i].flush = flush;
+	loggers[i].fd = fd;
+	atomic_set(&num_loggers, i+1);
+}
+
 void dbg_logger(DBG_LOGGER logger)
 {
-	loggers[num_loggers++] = logger;
+	dbg_logger_add(logger, 0, -1);
 }
 
 void dbg_assert_imp(const char *filename, int line, int test, const char *msg)
@@ -75,6 +102,7 @@ void dbg_assert_imp(const char *filename, int line, int test, const char *msg)
 	if(!test)
 	{
 		dbg_msg("assert", "%s(%d): %s", filename, line, msg);
+		dbg_logger_flush();
 		dbg_break();
 	}
 }
@@ -84,6 +112,323 @@ void dbg_break()
 	*((volatile unsigned*)0) = 0x0;
 }
 
+/* ----- asynchronous logging ----- */
+
+/*
+	Lines go into a bounded multi producer, single consumer ring. A line
+	takes one or more consecutive slots, producers reserve them by moving
+	the write position with a compare and swap and publish the line by
+	setting the sequence of its first slot. The writer thread hands the
+	lines to the loggers in reservation order every LOG_DRAIN_INTERVAL
+	milliseconds while there are any and flushes them at most once every
+	LOG_FLUSH_INTERVAL milliseconds.
+*/
+enum
+{
+	LOG_NUM_SLOTS=4096, /* power of two */
+	LOG_SLOT_MASK=LOG_NUM_SLOTS-1,
+	LOG_SLOT_SIZE=64,
+	LOG_DRAIN_INTERVAL=5,
+	LOG_FLUSH_INTERVAL=50,
+	LOG_MAX_LINE=1024*4,
+};
+
+static volatile int64 log_sequences[LOG_NUM_SLOTS];
+static int log_lengths[LOG_NUM_SLOTS];
+static char log_data[LOG_NUM_SLOTS*LOG_SLOT_SIZE];
+static volatile int64 log_write_pos = 0;
+static int64 log_read_pos = 0;
+static volatile int64 log_flushed_pos = 0; /* lines before this have reached the loggers' files */
+static volatile int log_dropped = 0;
+static int log_reported_dropped = 0;
+
+static volatile int log_async = 0;
+static volatile int log_stop = 0;
+static volatile int log_writer_sleeping = 0;
+static void *log_thread = 0;
+static LOCK log_read_lock = 0;
+static LOCK log_wake_lock = 0;
+static CONDVAR log_wake_cond = 0;
+
+static void log_call_loggers(const char *line)
+{
+	int i, num = atomic_get(&num_loggers);
+	for(i = 0; i < num; i++)
+		loggers[i].logger(line);
+}
+
+/* must hold log_read_lock */
+static void log_flush_loggers()
+{
+	int i, num = atomic_get(&num_loggers);
+	for(i = 0; i < num; i++)
+		if(loggers[i].flush)
+			loggers[i].flush();
+	atomic_set64(&log_flushed_pos, log_read_pos);
+}
+
+static void log_queue(const char *line)
+{
+	int length = strlen(line)+1;
+	int num_slots, first, tail;
+	int64 pos;
+
+	if(length > LOG_MAX_LINE)
+		length = LOG_MAX_LINE;
+	num_slots = (length+LOG_SLOT_SIZE-1)/LOG_SLOT_SIZE;
+
+	/* the reader frees slots in order, so if the last one is free all are */
+	do
+	{
+		pos = atomic_get64(&log_write_pos);
+		if(atomic_get64(&log_sequences[(pos+num_slots-1)&LOG_SLOT_MASK]) != pos+num_slots-1)
+		{
+			atomic_add(&log_dropped, 1);
+			return;
+		}
+	}
+	while(!atomic_compare_swap64(&log_write_pos, pos, pos+num_slots));
+
+	first = (int)(pos&LOG_SLOT_MASK);
+	tail = first*LOG_SLOT_SIZE+length-LOG_NUM_SLOTS*LOG_SLOT_SIZE; /* bytes that wrap around */
+	if(tail < 0)
+		tail = 0;
+	memcpy(&log_data[first*LOG_SLOT_SIZE], line, length-tail);
+	memcpy(log_data, line+length-tail, tail);
+	log_data[((first*LOG_SLOT_SIZE+length-1)&(LOG_NUM_SLOTS*LOG_SLOT_SIZE-1))] = 0;
+	log_lengths[first] = length;
+	atomic_set64(&log_sequences[first], pos+1);
+
+	if(atomic_get(&log_writer_sleeping))
+	{
+		lock_wait(log_wake_lock);
+		condvar_signal(log_wake_cond);
+		lock_unlock(log_wake_lock);
+	}
+}
+
+static void log_output_loggers(const char *line, void *user)
+{
+	log_call_loggers(line);
+}
+
+/* must hold log_read_lock, returns the number of lines written */
+static int log_drain(void (*output)(const char *line, void *user), void *user)
+{
+	char line[LOG_MAX_LINE];
+	int num_lines = 0;
+	int dropped = atomic_get(&log_dropped);
+
+	if(dropped != log_reported_dropped)
+	{
+		str_format(line, sizeof(line), "[%08x][dbg/logger]: queue full, dropped %d messages", (int)time(0), dropped-log_reported_dropped);
+		log_reported_dropped = dropped;
+		output(line, user);
+		num_lines++;
+	}
+
+	while(1)
+	{
+		int64 pos = log_read_pos;
+		int first = (int)(pos&LOG_SLOT_MASK);
+		int length, num_slots, tail, i;
+
+		if(atomic_get64(&log_sequences[first]) != pos+1)
+			break;
+
+		length = log_lengths[first];
+		num_slots = (length+LOG_SLOT_SIZE-1)/LOG_SLOT_SIZE;
+		tail = first*LOG_SLOT_SIZE+length-LOG_NUM_SLOTS*LOG_SLOT_SIZE;
+		if(tail < 0)
+			tail = 0;
+		memcpy(line, &log_data[first*LOG_SLOT_SIZE], length-tail);
+		memcpy(line+length-tail, log_data, tail);
+
+		/* in order, log_queue only checks the last slot of a range */
+		for(i = 0; i < num_slots; i++)
+			atomic_set64(&log_sequences[(pos+i)&LOG_SLOT_MASK], pos+i+LOG_NUM_SLOTS);
+		log_read_pos = pos+num_slots;
+
+		output(line, user);
+		num_lines++;
+	}
+	return num_lines;
+}
+
+static int log_empty()
+{
+	return atomic_get64(&log_sequences[log_read_pos&LOG_SLOT_MASK]) != log_read_pos+1 && atomic_get(&log_dropped) == log_reported_dropped;
+}
+
+static void log_writer_thread(void *user)
+{
+	int64 last_flush = time_get();
+	int unflushed = 0;
+
+	while(1)
+	{
+		int64 now;
+
+		lock_wait(log_read_lock);
+		unflushed += log_drain(log_output_loggers, 0);
+		now = time_get();
+		if(unflushed && (now-last_flush)*1000 >= LOG_FLUSH_INTERVAL*time_freq())
+		{
+			log_flush_loggers();
+			unflushed = 0;
+			last_flush = now;
+		}
+		lock_unlock(log_read_lock);
+
+		if(unflushed)
+		{
+			/* collect more lines before the next flush */
+			thread_sleep(LOG_DRAIN_INTERVAL);
+			continue;
+		}
+		if(atomic_get(&log_stop))
+			break;
+
+		lock_wait(log_wake_lock);
+		atomic_set(&log_writer_sleeping, 1);
+		while(log_empty() && !atomic_get(&log_stop))
+			condvar_wait(log_wake_cond, log_wake_lock);
+		atomic_set(&log_writer_sleeping, 0);
+		lock_unlock(log_wake_lock);
+	}
+}
+
+static void log_flush_sync()
+{
+	lock_wait(log_read_lock);
+	log_drain(log_output_loggers, 0);
+	log_flush_loggers();
+	lock_unlock(log_read_lock);
+}
+
+#if defined(CONF_FAMILY_UNIX)
+static void log_crash_write(const char *data, int size)
+{
+	int i, num = atomic_get(&num_loggers);
+	for(i = 0; i < num; i++)
+	{
+		ssize_t written;
+		if(loggers[i].fd < 0 || size <= 0)
+			continue;
+		written = write(loggers[i].fd, data, size);
+		(void)written; /* nothing left to report a failure to */
+	}
+}
+
+/*
+	Only write(2) is safe here, the loggers, their stdio buffers and the
+	locks can be in any state. Everything after the last flush of the
+	loggers goes straight to the descriptors of the loggers that have
+	one. The slots of lines that the writer thread has already taken
+	still hold them until the queue wraps, so the lines that sat in a
+	stdio buffer are written again from the ring. Lines that the stdio
+	buffer or the writer thread got out in the meantime appear twice.
+*/
+static void log_crash_handler(int sig)
+{
+	int64 pos = atomic_get64(&log_flushed_pos);
+
+	atomic_set(&log_async, 0);
+	while(1)
+	{
+		int first = (int)(pos&LOG_SLOT_MASK);
+		int64 sequence = atomic_get64(&log_sequences[first]);
+		int length, tail;
+
+		/* published, or taken by the writer and not reused yet */
+		if(sequence != pos+1 && sequence != pos+LOG_NUM_SLOTS)
+			break;
+		if(atomic_get64(&log_write_pos) >= pos+LOG_NUM_SLOTS)
+			break;
+		length = log_lengths[first]-1;
+		if(length < 0 || length >= LOG_MAX_LINE)
+			break;
+		tail = first*LOG_SLOT_SIZE+length-LOG_NUM_SLOTS*LOG_SLOT_SIZE;
+		if(tail < 0)
+			tail = 0;
+		log_crash_write(&log_data[first*LOG_SLOT_SIZE], length-tail);
+		log_crash_write(log_data, tail);
+		log_crash_write("\n", 1);
+		pos += (length+1+LOG_SLOT_SIZE-1)/LOG_SLOT_SIZE;
+	}
+
+	/* the handler was reset, so this ends the program as the signal would have */
+	raise(sig);
+}
+#endif
+
+static void log_stop_writer()
+{
+	if(!atomic_get(&log_async))
+		return;
+
+	lock_wait(log_wake_lock);
+	atomic_set(&log_stop, 1);
+	condvar_signal(log_wake_cond);
+	lock_unlock(log_wake_lock);
+	thread_wait(log_thread);
+	log_thread = 0;
+
+	/* everything logged from now on is written directly */
+	atomic_set(&log_async, 0);
+	log_flush_sync();
+}
+
+void dbg_logger_async()
+{
+	int64 i;
+	if(log_thread)
+		return;
+
+	for(i = 0; i < LOG_NUM_SLOTS; i++)
+		log_sequences[i] = i;
+	log_write_pos = 0;
+	log_read_pos = 0;
+	log_flushed_pos = 0;
+	log_stop = 0;
+	log_read_lock = lock_create();
+	log_wake_lock = lock_create();
+	log_wake_cond = condvar_create();
+	log_thread = thread_init(log_writer_thread, 0);
+	if(!log_thread)
+	{
+		dbg_msg("dbg/logger", "failed to start the log writer thread");
+		return;
+	}
+	atomic_set(&log_async, 1);
+
+	atexit(log_stop_writer);
+#if defined(CONF_FAMILY_UNIX)
+	{
+		/* only real crashes, SIGINT and SIGTERM keep their default action */
+		static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+		struct sigaction action;
+		mem_zero(&action, sizeof(action));
+		action.sa_handler = log_crash_handler;
+		action.sa_flags = SA_RESETHAND;
+		sigemptyset(&action.sa_mask);
+		for(i = 0; i < (int)(sizeof(crash_signals)/sizeof(crash_signals[0])); i++)
+			sigaction(crash_signals[i], &action, 0);
+	}
+#endif
+}
+
+void dbg_logger_flush()
+{
+	if(atomic_get(&log_async))
+		log_flush_sync();
+}
+
+int dbg_logger_dropped()
+{
+	return atomic_get(&log_dropped);
+}
+
 void dbg_msg(const char *sys, const char *fmt, ...)
 {
 	va_list args;
@@ -103,13 +448,27 @@ void dbg_msg(const char *sys, const char *fmt, ...)
 #endif
 	va_end(args);
 
+	if(atomic_get(&log_async))
+	{
+		log_queue(str);
+		return;
+	}
+
 	for(i = 0; i < num_loggers; i++)
-		loggers[i](str);
+	{
+		loggers[i].logger(str);
+		if(loggers[i].flush)
+			loggers[i].flush();
+	}
 }
 
 static void logger_stdout(const char *line)
 {
 	printf("%s\n", line);
+}
+
+static void logger_stdout_flush()
+{
 	fflush(stdout);
 }
 
@@ -127,16 +486,32 @@ static void logger_file(const char *line)
 {
 	io_write(logfile, line, strlen(line));
 	io_write_newline(logfile);
+}
+
+static void logger_file_flush()
+{
 	io_flush(logfile);
 }
 
-void dbg_logger_stdout() { dbg_logger(logger_stdout); }
+#if defined(CONF_FAMILY_UNIX)
+void dbg_logger_stdout() { dbg_logger_add(logger_stdout, logger_stdout_flush, STDOUT_FILENO); }
+#else
+void dbg_logger_stdout() { dbg_logger_add(logger_stdout, logger_stdout_flush, -1); }
+#endif
 void dbg_logger_debugger() { dbg_logger(logger_debugger); }
 void dbg_logger_file(const char *filename)
 {
 	logfile = io_open(filename, IOFLAG_WRITE);
 	if(logfile)
-		dbg_logger(logger_file);
+	{
+		/* the writer thread flushes whole batches */
+		setvbuf((FILE *)logfile, 0, _IOFBF, 64*1024);
+#if defined(CONF_FAMILY_UNIX)
+		dbg_logger_add(logger_file, logger_file_flush, fileno((FILE *)logfile));
+#else
+		dbg_logger_add(logger_file, logger_file_flush, -1);
+#endif
+	}
 	else
 		dbg_msg("dbg/logger", "failed to open '%s' for logging", filename);
 
@@ -160,6 +535,20 @@ typedef struct MEMTAIL
 static struct MEMHEADER *first = 0;
 static const int MEM_GUARD_VAL = 0xbaadc0de;
 
+/* the block list and the stats are shared by all threads */
+static volatile int mem_lock = 0;
+
+static void mem_lock_take()
+{
+	while(!atomic_compare_swap(&mem_lock, 0, 1))
+		thread_yield();
+}
+
+static void mem_lock_release()
+{
+	atomic_set(&mem_lock, 0);
+}
+
 void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment)
 {
 	/* TODO: fix alignment */
@@ -173,18 +562,19 @@ void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned al
 	header->size = size;
 	header->filename = filename;
 	header->line = line;
+	tail->guard = MEM_GUARD_VAL;
 
+	mem_lock_take();
 	memory_stats.allocated += header->size;
 	memory_stats.total_allocations++;
 	memory_stats.active_allocations++;
 
-	tail->guard = MEM_GUARD_VAL;
-
 	header->prev = (MEMHEADER *)0;
 	header->next = first;
 	if(first)
 		first->prev = header;
 	first = header;
+	mem_lock_release();
 
 	/*dbg_msg("mem", "++ %p", header+1); */
 	return header+1;
@@ -200,6 +590,7 @@ void mem_free(void *p)
 		if(tail->guard != MEM_GUARD_VAL)
 			dbg_msg("mem", "!! %p", p);
 		/* dbg_msg("mem", "-- %p", p); */
+		mem_lock_take();
 		memory_stats.allocated -= header->size;
 		memory_stats.active_allocations--;
 
@@ -209,6 +600,7 @@ void mem_free(void *p)
 			first = header->next;
 		if(header->next)
 			header->next->prev = header->prev;
+		mem_lock_release();
 
 		free(header);
 	}
@@ -525,6 +917,63 @@ void lock_unlock(LOCK lock)
 #endif
 
 
+/* ----- condition variables ----- */
+#if defined(CONF_FAMILY_UNIX)
+typedef pthread_cond_t CONDVARINTERNAL;
+#elif defined(CONF_FAMILY_WINDOWS)
+typedef CONDITION_VARIABLE CONDVARINTERNAL;
+#else
+	#error not implemented on this platform
+#endif
+
+CONDVAR condvar_create()
+{
+	CONDVARINTERNAL *cond = (CONDVARINTERNAL*)mem_alloc(sizeof(CONDVARINTERNAL), 4);
+
+#if defined(CONF_FAMILY_UNIX)
+	pthread_cond_init(cond, 0x0);
+#elif defined(CONF_FAMILY_WINDOWS)
+	InitializeConditionVariable(cond);
+#endif
+	return (CONDVAR)cond;
+}
+
+void condvar_destroy(CONDVAR cond)
+{
+#if defined(CONF_FAMILY_UNIX)
+	pthread_cond_destroy((CONDVARINTERNAL *)cond);
+#endif
+	mem_free(cond);
+}
+
+void condvar_wait(CONDVAR cond, LOCK lock)
+{
+#if defined(CONF_FAMILY_UNIX)
+	pthread_cond_wait((CONDVARINTERNAL *)cond, (LOCKINTERNAL *)lock);
+#elif defined(CONF_FAMILY_WINDOWS)
+	SleepConditionVariableCS((CONDVARINTERNAL *)cond, (LPCRITICAL_SECTION)lock, INFINITE);
+#endif
+}
+
+void condvar_signal(CONDVAR cond)
+{
+#if defined(CONF_FAMILY_UNIX)
+	pthread_cond_signal((CONDVARINTERNAL *)cond);
+#elif defined(CONF_FAMILY_WINDOWS)
+	WakeConditionVariable((CONDVARINTERNAL *)cond);
+#endif
+}
+
+void condvar_broadcast(CONDVAR cond)
+{
+#if defined(CONF_FAMILY_UNIX)
+	pthread_cond_broadcast((CONDVARINTERNAL *)cond);
+#elif defined(CONF_FAMILY_WINDOWS)
+	WakeAllConditionVariable((CONDVARINTERNAL *)cond);
+#endif
+}
+
+
 /* -----  time ----- */
 int64 time_get()
 {
@@ -1000,6 +1449,7 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 				netaddr_to_sockaddr_in(addr, &sa);
 
 			d = sendto((int)sock.ipv4sock, (const char*)data, size, 0, (struct sockaddr *)&sa, sizeof(sa));
+			network_stats.send_calls++;
 		}
 		else
 			dbg_msg("net", "can't sent ipv4 traffic to this socket");
@@ -1023,6 +1473,7 @@ int net_udp_send(NETSOCKET sock, const NETADDR *addr, const void *data, int size
 				netaddr_to_sockaddr_in6(addr, &sa);
 
 			d = sendto((int)sock.ipv6sock, (const char*)data, size, 0, (struct sockaddr *)&sa, sizeof(sa));
+			network_stats.send_calls++;
 		}
 		else
 			dbg_msg("net", "can't sent ipv6 traffic to this socket");
@@ -1058,12 +1509,14 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize)
 	{
 		fromlen = sizeof(struct sockaddr_in);
 		bytes = recvfrom(sock.ipv4sock, (char*)data, maxsize, 0, (struct sockaddr *)&sockaddrbuf, &fromlen);
+		network_stats.recv_calls++;
 	}
 
 	if(bytes <= 0 && sock.ipv6sock >= 0)
 	{
 		fromlen = sizeof(struct sockaddr_in6);
 		bytes = recvfrom(sock.ipv6sock, (char*)data, maxsize, 0, (struct sockaddr *)&sockaddrbuf, &fromlen);
+		network_stats.recv_calls++;
 	}
 
 	if(bytes > 0)
@@ -1083,6 +1536,214 @@ int net_udp_close(NETSOCKET sock)
 	return priv_net_close_all_sockets(sock);
 }
 
+struct NETRECVBATCH
+{
+	int packet_size;
+	int num_packets;
+	unsigned char *buffers;
+	int sizes[NET_BATCH_MAX_PACKETS];
+	struct sockaddr_storage addrs[NET_BATCH_MAX_PACKETS];
+#if defined(CONF_PLATFORM_LINUX)
+	struct mmsghdr msgs[NET_BATCH_MAX_PACKETS];
+	struct iovec iovs[NET_BATCH_MAX_PACKETS];
+#endif
+};
+
+NETRECVBATCH *net_udp_recv_batch_create(int packet_size)
+{
+	NETRECVBATCH *batch = (NETRECVBATCH *)mem_alloc(sizeof(NETRECVBATCH), 1);
+	mem_zero(batch, sizeof(NETRECVBATCH));
+	batch->packet_size = packet_size;
+	batch->buffers = (unsigned char *)mem_alloc(packet_size*NET_BATCH_MAX_PACKETS, 1);
+	return batch;
+}
+
+void net_udp_recv_batch_destroy(NETRECVBATCH *batch)
+{
+	mem_free(batch->buffers);
+	mem_free(batch);
+}
+
+static int priv_net_udp_recv_batch(int sockfd, NETRECVBATCH *batch)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	int i, num;
+	for(i = 0; i < NET_BATCH_MAX_PACKETS; i++)
+	{
+		batch->iovs[i].iov_base = batch->buffers + i*batch->packet_size;
+		batch->iovs[i].iov_len = batch->packet_size;
+		mem_zero(&batch->msgs[i].msg_hdr, sizeof(batch->msgs[i].msg_hdr));
+		batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+		batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	num = recvmmsg(sockfd, batch->msgs, NET_BATCH_MAX_PACKETS, MSG_DONTWAIT, NULL);
+	network_stats.recv_calls++;
+	for(i = 0; i < num; i++)
+		batch->sizes[i] = batch->msgs[i].msg_len;
+	return num;
+#else
+	int num = 0;
+	while(num < NET_BATCH_MAX_PACKETS)
+	{
+		socklen_t fromlen = sizeof(batch->addrs[num]);
+		int bytes = recvfrom(sockfd, (char *)batch->buffers + num*batch->packet_size, batch->packet_size, 0, (struct sockaddr *)&batch->addrs[num], &fromlen);
+		network_stats.recv_calls++;
+		if(bytes <= 0)
+			break;
+		batch->sizes[num++] = bytes;
+	}
+	return num;
+#endif
+}
+
+int net_udp_recv_batch(NETSOCKET sock, NETRECVBATCH *batch)
+{
+	int i, num = 0;
+
+	if(sock.ipv4sock >= 0)
+		num = priv_net_udp_recv_batch(sock.ipv4sock, batch);
+	if(num <= 0 && sock.ipv6sock >= 0)
+		num = priv_net_udp_recv_batch(sock.ipv6sock, batch);
+
+	if(num < 0)
+		num = 0;
+	for(i = 0; i < num; i++)
+	{
+		network_stats.recv_bytes += batch->sizes[i];
+		network_stats.recv_packets++;
+	}
+	batch->num_packets = num;
+	return num;
+}
+
+int net_udp_recv_batch_get(NETRECVBATCH *batch, int index, NETADDR *addr, unsigned char **data)
+{
+	if(index < 0 || index >= batch->num_packets)
+		return -1;
+
+	sockaddr_to_netaddr((struct sockaddr *)&batch->addrs[index], addr);
+	*data = batch->buffers + index*batch->packet_size;
+	return batch->sizes[index];
+}
+
+struct NETSENDBATCH
+{
+	int packet_size;
+	int num_packets;
+	unsigned char *buffers;
+	int fds[NET_BATCH_MAX_PACKETS];
+	int sizes[NET_BATCH_MAX_PACKETS];
+	struct sockaddr_storage addrs[NET_BATCH_MAX_PACKETS];
+	socklen_t addrlens[NET_BATCH_MAX_PACKETS];
+#if defined(CONF_PLATFORM_LINUX)
+	struct mmsghdr msgs[NET_BATCH_MAX_PACKETS];
+	struct iovec iovs[NET_BATCH_MAX_PACKETS];
+#endif
+};
+
+NETSENDBATCH *net_udp_send_batch_create(int packet_size)
+{
+	NETSENDBATCH *batch = (NETSENDBATCH *)mem_alloc(sizeof(NETSENDBATCH), 1);
+	mem_zero(batch, sizeof(NETSENDBATCH));
+	batch->packet_size = packet_size;
+	batch->buffers = (unsigned char *)mem_alloc(packet_size*NET_BATCH_MAX_PACKETS, 1);
+	return batch;
+}
+
+void net_udp_send_batch_destroy(NETSENDBATCH *batch)
+{
+	mem_free(batch->buffers);
+	mem_free(batch);
+}
+
+int net_udp_send_batch_add(NETSENDBATCH *batch, NETSOCKET sock, const NETADDR *addr, const void *data, int size)
+{
+	int i;
+
+	/* broadcasts and oversized packets are sent right away */
+	if((addr->type&NETTYPE_LINK_BROADCAST) || size > batch->packet_size)
+		return net_udp_send(sock, addr, data, size);
+
+	if(batch->num_packets == NET_BATCH_MAX_PACKETS)
+		net_udp_send_batch_flush(batch);
+
+	i = batch->num_packets;
+	if((addr->type&NETTYPE_IPV4) && sock.ipv4sock >= 0)
+	{
+		batch->fds[i] = sock.ipv4sock;
+		netaddr_to_sockaddr_in(addr, (struct sockaddr_in *)&batch->addrs[i]);
+		batch->addrlens[i] = sizeof(struct sockaddr_in);
+	}
+	else if((addr->type&NETTYPE_IPV6) && sock.ipv6sock >= 0)
+	{
+		batch->fds[i] = sock.ipv6sock;
+		netaddr_to_sockaddr_in6(addr, (struct sockaddr_in6 *)&batch->addrs[i]);
+		batch->addrlens[i] = sizeof(struct sockaddr_in6);
+	}
+	else
+		return net_udp_send(sock, addr, data, size);
+
+	mem_copy(batch->buffers + i*batch->packet_size, data, size);
+	batch->sizes[i] = size;
+	batch->num_packets++;
+	return size;
+}
+
+int net_udp_send_batch_flush(NETSENDBATCH *batch)
+{
+	int start = 0, i;
+	while(start < batch->num_packets)
+	{
+		/* one call per run of packets for the same socket */
+		int end = start+1;
+		while(end < batch->num_packets && batch->fds[end] == batch->fds[start])
+			end++;
+
+#if defined(CONF_PLATFORM_LINUX)
+		for(i = start; i < end; i++)
+		{
+			batch->iovs[i].iov_base = batch->buffers + i*batch->packet_size;
+			batch->iovs[i].iov_len = batch->sizes[i];
+			mem_zero(&batch->msgs[i].msg_hdr, sizeof(batch->msgs[i].msg_hdr));
+			batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+			batch->msgs[i].msg_hdr.msg_namelen = batch->addrlens[i];
+			batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+			batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		i = start;
+		while(i < end)
+		{
+			int sent = sendmmsg(batch->fds[start], &batch->msgs[i], end-i, 0);
+			network_stats.send_calls++;
+			if(sent <= 0)
+				sent = 1; /* drop the packet that failed, like a failed sendto */
+			i += sent;
+		}
+#else
+		for(i = start; i < end; i++)
+		{
+			sendto(batch->fds[i], (const char *)batch->buffers + i*batch->packet_size, batch->sizes[i], 0, (struct sockaddr *)&batch->addrs[i], batch->addrlens[i]);
+			network_stats.send_calls++;
+		}
+#endif
+
+		for(i = start; i < end; i++)
+		{
+			network_stats.sent_bytes += batch->sizes[i];
+			network_stats.sent_packets++;
+		}
+		start = end;
+	}
+
+	i = batch->num_packets;
+	batch->num_packets = 0;
+	return i;
+}
+
 NETSOCKET net_tcp_create(NETADDR bindaddr)
 {
 	NETSOCKET sock = invalid_socket;
@@ -1553,11 +2214,216 @@ int net_socket_read_wait(NETSOCKET sock, int time)
 	return 0;
 }
 
+struct NETWAIT
+{
+	/* watched sockets, on linux these are the ones registered with epoll */
+	int num_fds;
+	int fds[NET_WAIT_MAX_SOCKETS];
+#if defined(CONF_PLATFORM_LINUX)
+	int epoll_fd;
+	int timer_fd;
+#endif
+};
+
+NETWAIT *net_wait_create()
+{
+	NETWAIT *wait = (NETWAIT *)mem_alloc(sizeof(NETWAIT), 1);
+	mem_zero(wait, sizeof(NETWAIT));
+#if defined(CONF_PLATFORM_LINUX)
+	{
+		struct epoll_event ev;
+		wait->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		wait->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if(wait->epoll_fd < 0 || wait->timer_fd < 0)
+		{
+			dbg_msg("net", "failed to create epoll/timerfd, errno=%d", errno);
+			net_wait_destroy(wait);
+			return 0;
+		}
+
+		mem_zero(&ev, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = wait->timer_fd;
+		epoll_ctl(wait->epoll_fd, EPOLL_CTL_ADD, wait->timer_fd, &ev);
+	}
+#endif
+	return wait;
+}
+
+void net_wait_destroy(NETWAIT *wait)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	if(wait->epoll_fd >= 0)
+		close(wait->epoll_fd);
+	if(wait->timer_fd >= 0)
+		close(wait->timer_fd);
+#endif
+	mem_free(wait);
+}
+
+static void net_wait_add_fd(NETWAIT *wait, int fd)
+{
+	int i;
+	if(fd < 0 || wait->num_fds >= NET_WAIT_MAX_SOCKETS)
+		return;
+	for(i = 0; i < wait->num_fds; i++)
+		if(wait->fds[i] == fd)
+			return;
+
+#if defined(CONF_PLATFORM_LINUX)
+	{
+		struct epoll_event ev;
+		mem_zero(&ev, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		if(epoll_ctl(wait->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			dbg_msg("net", "failed to watch socket %d, errno=%d", fd, errno);
+			return;
+		}
+	}
+#endif
+	wait->fds[wait->num_fds++] = fd;
+}
+
+static void net_wait_remove_fd(NETWAIT *wait, int fd)
+{
+	int i;
+	for(i = 0; i < wait->num_fds; i++)
+	{
+		if(wait->fds[i] == fd)
+		{
+#if defined(CONF_PLATFORM_LINUX)
+			epoll_ctl(wait->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+			wait->fds[i] = wait->fds[--wait->num_fds];
+			return;
+		}
+	}
+}
+
+void net_wait_add(NETWAIT *wait, NETSOCKET sock)
+{
+	net_wait_add_fd(wait, sock.ipv4sock);
+	net_wait_add_fd(wait, sock.ipv6sock);
+}
+
+void net_wait_remove(NETWAIT *wait, NETSOCKET sock)
+{
+	net_wait_remove_fd(wait, sock.ipv4sock);
+	net_wait_remove_fd(wait, sock.ipv6sock);
+}
+
+int net_wait(NETWAIT *wait, int64 deadline)
+{
+	int64 timeout = (deadline-time_get())*1000000/time_freq(); /* in microseconds */
+	int result = 0;
+
+#if defined(CONF_PLATFORM_LINUX)
+	{
+		int i, n;
+		struct epoll_event events[NET_WAIT_MAX_SOCKETS+1];
+
+		if(timeout > 0)
+		{
+			/* arming the timer also clears expirations of the previous wait */
+			struct itimerspec spec;
+			mem_zero(&spec, sizeof(spec));
+			spec.it_value.tv_sec = timeout/1000000;
+			spec.it_value.tv_nsec = (timeout%1000000)*1000;
+			timerfd_settime(wait->timer_fd, 0, &spec, NULL);
+
+			/* the millisecond timeout is only a fallback for the timer */
+			n = epoll_wait(wait->epoll_fd, events, NET_WAIT_MAX_SOCKETS+1, (int)(timeout/1000)+1);
+		}
+		else
+			n = epoll_wait(wait->epoll_fd, events, NET_WAIT_MAX_SOCKETS+1, 0);
+
+		for(i = 0; i < n; i++)
+		{
+			if(events[i].data.fd != wait->timer_fd)
+				result = 1;
+		}
+	}
+#else
+	{
+		struct timeval tv;
+		fd_set readfds;
+		int i, maxfd = 0;
+
+		if(timeout < 0)
+			timeout = 0;
+		tv.tv_sec = timeout/1000000;
+		tv.tv_usec = timeout%1000000;
+
+		FD_ZERO(&readfds);
+		for(i = 0; i < wait->num_fds; i++)
+		{
+			FD_SET(wait->fds[i], &readfds);
+			if(wait->fds[i] > maxfd)
+				maxfd = wait->fds[i];
+		}
+
+		/* don't care about writefds and exceptfds */
+		if(select(maxfd+1, &readfds, NULL, NULL, &tv) > 0)
+			result = 1;
+	}
+#endif
+
+	return result;
+}
+
 int time_timestamp()
 {
 	return time(0);
 }
 
+/* ----- atomics ----- */
+#if defined(__GNUC__)
+int atomic_get(volatile int *value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+void atomic_set(volatile int *value, int new_value) { __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST); }
+int atomic_add(volatile int *value, int amount) { return __atomic_add_fetch(value, amount, __ATOMIC_SEQ_CST); }
+int atomic_compare_swap(volatile int *value, int expected, int new_value)
+{
+	return __atomic_compare_exchange_n(value, &expected, new_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+int64 atomic_get64(volatile int64 *value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+void atomic_set64(volatile int64 *value, int64 new_value) { __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST); }
+int atomic_compare_swap64(volatile int64 *value, int64 expected, int64 new_value)
+{
+	return __atomic_compare_exchange_n(value, &expected, new_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void *atomic_get_ptr(void *volatile *value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+void atomic_set_ptr(void *volatile *value, void *new_value) { __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST); }
+
+void atomic_fence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+#elif defined(CONF_FAMILY_WINDOWS)
+/* the interlocked functions are full barriers */
+int atomic_get(volatile int *value) { return InterlockedCompareExchange((volatile LONG *)value, 0, 0); }
+void atomic_set(volatile int *value, int new_value) { InterlockedExchange((volatile LONG *)value, new_value); }
+int atomic_add(volatile int *value, int amount) { return InterlockedExchangeAdd((volatile LONG *)value, amount)+amount; }
+int atomic_compare_swap(volatile int *value, int expected, int new_value)
+{
+	return InterlockedCompareExchange((volatile LONG *)value, new_value, expected) == expected;
+}
+
+int64 atomic_get64(volatile int64 *value) { return InterlockedCompareExchange64(value, 0, 0); }
+void atomic_set64(volatile int64 *value, int64 new_value) { InterlockedExchange64(value, new_value); }
+int atomic_compare_swap64(volatile int64 *value, int64 expected, int64 new_value)
+{
+	return InterlockedCompareExchange64(value, new_value, expected) == expected;
+}
+
+void *atomic_get_ptr(void *volatile *value) { return InterlockedCompareExchangePointer(value, 0, 0); }
+void atomic_set_ptr(void *volatile *value, void *new_value) { InterlockedExchangePointer(value, new_value); }
+
+void atomic_fence() { MemoryBarrier(); }
+#else
+	#error not implemented on this platform
+#endif
+
 void str_append(char *dst, const char *src, int dst_size)
 {
 	int s = strlen(dst);
@@ -2117,6 +2983,32 @@ void secure_random_fill(void *bytes, size_t length)
 #endif
 }
 
+int cpu_features()
+{
+	int features = 0;
+#if defined(CONF_ARCH_IA32) || defined(CONF_ARCH_AMD64)
+#if defined(_MSC_VER)
+	int info[4];
+	int os_avx;
+	__cpuid(info, 1);
+	if(info[3]&(1<<26))
+		features |= CPUFEATURE_SSE2;
+	/* the os has to save the ymm registers on context switches */
+	os_avx = (info[2]&(1<<27)) && (info[2]&(1<<28)) && (_xgetbv(0)&6) == 6;
+	__cpuidex(info, 7, 0);
+	if(os_avx && (info[1]&(1<<5)))
+		features |= CPUFEATURE_AVX2;
+#elif defined(__GNUC__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))
+		features |= CPUFEATURE_SSE2;
+	if(__builtin_cpu_supports("avx2"))
+		features |= CPUFEATURE_AVX2;
+#endif
+#endif
+	return features;
+}
+
 #if defined(__cplusplus)
 }
 #endif
@@ -87,6 +87,7 @@ void dbg_msg(const char *sys, const char *fmt, ...);
 	Remarks:
 		- Passing 0 to size will allocated the smallest amount possible
 		and return a unique pointer.
+		- Safe to call from any thread.
 
 	See Also:
 		<mem_free>
@@ -427,6 +428,30 @@ void lock_unlock(LOCK lock);
 	void semaphore_destroy(SEMAPHORE *sem);
 #endif
 
+/* Group: Condition variables */
+typedef void* CONDVAR;
+
+/*
+	Function: condvar_create
+		Creates a condition variable to be used together with a <LOCK>.
+*/
+CONDVAR condvar_create();
+void condvar_destroy(CONDVAR cond);
+
+/*
+	Function: condvar_wait
+		Releases the lock, sleeps until the condition variable is
+		signaled and takes the lock again before returning. Wakeups
+		can be spurious, so the condition has to be checked again.
+
+	Parameters:
+		cond - Condition variable to wait on.
+		lock - Lock that the calling thread holds.
+*/
+void condvar_wait(CONDVAR cond, LOCK lock);
+void condvar_signal(CONDVAR cond);
+void condvar_broadcast(CONDVAR cond);
+
 /* Group: Timer */
 #ifdef __GNUC__
 /* if compiled with -pedantic-errors it will complain about long
@@ -466,6 +491,49 @@ int64 time_freq();
 */
 int time_timestamp();
 
+/* Group: Atomics */
+
+/*
+	Function: atomic_get
+		Reads an integer that other threads change concurrently.
+
+	Remarks:
+		All atomic operations are sequentially consistent.
+*/
+int atomic_get(volatile int *value);
+void atomic_set(volatile int *value, int new_value);
+
+/*
+	Function: atomic_add
+		Adds to an integer in one indivisible step.
+
+	Returns:
+		The new value.
+*/
+int atomic_add(volatile int *value, int amount);
+
+/*
+	Function: atomic_compare_swap
+		Replaces an integer with new_value if it still equals expected.
+
+	Returns:
+		1 if the value was replaced, 0 otherwise.
+*/
+int atomic_compare_swap(volatile int *value, int expected, int new_value);
+
+int64 atomic_get64(volatile int64 *value);
+void atomic_set64(volatile int64 *value, int64 new_value);
+int atomic_compare_swap64(volatile int64 *value, int64 expected, int64 new_value);
+
+void *atomic_get_ptr(void *volatile *value);
+void atomic_set_ptr(void *volatile *value, void *new_value);
+
+/*
+	Function: atomic_fence
+		Full memory barrier.
+*/
+void atomic_fence();
+
 /* Group: Network General */
 typedef struct
 {
@@ -619,6 +687,79 @@ int net_udp_recv(NETSOCKET sock, NETADDR *addr, void *data, int maxsize);
 */
 int net_udp_close(NETSOCKET sock);
 
+/* Group: Network Batches */
+enum
+{
+	NET_BATCH_MAX_PACKETS = 64
+};
+
+typedef struct NETRECVBATCH NETRECVBATCH;
+typedef struct NETSENDBATCH NETSENDBATCH;
+
+/*
+	Function: net_udp_recv_batch_create
+		Creates buffers for receiving up to NET_BATCH_MAX_PACKETS
+		packets with one call (recvmmsg on Linux).
+
+	Parameters:
+		packet_size - Maximum size of a single packet.
+*/
+NETRECVBATCH *net_udp_recv_batch_create(int packet_size);
+void net_udp_recv_batch_destroy(NETRECVBATCH *batch);
+
+/*
+	Function: net_udp_recv_batch
+		Receives all pending packets that fit into the batch
+		without blocking.
+
+	Returns:
+		Number of packets received, 0 if there are none.
+*/
+int net_udp_recv_batch(NETSOCKET sock, NETRECVBATCH *batch);
+
+/*
+	Function: net_udp_recv_batch_get
+		Gets a packet from the last <net_udp_recv_batch> call.
+
+	Parameters:
+		batch - Batch to read from.
+		index - Packet index.
+		addr - Receives the sender address.
+		data - Receives a pointer to the packet data, valid until
+			the next receive.
+
+	Returns:
+		Size of the packet, -1 if the index is out of range.
+*/
+int net_udp_recv_batch_get(NETRECVBATCH *batch, int index, NETADDR *addr, unsigned char **data);
+
+/*
+	Function: net_udp_send_batch_create
+		Creates a queue for sending packets with one call
+		(sendmmsg on Linux).
+
+	Parameters:
+		packet_size - Maximum size of a single packet.
+*/
+NETSENDBATCH *net_udp_send_batch_create(int packet_size);
+void net_udp_send_batch_destroy(NETSENDBATCH *batch);
+
+/*
+	Function: net_udp_send_batch_add
+		Queues a packet, same parameters as <net_udp_send>. The
+		data is copied. Flushes the queue when it is full.
+*/
+int net_udp_send_batch_add(NETSENDBATCH *batch, NETSOCKET sock, const NETADDR *addr, const void *data, int size);
+
+/*
+	Function: net_udp_send_batch_flush
+		Sends all queued packets.
+
+	Returns:
+		Number of packets sent.
+*/
+int net_udp_send_batch_flush(NETSENDBATCH *batch);
+
 
 /* Group: Network TCP */
 
@@ -1171,6 +1312,63 @@ int net_would_block();
 
 int net_socket_read_wait(NETSOCKET sock, int time);
 
+/* Group: Network Wait */
+enum
+{
+	NET_WAIT_MAX_SOCKETS = 32
+};
+
+typedef struct NETWAIT NETWAIT;
+
+/*
+	Function: net_wait_create
+		Creates a wait set that sleeps until one of its sockets
+		is readable or a deadline is reached. Uses epoll and a
+		timerfd on Linux and select elsewhere.
+
+	Returns:
+		The wait set or 0 on failure.
+*/
+NETWAIT *net_wait_create();
+
+/*
+	Function: net_wait_destroy
+		Frees a wait set created by <net_wait_create>.
+*/
+void net_wait_destroy(NETWAIT *wait);
+
+/*
+	Function: net_wait_add
+		Watches a socket in all following <net_wait> calls.
+		Adding a socket that is already watched does nothing.
+
+	Remarks:
+		Remove the socket with <net_wait_remove> before it is
+		closed. Its descriptor may be reused by the next socket,
+		which would then look watched but never wake the wait.
+*/
+void net_wait_add(NETWAIT *wait, NETSOCKET sock);
+
+/*
+	Function: net_wait_remove
+		Stops watching a socket added with <net_wait_add>.
+*/
+void net_wait_remove(NETWAIT *wait, NETSOCKET sock);
+
+/*
+	Function: net_wait
+		Waits until one of the watched sockets is readable or
+		the deadline is reached.
+
+	Parameters:
+		wait - Wait set.
+		deadline - Absolute time as returned by <time_get>.
+
+	Returns:
+		1 if a socket is readable, 0 on timeout.
+*/
+int net_wait(NETWAIT *wait, int64 deadline);
+
 void mem_debug_dump(IOHANDLE file);
 
 void swap_endian(void *data, unsigned elem_size, unsigned num);
@@ -1183,6 +1381,35 @@ void dbg_logger_stdout();
 void dbg_logger_debugger();
 void dbg_logger_file(const char *filename);
 
+/*
+	Function: dbg_logger_async
+		Moves the output of <dbg_msg> to a background thread. The
+		calling thread only formats the line and puts it into a
+		bounded queue, the loggers are called and flushed by the
+		writer thread. Lines that don't fit into the queue are
+		dropped and counted.
+
+	Remarks:
+		The queue is written out when the program exits, on a failed
+		assertion and, on unix, when the program crashes. Lines that
+		are still queued when the program is killed by a signal are
+		lost.
+*/
+void dbg_logger_async();
+
+/*
+	Function: dbg_logger_flush
+		Writes out all queued lines and flushes the loggers.
+*/
+void dbg_logger_flush();
+
+/*
+	Function: dbg_logger_dropped
+		Returns the number of lines that were dropped because the
+		queue was full.
+*/
+int dbg_logger_dropped();
+
 typedef struct
 {
 	int allocated;
@@ -1198,6 +1425,8 @@ typedef struct
 	int sent_bytes;
 	int recv_packets;
 	int recv_bytes;
+	int send_calls; /* socket syscalls, a batch counts as one */
+	int recv_calls;
 } NETSTATS;
 
 
@@ -1320,6 +1549,22 @@ int secure_random_init();
 */
 void secure_random_fill(void *bytes, size_t length);
 
+enum
+{
+	CPUFEATURE_SSE2=1,
+	CPUFEATURE_AVX2=2
+};
+
+/*
+	Function: cpu_features
+		Checks which vector instruction sets can be used.
+
+	Returns:
+		A combination of the CPUFEATURE_* flags for the instruction
+		sets that both the processor and the operating system support.
+*/
+int cpu_features();
+
 #ifdef __cplusplus
 }
 #endif
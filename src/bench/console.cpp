@@ -0,0 +1,125 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/shared/config.h>
+
+#include <stdio.h>
+
+/*
+	Looks up and executes the server's integer variables through a fresh
+	console, with its hashed lookup and with a walk over the command
+	list like the lookup before the hash index. The console is filled up
+	with commands that do nothing to the size of the server's.
+
+	usage: bench_console [lines] [commands]
+*/
+
+enum
+{
+	MAX_VARIABLES=1024,
+	MAX_COMMANDS=4096,
+};
+
+static char s_aaFillerNames[MAX_COMMANDS][16];
+
+static void ConNothing(IConsole::IResult *pResult, void *pUser)
+{
+}
+
+static int s_Value;
+static bool s_GotValue;
+
+static void PrintValue(const char *pStr, void *pUser)
+{
+	const char *pValue = str_find(pStr, "Value: ");
+	if(pValue)
+	{
+		s_Value = str_toint(pValue+7);
+		s_GotValue = true;
+	}
+}
+
+static const IConsole::CCommandInfo *FindLinear(IConsole *pConsole, const char *pName)
+{
+	for(const IConsole::CCommandInfo *pInfo = pConsole->FirstCommandInfo(IConsole::ACCESS_LEVEL_ADMIN, CFGFLAG_SERVER); pInfo;
+		pInfo = pInfo->NextCommandInfo(IConsole::ACCESS_LEVEL_ADMIN, CFGFLAG_SERVER))
+	{
+		if(str_comp_nocase(pInfo->m_pName, pName) == 0)
+			return pInfo;
+	}
+	return 0;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumLines = argc > 1 ? clamp(str_toint(argv[1]), 1, 1000000) : 20000; // ignore_convention
+	int NumFillers = argc > 2 ? clamp(str_toint(argv[2]), 0, (int)MAX_COMMANDS) : 400; // ignore_convention
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	pConsole->RegisterPrintCallback(IConsole::OUTPUT_LEVEL_STANDARD, PrintValue, 0);
+	for(int i = 0; i < NumFillers; i++)
+	{
+		str_format(s_aaFillerNames[i], sizeof(s_aaFillerNames[i]), "filler_%d", i);
+		pConsole->Register(s_aaFillerNames[i], "", CFGFLAG_SERVER, ConNothing, 0, "");
+	}
+
+	// the same variables the server registers, set to their current values
+	const IConsole::CCommandInfo *apVariables[MAX_VARIABLES];
+	char aaLines[MAX_VARIABLES][128];
+	int NumCommands = 0;
+	int NumVariables = 0;
+	for(const IConsole::CCommandInfo *pInfo = pConsole->FirstCommandInfo(IConsole::ACCESS_LEVEL_ADMIN, CFGFLAG_SERVER); pInfo;
+		pInfo = pInfo->NextCommandInfo(IConsole::ACCESS_LEVEL_ADMIN, CFGFLAG_SERVER))
+	{
+		NumCommands++;
+		if(NumVariables == MAX_VARIABLES || str_comp(pInfo->m_pParams, "?i") != 0)
+			continue;
+
+		// a variable prints its value when it is executed without one
+		s_GotValue = false;
+		pConsole->ExecuteLine(pInfo->m_pName, -1);
+		if(!s_GotValue)
+			continue;
+		str_format(aaLines[NumVariables], sizeof(aaLines[NumVariables]), "%s %d", pInfo->m_pName, s_Value);
+		apVariables[NumVariables++] = pInfo;
+	}
+	if(!NumVariables)
+	{
+		printf("no integer variables registered\n");
+		return 1;
+	}
+
+	// alternate the runs and keep the best of each
+	static const char *s_apNames[3] = {"linear lookup", "hashed lookup", "execute"};
+	int64 aBest[3] = {0, 0, 0};
+	int Errors = 0;
+	for(int Round = 0; Round < 3; Round++)
+	{
+		for(int Mode = 0; Mode < 3; Mode++)
+		{
+			int64 Start = time_get();
+			for(int Line = 0; Line < NumLines; Line++)
+			{
+				int Variable = Line%NumVariables;
+				if(Mode == 0)
+					Errors += FindLinear(pConsole, apVariables[Variable]->m_pName) != apVariables[Variable];
+				else if(Mode == 1)
+					Errors += pConsole->GetCommandInfo(apVariables[Variable]->m_pName, CFGFLAG_SERVER, false) != apVariables[Variable];
+				else
+					pConsole->ExecuteLine(aaLines[Variable], -1);
+			}
+			int64 Time = time_get()-Start;
+			if(!aBest[Mode] || Time < aBest[Mode])
+				aBest[Mode] = Time;
+		}
+	}
+
+	printf("%d lines over %d of %d commands, %d lookup errors\n", NumLines, NumVariables, NumCommands, Errors);
+	for(int i = 0; i < 3; i++)
+		printf("%s: %.2f ms, %.3f us/line\n", s_apNames[i], aBest[i]*1000.0/time_freq(), aBest[i]*1000000.0/time_freq()/NumLines);
+
+	delete pConsole;
+	return Errors ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+
+#include "snapshots.h"
+
+/*
+	Records the same made up round, with one snapshot message per
+	client and tick, once encoding on the calling thread and once on
+	the writer thread. Compares the time the calling thread spends per
+	tick and the written files.
+
+	usage: bench_demo [clients]
+*/
+
+enum
+{
+	NUM_TICKS=1000,
+	NUM_FRAMES=150,
+	MAP_SIZE=256*1024,
+};
+
+static const char *s_pDir = "bench_demo.tmp";
+
+// keeps all files of the bench in one directory next to the program
+class CBenchStorage : public IStorage
+{
+	const char *GetPath(const char *pFilename, char *pBuffer, unsigned BufferSize)
+	{
+		str_format(pBuffer, BufferSize, "%s/%s", s_pDir, pFilename);
+		return pBuffer;
+	}
+
+public:
+	virtual void ListDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser) {}
+	virtual IOHANDLE OpenFile(const char *pFilename, int Flags, int Type, char *pBuffer = 0, int BufferSize = 0)
+	{
+		char aBuf[512];
+		return io_open(GetPath(pFilename, aBuf, sizeof(aBuf)), Flags);
+	}
+	virtual bool FindFile(const char *pFilename, const char *pPath, int Type, char *pBuffer, int BufferSize) { return false; }
+	virtual bool RemoveFile(const char *pFilename, int Type)
+	{
+		char aBuf[512];
+		return !fs_remove(GetPath(pFilename, aBuf, sizeof(aBuf)));
+	}
+	virtual bool RenameFile(const char* pOldFilename, const char* pNewFilename, int Type) { return false; }
+	virtual bool CreateFolder(const char *pFoldername, int Type)
+	{
+		char aBuf[512];
+		return !fs_makedir(GetPath(pFoldername, aBuf, sizeof(aBuf)));
+	}
+	virtual void GetCompletePath(int Type, const char *pDir, char *pBuffer, unsigned BufferSize) { GetPath(pDir, pBuffer, BufferSize); }
+};
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumClients = argc > 1 ? clamp(str_toint(argv[1]), 1, (int)CBenchGame::MAX_PLAYERS) : 16; // ignore_convention
+	dbg_logger_stdout();
+
+	CBenchStorage Storage;
+	IConsole *pConsole = CreateConsole(CFGFLAG_SERVER);
+	CSnapshotDelta *pSnapshotDelta = new CSnapshotDelta();
+	CBenchGame::SetStaticSizes(pSnapshotDelta);
+
+	// a map of random bytes, the recorder copies it into the demo
+	fs_makedir(s_pDir);
+	Storage.CreateFolder("maps", IStorage::TYPE_SAVE);
+	Storage.CreateFolder("demos", IStorage::TYPE_SAVE);
+	IOHANDLE MapFile = Storage.OpenFile("maps/bench.map", IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!MapFile)
+	{
+		printf("failed to create %s/maps/bench.map\n", s_pDir);
+		return 1;
+	}
+	unsigned char *pMap = (unsigned char *)mem_alloc(MAP_SIZE, 1);
+	for(int i = 0; i < MAP_SIZE; i++)
+		pMap[i] = (unsigned char)((i*2654435761u)>>24);
+	io_write(MapFile, pMap, MAP_SIZE);
+	io_close(MapFile);
+	mem_free(pMap);
+
+	// the demo sees everything, every client gets a packed delta per tick, cut to one snapshot packet
+	CBenchGame Game;
+	Game.Init(NumClients, 1);
+	char *pFrames = (char *)mem_alloc(NUM_FRAMES*CSnapshot::MAX_SIZE, 1);
+	int aFrameSizes[NUM_FRAMES];
+	char *pMessages = (char *)mem_alloc(NumClients*NUM_FRAMES*MAX_SNAPSHOT_PACKSIZE, 1);
+	int *pMessageSizes = (int *)mem_alloc(NumClients*NUM_FRAMES*sizeof(int), 1);
+	char *pPrev = (char *)mem_alloc(NumClients*CSnapshot::MAX_SIZE, 1);
+	CSnapshotIndexBuffer *pIndices = new CSnapshotIndexBuffer[NumClients+1]; // one spare for the new snapshot
+	char aSnap[CSnapshot::MAX_SIZE];
+	char aDelta[CSnapshot::MAX_SIZE];
+	char aPacked[CSnapshot::MAX_SIZE*2];
+	int MessageBytes = 0;
+	for(int c = 0; c < NumClients; c++)
+	{
+		((CSnapshot *)(pPrev+c*CSnapshot::MAX_SIZE))->Clear();
+		pIndices[c].Index()->Build((CSnapshot *)(pPrev+c*CSnapshot::MAX_SIZE));
+	}
+	for(int f = 0; f < NUM_FRAMES; f++)
+	{
+		Game.Tick();
+		aFrameSizes[f] = Game.Snap(-1, pFrames+f*CSnapshot::MAX_SIZE);
+		for(int c = 0; c < NumClients; c++)
+		{
+			CSnapshot *pFrom = (CSnapshot *)(pPrev+c*CSnapshot::MAX_SIZE);
+			int SnapSize = Game.Snap(c, aSnap);
+			int DeltaSize = pSnapshotDelta->CreateDelta(pFrom, (CSnapshot *)aSnap, aDelta, pIndices[c].Index(), &pIndices[NumClients]);
+			int Size = min(DeltaSize ? (int)CVariableInt::Compress(aDelta, DeltaSize, aPacked) : 0, (int)MAX_SNAPSHOT_PACKSIZE);
+			mem_copy(pMessages+(c*NUM_FRAMES+f)*MAX_SNAPSHOT_PACKSIZE, aPacked, Size);
+			pMessageSizes[c*NUM_FRAMES+f] = Size;
+			MessageBytes += Size;
+			mem_copy(pFrom, aSnap, SnapSize);
+			std::swap(pIndices[c], pIndices[NumClients]);
+		}
+	}
+	delete [] pIndices;
+	mem_free(pPrev);
+
+	printf("recording %d ticks, %d snapshots of %d clients, %d KB of messages per %d ticks\n",
+		(int)NUM_TICKS, (int)NUM_FRAMES, NumClients, MessageBytes/1024, (int)NUM_FRAMES);
+
+	static const char *s_apModes[2] = {"inline", "threaded"};
+	char aaFilenames[2][64];
+	int64 *pTimes = (int64 *)mem_alloc(NUM_TICKS*sizeof(int64), 1);
+	for(int Mode = 0; Mode < 2; Mode++)
+	{
+		CDemoRecorder *pRecorder = new CDemoRecorder(pSnapshotDelta);
+		pRecorder->SetThreaded(Mode == 1);
+		str_format(aaFilenames[Mode], sizeof(aaFilenames[Mode]), "demos/%s.demo", s_apModes[Mode]);
+		if(pRecorder->Start(&Storage, pConsole, aaFilenames[Mode], "0.6 bench", "bench", 0, "server") != 0)
+		{
+			printf("failed to record %s/%s\n", s_pDir, aaFilenames[Mode]);
+			delete pRecorder;
+			aaFilenames[Mode][0] = 0;
+			continue;
+		}
+
+		// like the server, a tick records the demo snapshot and then the messages to the clients
+		int64 Total = 0;
+		for(int t = 0; t < NUM_TICKS; t++)
+		{
+			int f = t%NUM_FRAMES;
+			int64 Start = time_get();
+			pRecorder->RecordSnapshot(t, pFrames+f*CSnapshot::MAX_SIZE, aFrameSizes[f]);
+			for(int c = 0; c < NumClients; c++)
+			{
+				if(pMessageSizes[c*NUM_FRAMES+f])
+					pRecorder->RecordMessage(pMessages+(c*NUM_FRAMES+f)*MAX_SNAPSHOT_PACKSIZE, pMessageSizes[c*NUM_FRAMES+f]);
+			}
+			pTimes[t] = time_get()-Start;
+			Total += pTimes[t];
+
+			// leave the writer thread the time it has between real ticks
+			if(t%4 == 3)
+				thread_sleep(1);
+		}
+		int64 StopStart = time_get();
+		int NumStalls = pRecorder->NumStalls();
+		pRecorder->Stop();
+		int64 StopTime = time_get()-StopStart;
+		delete pRecorder;
+
+		std::sort(pTimes, pTimes+NUM_TICKS);
+		int64 Freq = time_freq();
+		printf("%-8s per tick: avg %7.2fus p50 %7.2fus p99 %7.2fus, stop %6.2fms, queue full %d times\n",
+			s_apModes[Mode], Total*1000000.0/Freq/NUM_TICKS, pTimes[NUM_TICKS/2]*1000000.0/Freq,
+			pTimes[NUM_TICKS*99/100]*1000000.0/Freq, StopTime*1000.0/Freq, NumStalls);
+	}
+	mem_free(pTimes);
+	mem_free(pMessageSizes);
+	mem_free(pMessages);
+	mem_free(pFrames);
+
+	// the files must only differ in the timestamp of the header
+	bool Same = false;
+	if(aaFilenames[0][0] && aaFilenames[1][0])
+	{
+		char *apData[2] = {0, 0};
+		int aSizes[2] = {0, 0};
+		for(int Mode = 0; Mode < 2; Mode++)
+		{
+			IOHANDLE File = Storage.OpenFile(aaFilenames[Mode], IOFLAG_READ, IStorage::TYPE_SAVE);
+			if(!File)
+				continue;
+			aSizes[Mode] = io_length(File);
+			apData[Mode] = (char *)mem_alloc(aSizes[Mode]+1, 1);
+			io_read(File, apData[Mode], aSizes[Mode]);
+			io_close(File);
+		}
+		// the unused timeline marker slots are not initialized
+		int Offset = sizeof(CDemoHeader)+sizeof(CTimelineMarkers);
+		Same = apData[0] && apData[1] && aSizes[0] == aSizes[1] && aSizes[0] >= Offset &&
+			mem_comp(apData[0]+Offset, apData[1]+Offset, aSizes[0]-Offset) == 0 &&
+			mem_comp(apData[0], apData[1], offsetof(CDemoHeader, m_aTimestamp)) == 0;
+		printf("files %s apart from the header timestamp, %d and %d bytes\n", Same ? "identical" : "DIFFERENT", aSizes[0], aSizes[1]);
+		for(int Mode = 0; Mode < 2; Mode++)
+			mem_free(apData[Mode]);
+	}
+
+	for(int Mode = 0; Mode < 2; Mode++)
+	{
+		if(aaFilenames[Mode][0])
+			Storage.RemoveFile(aaFilenames[Mode], IStorage::TYPE_SAVE);
+	}
+	Storage.RemoveFile("maps/bench.map", IStorage::TYPE_SAVE);
+	Storage.RemoveFile("maps", IStorage::TYPE_SAVE);
+	Storage.RemoveFile("demos", IStorage::TYPE_SAVE);
+	fs_remove(s_pDir);
+
+	delete pSnapshotDelta;
+	delete pConsole;
+	return Same ? 0 : 1;
+}
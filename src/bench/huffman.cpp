@@ -0,0 +1,558 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/shared/compression.h>
+#include <engine/shared/network.h>
+#include <engine/shared/snapshot.h>
+
+#include <stdio.h>
+
+#include "snapshots.h"
+
+/*
+	Runs random, snapshot and corrupted data through the huffman coder
+	of the network code and through the tree walking coder it replaced,
+	reports every difference in the output or the return values and
+	compares the throughput on the packed snapshot deltas of a made up
+	round.
+
+	usage: bench_huffman [clients] [ticks]
+*/
+
+// the coder as it was before the decode table, which the fast one has to match
+class CReferenceHuffman
+{
+	enum
+	{
+		HUFFMAN_EOF_SYMBOL = 256,
+
+		HUFFMAN_MAX_SYMBOLS=HUFFMAN_EOF_SYMBOL+1,
+		HUFFMAN_MAX_NODES=HUFFMAN_MAX_SYMBOLS*2-1,
+
+		HUFFMAN_LUTBITS = 10,
+		HUFFMAN_LUTSIZE = (1<<HUFFMAN_LUTBITS),
+		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1)
+	};
+
+	struct CNode
+	{
+		unsigned m_Bits;
+		unsigned m_NumBits;
+		unsigned short m_aLeafs[2];
+		unsigned char m_Symbol;
+	};
+
+	CNode m_aNodes[HUFFMAN_MAX_NODES];
+	CNode *m_apDecodeLut[HUFFMAN_LUTSIZE];
+	CNode *m_pStartNode;
+	int m_NumNodes;
+
+	void Setbits_r(CNode *pNode, int Bits, unsigned Depth);
+	void ConstructTree(const unsigned *pFrequencies);
+
+public:
+	void Init(const unsigned *pFrequencies);
+	int Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+	int Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize);
+};
+
+struct CConstructNode
+{
+	unsigned short m_NodeId;
+	int m_Frequency;
+};
+
+void CReferenceHuffman::Setbits_r(CNode *pNode, int Bits, unsigned Depth)
+{
+	if(pNode->m_aLeafs[1] != 0xffff)
+		Setbits_r(&m_aNodes[pNode->m_aLeafs[1]], Bits|(1<<Depth), Depth+1);
+	if(pNode->m_aLeafs[0] != 0xffff)
+		Setbits_r(&m_aNodes[pNode->m_aLeafs[0]], Bits, Depth+1);
+
+	if(pNode->m_NumBits)
+	{
+		pNode->m_Bits = Bits;
+		pNode->m_NumBits = Depth;
+	}
+}
+
+// TODO: this should be something faster, but it's enough for now
+static void BubbleSort(CConstructNode **ppList, int Size)
+{
+	int Changed = 1;
+	CConstructNode *pTemp;
+
+	while(Changed)
+	{
+		Changed = 0;
+		for(int i = 0; i < Size-1; i++)
+		{
+			if(ppList[i]->m_Frequency < ppList[i+1]->m_Frequency)
+			{
+				pTemp = ppList[i];
+				ppList[i] = ppList[i+1];
+				ppList[i+1] = pTemp;
+				Changed = 1;
+			}
+		}
+		Size--;
+	}
+}
+
+void CReferenceHuffman::ConstructTree(const unsigned *pFrequencies)
+{
+	CConstructNode aNodesLeftStorage[HUFFMAN_MAX_SYMBOLS];
+	CConstructNode *apNodesLeft[HUFFMAN_MAX_SYMBOLS];
+	int NumNodesLeft = HUFFMAN_MAX_SYMBOLS;
+
+	// add the symbols
+	for(int i = 0; i < HUFFMAN_MAX_SYMBOLS; i++)
+	{
+		m_aNodes[i].m_NumBits = 0xFFFFFFFF;
+		m_aNodes[i].m_Symbol = i;
+		m_aNodes[i].m_aLeafs[0] = 0xffff;
+		m_aNodes[i].m_aLeafs[1] = 0xffff;
+
+		if(i == HUFFMAN_EOF_SYMBOL)
+			aNodesLeftStorage[i].m_Frequency = 1;
+		else
+			aNodesLeftStorage[i].m_Frequency = pFrequencies[i];
+		aNodesLeftStorage[i].m_NodeId = i;
+		apNodesLeft[i] = &aNodesLeftStorage[i];
+
+	}
+
+	m_NumNodes = HUFFMAN_MAX_SYMBOLS;
+
+	// construct the table
+	while(NumNodesLeft > 1)
+	{
+		// we can't rely on stdlib's qsort for this, it can generate different results on different implementations
+		BubbleSort(apNodesLeft, NumNodesLeft);
+
+		m_aNodes[m_NumNodes].m_NumBits = 0;
+		m_aNodes[m_NumNodes].m_aLeafs[0] = apNodesLeft[NumNodesLeft-1]->m_NodeId;
+		m_aNodes[m_NumNodes].m_aLeafs[1] = apNodesLeft[NumNodesLeft-2]->m_NodeId;
+		apNodesLeft[NumNodesLeft-2]->m_NodeId = m_NumNodes;
+		apNodesLeft[NumNodesLeft-2]->m_Frequency = apNodesLeft[NumNodesLeft-1]->m_Frequency + apNodesLeft[NumNodesLeft-2]->m_Frequency;
+
+		m_NumNodes++;
+		NumNodesLeft--;
+	}
+
+	// set start node
+	m_pStartNode = &m_aNodes[m_NumNodes-1];
+
+	// build symbol bits
+	Setbits_r(m_pStartNode, 0, 0);
+}
+
+void CReferenceHuffman::Init(const unsigned *pFrequencies)
+{
+	int i;
+
+	// make sure to cleanout every thing
+	mem_zero(this, sizeof(*this));
+
+	// construct the tree
+	ConstructTree(pFrequencies);
+
+	// build decode LUT
+	for(i = 0; i < HUFFMAN_LUTSIZE; i++)
+	{
+		unsigned Bits = i;
+		int k;
+		CNode *pNode = m_pStartNode;
+		for(k = 0; k < HUFFMAN_LUTBITS; k++)
+		{
+			pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
+			Bits >>= 1;
+
+			if(!pNode)
+				break;
+
+			if(pNode->m_NumBits)
+			{
+				m_apDecodeLut[i] = pNode;
+				break;
+			}
+		}
+
+		if(k == HUFFMAN_LUTBITS)
+			m_apDecodeLut[i] = pNode;
+	}
+
+}
+
+int CReferenceHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	// this macro loads a symbol for a byte into bits and bitcount
+#define HUFFMAN_MACRO_LOADSYMBOL(Sym) \
+	Bits |= m_aNodes[Sym].m_Bits << Bitcount; \
+	Bitcount += m_aNodes[Sym].m_NumBits;
+
+	// this macro writes the symbol stored in bits and bitcount to the dst pointer
+#define HUFFMAN_MACRO_WRITE() \
+	while(Bitcount >= 8) \
+	{ \
+		*pDst++ = (unsigned char)(Bits&0xff); \
+		if(pDst == pDstEnd) \
+			return -1; \
+		Bits >>= 8; \
+		Bitcount -= 8; \
+	}
+
+	// setup buffer pointers
+	const unsigned char *pSrc = (const unsigned char *)pInput;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
+	unsigned char *pDst = (unsigned char *)pOutput;
+	unsigned char *pDstEnd = pDst + OutputSize;
+
+	// symbol variables
+	unsigned Bits = 0;
+	unsigned Bitcount = 0;
+
+	// make sure that we have data that we want to compress
+	if(InputSize)
+	{
+		// {A} load the first symbol
+		int Symbol = *pSrc++;
+
+		while(pSrc != pSrcEnd)
+		{
+			// {B} load the symbol
+			HUFFMAN_MACRO_LOADSYMBOL(Symbol)
+
+			// {C} fetch next symbol, this is done here because it will reduce dependency in the code
+			Symbol = *pSrc++;
+
+			// {B} write the symbol loaded at
+			HUFFMAN_MACRO_WRITE()
+		}
+
+		// write the last symbol loaded from {C} or {A} in the case of only 1 byte input buffer
+		HUFFMAN_MACRO_LOADSYMBOL(Symbol)
+		HUFFMAN_MACRO_WRITE()
+	}
+
+	// write EOF symbol
+	HUFFMAN_MACRO_LOADSYMBOL(HUFFMAN_EOF_SYMBOL)
+	HUFFMAN_MACRO_WRITE()
+
+	// write out the last bits
+	*pDst++ = Bits;
+
+	// return the size of the output
+	return (int)(pDst - (const unsigned char *)pOutput);
+
+	// remove macros
+#undef HUFFMAN_MACRO_LOADSYMBOL
+#undef HUFFMAN_MACRO_WRITE
+}
+
+int CReferenceHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
+	// setup buffer pointers
+	unsigned char *pDst = (unsigned char *)pOutput;
+	unsigned char *pSrc = (unsigned char *)pInput;
+	unsigned char *pDstEnd = pDst + OutputSize;
+	unsigned char *pSrcEnd = pSrc + InputSize;
+
+	unsigned Bits = 0;
+	unsigned Bitcount = 0;
+
+	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
+	CNode *pNode = 0;
+
+	while(1)
+	{
+		// {A} try to load a node now, this will reduce dependency at location {D}
+		pNode = 0;
+		if(Bitcount >= HUFFMAN_LUTBITS)
+			pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
+
+		// {B} fill with new bits
+		while(Bitcount < 24 && pSrc != pSrcEnd)
+		{
+			Bits |= (*pSrc++) << Bitcount;
+			Bitcount += 8;
+		}
+
+		// {C} load symbol now if we didn't that earlier at location {A}
+		if(!pNode)
+			pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
+
+		if(!pNode)
+			return -1;
+
+		// {D} check if we hit a symbol already
+		if(pNode->m_NumBits)
+		{
+			// remove the bits for that symbol
+			Bits >>= pNode->m_NumBits;
+			Bitcount -= pNode->m_NumBits;
+		}
+		else
+		{
+			// remove the bits that the lut checked up for us
+			Bits >>= HUFFMAN_LUTBITS;
+			Bitcount -= HUFFMAN_LUTBITS;
+
+			// walk the tree bit by bit
+			while(1)
+			{
+				// traverse tree
+				pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
+
+				// remove bit
+				Bitcount--;
+				Bits >>= 1;
+
+				// check if we hit a symbol
+				if(pNode->m_NumBits)
+					break;
+
+				// no more bits, decoding error
+				if(Bitcount == 0)
+					return -1;
+			}
+		}
+
+		// check for eof
+		if(pNode == pEof)
+			break;
+
+		// output character
+		if(pDst == pDstEnd)
+			return -1;
+		*pDst++ = pNode->m_Symbol;
+	}
+
+	// return the size of the decompressed buffer
+	return (int)(pDst - (const unsigned char *)pOutput);
+}
+
+// the frequencies the network code builds its coder from in CNetBase::Init
+static const unsigned s_aFreqTable[256+1] = {
+	1<<30,4545,2657,431,1950,919,444,482,2244,617,838,542,715,1814,304,240,754,212,647,186,
+	283,131,146,166,543,164,167,136,179,859,363,113,157,154,204,108,137,180,202,176,
+	872,404,168,134,151,111,113,109,120,126,129,100,41,20,16,22,18,18,17,19,
+	16,37,13,21,362,166,99,78,95,88,81,70,83,284,91,187,77,68,52,68,
+	59,66,61,638,71,157,50,46,69,43,11,24,13,19,10,12,12,20,14,9,
+	20,20,10,10,15,15,12,12,7,19,15,14,13,18,35,19,17,14,8,5,
+	15,17,9,15,14,18,8,10,2173,134,157,68,188,60,170,60,194,62,175,71,
+	148,67,167,78,211,67,156,69,1674,90,174,53,147,89,181,51,174,63,163,80,
+	167,94,128,122,223,153,218,77,200,110,190,73,174,69,145,66,277,143,141,60,
+	136,53,180,57,142,57,158,61,166,112,152,92,26,22,21,28,20,26,30,21,
+	32,27,20,17,23,21,30,22,22,21,27,25,17,27,23,18,39,26,15,21,
+	12,18,18,27,20,18,15,19,11,17,33,12,18,15,19,18,16,26,17,18,
+	9,10,25,22,22,17,20,16,6,16,15,20,14,18,24,335,1517};
+
+enum
+{
+	FUZZ_ROUNDS=20000,
+	MAX_INPUT=1400,
+	BUFFER_SIZE=MAX_INPUT*4+64,
+	MIN_BENCH_BYTES=4*1024*1024,
+	MAX_SAMPLES=1024,
+};
+
+static CReferenceHuffman s_Reference;
+static unsigned char s_aInput[BUFFER_SIZE];
+static unsigned char s_aPacked[BUFFER_SIZE], s_aPackedRef[BUFFER_SIZE];
+static unsigned char s_aOutput[BUFFER_SIZE], s_aOutputRef[BUFFER_SIZE];
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumClients = argc > 1 ? clamp(str_toint(argv[1]), 1, (int)CBenchGame::MAX_PLAYERS) : 16; // ignore_convention
+	int NumTicks = argc > 2 ? clamp(str_toint(argv[2]), 2, 1000) : 150; // ignore_convention
+
+	CNetBase::Init();
+	s_Reference.Init(s_aFreqTable);
+
+	// the packed snapshot deltas are most of the traffic, cut to one packet
+	CSnapshotDelta *pSnapshotDelta = new CSnapshotDelta();
+	CBenchGame::SetStaticSizes(pSnapshotDelta);
+	CBenchGame Game;
+	Game.Init(NumClients, 1);
+	CSnapshotStorage *pStorages = new CSnapshotStorage[NumClients];
+	Game.Play(NumTicks, pStorages, NumClients);
+
+	unsigned char *pSamples = (unsigned char *)mem_alloc(MAX_SAMPLES*NET_MAX_PAYLOAD, 1);
+	const unsigned char *apSamples[MAX_SAMPLES];
+	int aSampleSizes[MAX_SAMPLES];
+	int NumSamples = 0;
+	char *pDelta = (char *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+	char *pPackedDelta = (char *)mem_alloc(CSnapshot::MAX_SIZE*5/4, 1);
+	CSnapshotIndexBuffer *pToIndex = new CSnapshotIndexBuffer;
+	for(int s = 0; s < NumClients; s++)
+	{
+		for(CSnapshotStorage::CHolder *pHolder = pStorages[s].m_pFirst; pHolder && pHolder->m_pNext && NumSamples < MAX_SAMPLES; pHolder = pHolder->m_pNext)
+		{
+			int DeltaSize = pSnapshotDelta->CreateDelta(pHolder->m_pSnap, pHolder->m_pNext->m_pSnap, pDelta, pHolder->m_pIndex, pToIndex);
+			if(!DeltaSize)
+				continue;
+			int PackedSize = min((int)CVariableInt::Compress(pDelta, DeltaSize, pPackedDelta), (int)NET_MAX_PAYLOAD);
+			mem_copy(pSamples+NumSamples*NET_MAX_PAYLOAD, pPackedDelta, PackedSize);
+			apSamples[NumSamples] = pSamples+NumSamples*NET_MAX_PAYLOAD;
+			aSampleSizes[NumSamples++] = PackedSize;
+		}
+	}
+	delete pToIndex;
+	mem_free(pPackedDelta);
+	mem_free(pDelta);
+	delete [] pStorages;
+	delete pSnapshotDelta;
+
+	// random inputs of the kinds that show up on the wire, with random output
+	// limits, then the packed results bit flipped, cut off and replaced by noise
+	unsigned Seed = 0x2545F491;
+	int NumCompress = 0, NumDecompress = 0, NumCorrupt = 0;
+	int NumMismatches = 0, NumRoundtripErrors = 0;
+	for(int r = 0; r < FUZZ_ROUNDS; r++)
+	{
+		Seed = Seed*1103515245+12345;
+		int Size = (Seed>>16)%(MAX_INPUT+1);
+		int Kind = (Seed>>8)&3;
+		for(int i = 0; i < Size; i++)
+		{
+			Seed = Seed*1103515245+12345;
+			unsigned Rand = Seed>>8;
+			if(Kind == 0) // mostly zeros, like snapshot deltas
+				s_aInput[i] = (Rand&3) ? 0 : (Rand>>2)&0xff;
+			else if(Kind == 1) // anything
+				s_aInput[i] = Rand&0xff;
+			else if(Kind == 2 && NumSamples) // real data
+				s_aInput[i] = apSamples[(Rand>>4)%NumSamples][i%aSampleSizes[(Rand>>4)%NumSamples]];
+			else // few distinct values
+				s_aInput[i] = (Rand%5)*51;
+		}
+
+		Seed = Seed*1103515245+12345;
+		int OutputSize = (Seed>>16)&1 ? 1+(Seed>>17)%(Size+16) : BUFFER_SIZE;
+		int Packed = CNetBase::Compress(s_aInput, Size, s_aPacked, OutputSize);
+		int PackedRef = s_Reference.Compress(s_aInput, Size, s_aPackedRef, OutputSize);
+		NumMismatches += Packed != PackedRef || (PackedRef > 0 && mem_comp(s_aPacked, s_aPackedRef, PackedRef) != 0);
+		NumCompress++;
+		if(PackedRef <= 0)
+			continue;
+
+		Seed = Seed*1103515245+12345;
+		OutputSize = (Seed>>16)&1 ? (Seed>>17)%(Size+16) : BUFFER_SIZE;
+		int Unpacked = CNetBase::Decompress(s_aPackedRef, PackedRef, s_aOutput, OutputSize);
+		int UnpackedRef = s_Reference.Decompress(s_aPackedRef, PackedRef, s_aOutputRef, OutputSize);
+		NumMismatches += Unpacked != UnpackedRef || (UnpackedRef > 0 && mem_comp(s_aOutput, s_aOutputRef, UnpackedRef) != 0);
+		NumRoundtripErrors += OutputSize >= Size && (Unpacked != Size || mem_comp(s_aOutput, s_aInput, Size) != 0);
+		NumDecompress++;
+
+		for(int c = 0; c < 4; c++)
+		{
+			Seed = Seed*1103515245+12345;
+			int CorruptSize = PackedRef;
+			mem_copy(s_aPacked, s_aPackedRef, PackedRef);
+			if(c == 0) // flipped bits
+			{
+				for(int f = 0; f < 1+(int)((Seed>>28)&3); f++)
+				{
+					Seed = Seed*1103515245+12345;
+					s_aPacked[(Seed>>16)%PackedRef] ^= 1<<((Seed>>8)&7);
+				}
+			}
+			else if(c == 1) // cut off
+				CorruptSize = (Seed>>16)%PackedRef;
+			else if(c == 2) // noise
+			{
+				CorruptSize = (Seed>>16)%(MAX_INPUT+1);
+				for(int i = 0; i < CorruptSize; i++)
+				{
+					Seed = Seed*1103515245+12345;
+					s_aPacked[i] = Seed>>16;
+				}
+			}
+			else // noise appended
+			{
+				CorruptSize = min(PackedRef+1+(int)((Seed>>16)%64), (int)BUFFER_SIZE);
+				for(int i = PackedRef; i < CorruptSize; i++)
+				{
+					Seed = Seed*1103515245+12345;
+					s_aPacked[i] = Seed>>16;
+				}
+			}
+
+			Seed = Seed*1103515245+12345;
+			OutputSize = (Seed>>16)&1 ? (Seed>>17)%(MAX_INPUT+16) : BUFFER_SIZE;
+			Unpacked = CNetBase::Decompress(s_aPacked, CorruptSize, s_aOutput, OutputSize);
+			UnpackedRef = s_Reference.Decompress(s_aPacked, CorruptSize, s_aOutputRef, OutputSize);
+			NumMismatches += Unpacked != UnpackedRef || (UnpackedRef > 0 && mem_comp(s_aOutput, s_aOutputRef, UnpackedRef) != 0);
+			NumCorrupt++;
+		}
+	}
+	printf("fuzz: %d compressions, %d decompressions, %d corrupted inputs, %d mismatches, %d round trip errors\n",
+		NumCompress, NumDecompress, NumCorrupt, NumMismatches, NumRoundtripErrors);
+
+	if(!NumSamples)
+	{
+		printf("no samples to measure the throughput on\n");
+		mem_free(pSamples);
+		return 1;
+	}
+
+	// pack all samples once, then repeat until enough data went through
+	int TotalSize = 0, TotalPacked = 0;
+	int *pPackedSizes = (int *)mem_alloc(NumSamples*sizeof(int), 1);
+	unsigned char *pPackedAll = (unsigned char *)mem_alloc(NumSamples*(MAX_INPUT*2+8), 1);
+	for(int i = 0; i < NumSamples; i++)
+	{
+		pPackedSizes[i] = s_Reference.Compress(apSamples[i], min(aSampleSizes[i], (int)MAX_INPUT), pPackedAll+i*(MAX_INPUT*2+8), MAX_INPUT*2+8);
+		TotalSize += min(aSampleSizes[i], (int)MAX_INPUT);
+		TotalPacked += max(pPackedSizes[i], 0);
+	}
+	int Rounds = max(1, (int)MIN_BENCH_BYTES/max(TotalSize, 1));
+
+	int64 aTime[4] = {0, 0, 0, 0};
+	for(int Impl = 0; Impl < 2; Impl++)
+	{
+		int64 Start = time_get();
+		for(int r = 0; r < Rounds; r++)
+			for(int i = 0; i < NumSamples; i++)
+			{
+				int Size = min(aSampleSizes[i], (int)MAX_INPUT);
+				if(Impl == 0)
+					s_Reference.Compress(apSamples[i], Size, s_aPacked, sizeof(s_aPacked));
+				else
+					CNetBase::Compress(apSamples[i], Size, s_aPacked, sizeof(s_aPacked));
+			}
+		aTime[Impl*2] = time_get()-Start;
+
+		Start = time_get();
+		for(int r = 0; r < Rounds; r++)
+			for(int i = 0; i < NumSamples; i++)
+			{
+				if(pPackedSizes[i] <= 0)
+					continue;
+				const unsigned char *pPacked = pPackedAll+i*(MAX_INPUT*2+8);
+				if(Impl == 0)
+					s_Reference.Decompress(pPacked, pPackedSizes[i], s_aOutput, sizeof(s_aOutput));
+				else
+					CNetBase::Decompress(pPacked, pPackedSizes[i], s_aOutput, sizeof(s_aOutput));
+			}
+		aTime[Impl*2+1] = time_get()-Start;
+	}
+
+	printf("%d samples, %d bytes packed to %d (%.1f%%), %d rounds\n",
+		NumSamples, TotalSize, TotalPacked, TotalPacked*100.0f/max(TotalSize, 1), Rounds);
+	static const char *s_apNames[2] = {"reference", "table"};
+	for(int Impl = 0; Impl < 2; Impl++)
+	{
+		double Bytes = (double)TotalSize*Rounds;
+		printf("%-10s compress %7.1f MB/s, decompress %7.1f MB/s\n", s_apNames[Impl],
+			Bytes/1000000.0/(aTime[Impl*2]/(double)time_freq()), Bytes/1000000.0/(aTime[Impl*2+1]/(double)time_freq()));
+	}
+
+	mem_free(pPackedAll);
+	mem_free(pPackedSizes);
+	mem_free(pSamples);
+	return NumMismatches || NumRoundtripErrors ? 1 : 0;
+}
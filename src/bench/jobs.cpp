@@ -0,0 +1,195 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdio.h>
+
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/shared/jobs.h>
+
+/*
+	Measures job dispatch latency and throughput of the work-stealing
+	job pool against the polling queue it replaced.
+
+	usage: bench_jobs [threads]
+*/
+
+// the pool as it was before: one locked list, idle workers poll every 10ms
+class CPollingJobQueue
+{
+public:
+	struct CItem
+	{
+		CItem *m_pNext;
+		volatile int m_Done;
+		int64 m_StartTime;
+	};
+
+	LOCK m_Lock;
+	CItem *m_pFirst;
+	CItem *m_pLast;
+	volatile int m_Stop;
+	void *m_apThreads[CJobPool::MAX_THREADS];
+	int m_NumThreads;
+
+	static void WorkerThread(void *pUser)
+	{
+		CPollingJobQueue *pQueue = (CPollingJobQueue *)pUser;
+		while(!atomic_get(&pQueue->m_Stop))
+		{
+			lock_wait(pQueue->m_Lock);
+			CItem *pItem = pQueue->m_pFirst;
+			if(pItem)
+			{
+				pQueue->m_pFirst = pItem->m_pNext;
+				if(!pQueue->m_pFirst)
+					pQueue->m_pLast = 0;
+			}
+			lock_unlock(pQueue->m_Lock);
+
+			if(pItem)
+			{
+				pItem->m_StartTime = time_get();
+				atomic_set(&pItem->m_Done, 1);
+			}
+			else
+				thread_sleep(10);
+		}
+	}
+
+	CPollingJobQueue(int NumThreads)
+	{
+		m_Lock = lock_create();
+		m_pFirst = 0;
+		m_pLast = 0;
+		m_Stop = 0;
+		m_NumThreads = NumThreads;
+		for(int i = 0; i < m_NumThreads; i++)
+			m_apThreads[i] = thread_init(WorkerThread, this);
+	}
+
+	~CPollingJobQueue()
+	{
+		atomic_set(&m_Stop, 1);
+		for(int i = 0; i < m_NumThreads; i++)
+			thread_wait(m_apThreads[i]);
+		lock_destroy(m_Lock);
+	}
+
+	void Add(CItem *pItem)
+	{
+		pItem->m_pNext = 0;
+		pItem->m_Done = 0;
+		lock_wait(m_Lock);
+		if(m_pLast)
+			m_pLast->m_pNext = pItem;
+		m_pLast = pItem;
+		if(!m_pFirst)
+			m_pFirst = pItem;
+		lock_unlock(m_Lock);
+	}
+};
+
+static int BenchStartJob(void *pData)
+{
+	*(int64 *)pData = time_get();
+	return 0;
+}
+
+static int BenchEmptyJob(void *pData)
+{
+	return 0;
+}
+
+static void BenchEmptyRange(void *pData, int Begin, int End)
+{
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	enum
+	{
+		LATENCY_RUNS=50,
+		THROUGHPUT_JOBS=20000,
+		PARALLEL_RUNS=2000,
+	};
+
+	int NumThreads = argc > 1 ? clamp(str_toint(argv[1]), 1, (int)CJobPool::MAX_THREADS) : 4; // ignore_convention
+	int64 Freq = time_freq();
+
+	printf("job pool benchmark, %d worker threads\n", NumThreads);
+
+	// dispatch latency: time from adding a job to a worker starting it, with the workers idle
+	double OldLatency = 0, NewLatency = 0;
+	{
+		CPollingJobQueue Old(NumThreads);
+		CPollingJobQueue::CItem Item;
+		for(int i = 0; i < LATENCY_RUNS; i++)
+		{
+			thread_sleep(1);
+			int64 Start = time_get();
+			Old.Add(&Item);
+			while(!atomic_get(&Item.m_Done))
+				thread_yield();
+			OldLatency += (Item.m_StartTime-Start)*1000000.0/Freq;
+		}
+		OldLatency /= LATENCY_RUNS;
+	}
+	{
+		CJobPool New;
+		New.Init(NumThreads);
+		CJob Job;
+		int64 StartTime;
+		for(int i = 0; i < LATENCY_RUNS; i++)
+		{
+			thread_sleep(1);
+			int64 Start = time_get();
+			New.Add(&Job, BenchStartJob, &StartTime);
+			while(Job.Status() != CJob::STATE_DONE)
+				thread_yield();
+			NewLatency += (StartTime-Start)*1000000.0/Freq;
+		}
+		NewLatency /= LATENCY_RUNS;
+	}
+	printf("dispatch latency: polling %.1fus, work-stealing %.1fus\n", OldLatency, NewLatency);
+
+	// throughput: a burst of empty jobs from one thread until all are done
+	double OldRate, NewRate;
+	{
+		CPollingJobQueue::CItem *pItems = new CPollingJobQueue::CItem[THROUGHPUT_JOBS];
+		CPollingJobQueue Old(NumThreads);
+		int64 Start = time_get();
+		for(int i = 0; i < THROUGHPUT_JOBS; i++)
+			Old.Add(&pItems[i]);
+		for(int i = 0; i < THROUGHPUT_JOBS; i++)
+			while(!atomic_get(&pItems[i].m_Done))
+				thread_yield();
+		OldRate = THROUGHPUT_JOBS/((time_get()-Start)/(double)Freq);
+		delete [] pItems;
+	}
+	{
+		CJob *pJobs = new CJob[THROUGHPUT_JOBS];
+		CJobPool New;
+		New.Init(NumThreads);
+		CJobCounter Counter;
+		int64 Start = time_get();
+		for(int i = 0; i < THROUGHPUT_JOBS; i++)
+			New.Add(&pJobs[i], BenchEmptyJob, 0, &Counter);
+		New.Wait(&Counter);
+		NewRate = THROUGHPUT_JOBS/((time_get()-Start)/(double)Freq);
+		delete [] pJobs;
+	}
+	printf("throughput: polling %.0f jobs/s, work-stealing %.0f jobs/s\n", OldRate, NewRate);
+
+	// fork/join overhead of an empty parallel for
+	{
+		CJobPool New;
+		New.Init(NumThreads);
+		int64 Start = time_get();
+		for(int i = 0; i < PARALLEL_RUNS; i++)
+			New.ParallelFor(CJobPool::MAX_RANGES, BenchEmptyRange, 0);
+		printf("parallel for: %.1fus per fork/join of %d ranges\n",
+			(time_get()-Start)*1000000.0/Freq/PARALLEL_RUNS, min((NumThreads+1)*4, (int)CJobPool::MAX_RANGES));
+	}
+	return 0;
+}
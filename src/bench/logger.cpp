@@ -0,0 +1,136 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+	Fills the queue of the asynchronous logger from several threads at
+	once, with lines of varying length that wrap the ring many times, and
+	checks that every line comes out whole and in order or is counted as
+	dropped.
+
+	usage: bench_logger [threads] [lines per thread]
+*/
+
+enum
+{
+	MAX_THREADS=16,
+	MAX_LINES=10000000,
+	MAX_PAD=300, // up to six queue slots per line
+};
+
+struct CProducer
+{
+	int m_Thread;
+	int m_NumLines;
+};
+
+static volatile int s_Received = 0;
+static int s_Errors = 0;
+static int s_aLast[MAX_THREADS];
+
+static int Pad(int Thread, int Seq)
+{
+	return (Seq*37+Thread*11)%MAX_PAD;
+}
+
+static void Producer(void *pUser)
+{
+	CProducer *pProducer = (CProducer *)pUser;
+	char aPad[MAX_PAD+1];
+	for(int Seq = 0; Seq < pProducer->m_NumLines; Seq++)
+	{
+		int Len = Pad(pProducer->m_Thread, Seq);
+		memset(aPad, 'a'+pProducer->m_Thread, Len);
+		aPad[Len] = 0;
+		dbg_msg("logtest", "%d %d %s", pProducer->m_Thread, Seq, aPad);
+		if(Seq%64 == 63)
+			thread_yield();
+	}
+}
+
+// called on the writer thread only
+static void CheckLine(const char *pLine)
+{
+	const char *pMsg = str_find(pLine, "[logtest]: ");
+	if(!pMsg)
+		return; // the logger's own "queue full" lines
+	pMsg += 11;
+
+	int Thread, Seq;
+	if(sscanf(pMsg, "%d %d ", &Thread, &Seq) != 2 || Thread < 0 || Thread >= MAX_THREADS || Seq <= s_aLast[Thread])
+		s_Errors++;
+	else
+	{
+		s_aLast[Thread] = Seq;
+		const char *pPad = str_find(str_find(pMsg, " ")+1, " ")+1;
+		int Len = str_length(pPad);
+		if(Len != Pad(Thread, Seq))
+			s_Errors++;
+		for(int i = 0; i < Len; i++)
+			if(pPad[i] != 'a'+Thread)
+			{
+				s_Errors++;
+				break;
+			}
+	}
+
+	// fall behind now and then so the producers run into a full queue too
+	if(atomic_add(&s_Received, 1)%512 == 0)
+		thread_sleep(1);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumThreads = argc > 1 ? clamp(str_toint(argv[1]), 1, (int)MAX_THREADS) : 4; // ignore_convention
+	int NumLines = argc > 2 ? clamp(str_toint(argv[2]), 1, (int)MAX_LINES) : 100000; // ignore_convention
+	int64 Total = (int64)NumThreads*NumLines;
+
+	dbg_logger(CheckLine);
+	dbg_logger_async();
+	for(int i = 0; i < MAX_THREADS; i++)
+		s_aLast[i] = -1;
+
+	CProducer aProducers[MAX_THREADS];
+	void *apThreads[MAX_THREADS];
+	int64 Start = time_get();
+	for(int i = 0; i < NumThreads; i++)
+	{
+		aProducers[i].m_Thread = i;
+		aProducers[i].m_NumLines = NumLines;
+		apThreads[i] = thread_init(Producer, &aProducers[i]);
+	}
+	for(int i = 0; i < NumThreads; i++)
+		thread_wait(apThreads[i]);
+
+	// a line that never gets published stalls the writer for good
+	int64 LastProgress = time_get();
+	int LastReceived = 0;
+	while(atomic_get(&s_Received)+(int64)dbg_logger_dropped() < Total)
+	{
+		int Received = atomic_get(&s_Received);
+		if(Received != LastReceived)
+		{
+			LastReceived = Received;
+			LastProgress = time_get();
+		}
+		else if(time_get()-LastProgress > 5*time_freq())
+			break;
+		thread_sleep(1);
+	}
+	dbg_logger_flush();
+
+	int Received = atomic_get(&s_Received);
+	int Dropped = dbg_logger_dropped();
+	if(Received+(int64)Dropped != Total)
+		s_Errors++;
+
+	printf("%d threads, %lld lines: %d received, %d dropped, %.0f lines/s, %d errors, %s\n",
+		NumThreads, (long long)Total, Received, Dropped, Total/((time_get()-Start)/(double)time_freq()),
+		s_Errors, s_Errors ? "FAILED" : "ok");
+	return s_Errors ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/shared/compression.h>
+#include <engine/shared/snapshot.h>
+
+#include <stdio.h>
+
+#include "snapshots.h"
+
+/*
+	Checks the vectorized item diff and variable int kernels against
+	the scalar ones on random data, then times all of them on the
+	deltas of a made up round, every snapshot of a client against the
+	one before it.
+
+	usage: bench_simd [clients] [ticks]
+*/
+
+enum
+{
+	ROUNDS=20,
+	CHECK_ARRAYS=4000,
+	CHECK_MAX_INTS=80,
+};
+
+struct CPair
+{
+	const int *m_pPast;
+	const int *m_pCurrent;
+	int m_Size;
+};
+
+static int s_aKernels[CVariableInt::NUM_KERNELS];
+static int s_NumKernels = 0;
+
+// every kernel against the scalar one on random arrays, with the values
+// around the byte boundaries of the packing mixed in
+static int CheckRandom()
+{
+	static const int s_aEdges[] = {0, 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, -8193,
+		(1<<20)-1, -(1<<20), 1<<20, 0x7FFFFFFF, (int)0x80000000};
+	unsigned Seed = 0x9E3779B9;
+	int aPast[CHECK_MAX_INTS], aCurrent[CHECK_MAX_INTS];
+	int aOut[CHECK_MAX_INTS], aRef[CHECK_MAX_INTS];
+	unsigned char aPacked[CHECK_MAX_INTS*5], aPackedRef[CHECK_MAX_INTS*5];
+	int NumChecks = 0;
+	int NumMismatches = 0;
+	for(int a = 0; a < CHECK_ARRAYS; a++)
+	{
+		Seed = Seed*1103515245+12345;
+		int Num = (Seed>>16)%CHECK_MAX_INTS;
+		for(int i = 0; i < Num; i++)
+		{
+			Seed = Seed*1103515245+12345;
+			int Kind = (Seed>>28)&3;
+			Seed = Seed*1103515245+12345;
+			if(Kind == 0)
+				aCurrent[i] = s_aEdges[(Seed>>16)%(sizeof(s_aEdges)/sizeof(s_aEdges[0]))];
+			else if(Kind == 1)
+				aCurrent[i] = (int)(Seed^(Seed<<13));
+			else
+				aCurrent[i] = (int)((Seed>>16)%128)-64;
+			aPast[i] = Kind == 3 ? aCurrent[i] : aCurrent[(i*7)%(i+1)]/3;
+		}
+
+		int NeededRef = CSnapshotDelta::DiffItem(CVariableInt::KERNEL_SCALAR, aPast, aCurrent, aRef, Num);
+		long PackedRef = CVariableInt::Compress(CVariableInt::KERNEL_SCALAR, aCurrent, Num*4, aPackedRef);
+		for(int k = 1; k < s_NumKernels; k++)
+		{
+			int Needed = CSnapshotDelta::DiffItem(s_aKernels[k], aPast, aCurrent, aOut, Num);
+			NumMismatches += Needed != NeededRef || mem_comp(aOut, aRef, Num*4) != 0;
+
+			long Packed = CVariableInt::Compress(s_aKernels[k], aCurrent, Num*4, aPacked);
+			NumMismatches += Packed != PackedRef || mem_comp(aPacked, aPackedRef, PackedRef) != 0;
+
+			long Unpacked = CVariableInt::Decompress(s_aKernels[k], aPackedRef, PackedRef, aOut);
+			NumMismatches += Unpacked != Num*4 || mem_comp(aOut, aCurrent, Num*4) != 0;
+			NumChecks += 3;
+		}
+	}
+	printf("self check: %d random arrays, %d checks, %d mismatches\n", (int)CHECK_ARRAYS, NumChecks, NumMismatches);
+	return NumMismatches;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumClients = argc > 1 ? clamp(str_toint(argv[1]), 1, (int)CBenchGame::MAX_PLAYERS) : 16; // ignore_convention
+	int NumTicks = argc > 2 ? clamp(str_toint(argv[2]), 2, 1000) : 150; // ignore_convention
+
+	char aBuf[256];
+	str_copy(aBuf, "kernels:", sizeof(aBuf));
+	for(int k = 0; k < CVariableInt::NUM_KERNELS; k++)
+	{
+		if(!CVariableInt::KernelSupported(k))
+			continue;
+		s_aKernels[s_NumKernels++] = k;
+		str_append(aBuf, " ", sizeof(aBuf));
+		str_append(aBuf, CVariableInt::KernelName(k), sizeof(aBuf));
+	}
+	printf("%s, using %s\n", aBuf, CVariableInt::KernelName(CVariableInt::BestKernel()));
+
+	int NumMismatches = CheckRandom();
+
+	CSnapshotDelta *pSnapshotDelta = new CSnapshotDelta();
+	CBenchGame::SetStaticSizes(pSnapshotDelta);
+	CBenchGame Game;
+	Game.Init(NumClients, 1);
+	CSnapshotStorage *pStorages = new CSnapshotStorage[NumClients];
+	Game.Play(NumTicks, pStorages, NumClients);
+
+	// the deltas and item pairs of the stored snapshots
+	int NumDeltas = 0;
+	int TotalDeltaSize = 0;
+	int NumPairs = 0;
+	char *pDelta = (char *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+	CSnapshotIndexBuffer *pToIndex = new CSnapshotIndexBuffer;
+	for(int s = 0; s < NumClients; s++)
+	{
+		for(CSnapshotStorage::CHolder *pHolder = pStorages[s].m_pFirst; pHolder && pHolder->m_pNext; pHolder = pHolder->m_pNext)
+		{
+			NumDeltas++;
+			TotalDeltaSize += pSnapshotDelta->CreateDelta(pHolder->m_pSnap, pHolder->m_pNext->m_pSnap, pDelta, pHolder->m_pIndex, pToIndex);
+			NumPairs += pHolder->m_pNext->m_pSnap->NumItems();
+		}
+	}
+
+	CPair *pPairs = (CPair *)mem_alloc(NumPairs*sizeof(CPair), 1);
+	int *pDeltaSizes = (int *)mem_alloc(NumDeltas*sizeof(int), 1);
+	char *pDeltas = (char *)mem_alloc(TotalDeltaSize+1, 1);
+	unsigned char *pPackedAll = (unsigned char *)mem_alloc(TotalDeltaSize/4*5+1, 1);
+	unsigned char *pPackedRefAll = (unsigned char *)mem_alloc(TotalDeltaSize/4*5+1, 1);
+	int *pUnpacked = (int *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+	int NumInts = 0;
+	NumPairs = 0;
+	NumDeltas = 0;
+	int Offset = 0;
+	for(int s = 0; s < NumClients; s++)
+	{
+		for(CSnapshotStorage::CHolder *pHolder = pStorages[s].m_pFirst; pHolder && pHolder->m_pNext; pHolder = pHolder->m_pNext)
+		{
+			CSnapshot *pFrom = pHolder->m_pSnap;
+			CSnapshot *pTo = pHolder->m_pNext->m_pSnap;
+			pDeltaSizes[NumDeltas] = pSnapshotDelta->CreateDelta(pFrom, pTo, pDeltas+Offset, pHolder->m_pIndex, pToIndex);
+			Offset += pDeltaSizes[NumDeltas++];
+
+			for(int i = 0; i < pTo->NumItems(); i++)
+			{
+				int PastIndex = pHolder->m_pIndex->GetItemIndex(pFrom, pTo->GetItem(i)->Key());
+				if(PastIndex == -1 || pFrom->GetItemSize(PastIndex) != pTo->GetItemSize(i))
+					continue;
+				pPairs[NumPairs].m_pPast = pFrom->GetItem(PastIndex)->Data();
+				pPairs[NumPairs].m_pCurrent = pTo->GetItem(i)->Data();
+				pPairs[NumPairs].m_Size = pTo->GetItemSize(i)/4;
+				NumInts += pPairs[NumPairs].m_Size;
+				NumPairs++;
+			}
+		}
+	}
+
+	// reference output
+	int *pDiffRef = (int *)mem_alloc(NumInts*sizeof(int)+1, 1);
+	int *pDiff = (int *)mem_alloc(NumInts*sizeof(int)+1, 1);
+	int *pNeededRef = (int *)mem_alloc(NumPairs*sizeof(int)+1, 1);
+	for(int p = 0, o = 0; p < NumPairs; o += pPairs[p].m_Size, p++)
+		pNeededRef[p] = CSnapshotDelta::DiffItem(CVariableInt::KERNEL_SCALAR, pPairs[p].m_pPast, pPairs[p].m_pCurrent, pDiffRef+o, pPairs[p].m_Size);
+	int *pPackedSizes = (int *)mem_alloc(NumDeltas*sizeof(int), 1);
+	int PackedRefSize = 0;
+	for(int d = 0, o = 0; d < NumDeltas; o += pDeltaSizes[d], d++)
+	{
+		pPackedSizes[d] = CVariableInt::Compress(CVariableInt::KERNEL_SCALAR, pDeltas+o, pDeltaSizes[d], pPackedRefAll+PackedRefSize);
+		PackedRefSize += pPackedSizes[d];
+	}
+
+	printf("%d deltas from %d clients, %.0f bytes per delta (%.0f packed), %d item diffs of %.1f ints, %d rounds\n",
+		NumDeltas, NumClients, TotalDeltaSize/(float)NumDeltas, PackedRefSize/(float)NumDeltas, NumPairs, NumInts/(float)max(NumPairs, 1), (int)ROUNDS);
+
+	int NumDiffering = 0;
+	for(int k = 0; k < s_NumKernels; k++)
+	{
+		int Kernel = s_aKernels[k];
+		int64 aTime[3] = {0, 0, 0};
+		for(int r = 0; r < ROUNDS; r++)
+		{
+			int64 Start = time_get();
+			for(int p = 0, o = 0; p < NumPairs; o += pPairs[p].m_Size, p++)
+				CSnapshotDelta::DiffItem(Kernel, pPairs[p].m_pPast, pPairs[p].m_pCurrent, pDiff+o, pPairs[p].m_Size);
+			int64 End = time_get();
+			aTime[0] += End-Start;
+
+			Start = End;
+			int PackedSize = 0;
+			for(int d = 0, o = 0; d < NumDeltas; o += pDeltaSizes[d], d++)
+				PackedSize += CVariableInt::Compress(Kernel, pDeltas+o, pDeltaSizes[d], pPackedAll+PackedSize);
+			End = time_get();
+			aTime[1] += End-Start;
+
+			Start = End;
+			bool UnpackDiffering = false;
+			for(int d = 0, o = 0, po = 0; d < NumDeltas; o += pDeltaSizes[d], po += pPackedSizes[d], d++)
+			{
+				long UnpackedSize = CVariableInt::Decompress(Kernel, pPackedRefAll+po, pPackedSizes[d], pUnpacked);
+				if(r == 0)
+					UnpackDiffering |= UnpackedSize != pDeltaSizes[d] || mem_comp(pUnpacked, pDeltas+o, pDeltaSizes[d]) != 0;
+			}
+			End = time_get();
+			aTime[2] += End-Start;
+
+			if(r == 0)
+			{
+				// compare the kernel outputs of the first round
+				bool Differing = UnpackDiffering;
+				for(int p = 0, o = 0; p < NumPairs; o += pPairs[p].m_Size, p++)
+					Differing |= (CSnapshotDelta::DiffItem(Kernel, pPairs[p].m_pPast, pPairs[p].m_pCurrent, pDiff+o, pPairs[p].m_Size) != 0) != (pNeededRef[p] != 0);
+				Differing |= mem_comp(pDiff, pDiffRef, NumInts*sizeof(int)) != 0;
+				Differing |= PackedSize != PackedRefSize || mem_comp(pPackedAll, pPackedRefAll, PackedRefSize) != 0;
+				NumDiffering += Differing;
+			}
+		}
+
+		printf("%-7s diff %6.1f ns per item, pack %6.2f us per delta, unpack %6.2f us per delta\n", CVariableInt::KernelName(Kernel),
+			aTime[0]*1000000000.0/time_freq()/(max(NumPairs, 1)*(int64)ROUNDS),
+			aTime[1]*1000000.0/time_freq()/(NumDeltas*(int64)ROUNDS),
+			aTime[2]*1000000.0/time_freq()/(NumDeltas*(int64)ROUNDS));
+	}
+	printf("kernels with output differing from scalar: %d\n", NumDiffering);
+
+	mem_free(pPackedSizes);
+	mem_free(pNeededRef);
+	mem_free(pDiff);
+	mem_free(pDiffRef);
+	mem_free(pUnpacked);
+	mem_free(pPackedRefAll);
+	mem_free(pPackedAll);
+	mem_free(pDeltas);
+	mem_free(pDeltaSizes);
+	mem_free(pPairs);
+	delete pToIndex;
+	mem_free(pDelta);
+	delete [] pStorages;
+	delete pSnapshotDelta;
+	return NumMismatches || NumDiffering ? 1 : 0;
+}
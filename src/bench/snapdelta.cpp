@@ -0,0 +1,234 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/shared/snapshot.h>
+
+#include <stdio.h>
+
+#include "snapshots.h"
+
+/*
+	Creates the deltas of a made up round, every snapshot of a client
+	against the one before it, once with the hash lists used before the
+	snapshot indices, once building the index of the old snapshot per
+	delta and once with the index the storage keeps. The deltas must
+	not differ.
+
+	usage: bench_snapdelta [clients] [ticks]
+*/
+
+enum
+{
+	ROUNDS=20,
+	HASHLIST_SIZE=256,
+};
+
+struct CItemList
+{
+	int m_Num;
+	int m_aKeys[64];
+	int m_aIndex[64];
+};
+
+static void GenerateHash(CItemList *pHashlist, CSnapshot *pSnapshot)
+{
+	for(int i = 0; i < HASHLIST_SIZE; i++)
+		pHashlist[i].m_Num = 0;
+
+	for(int i = 0; i < pSnapshot->NumItems(); i++)
+	{
+		int Key = pSnapshot->GetItem(i)->Key();
+		int HashID = ((Key>>12)&0xf0) | (Key&0xf);
+		if(pHashlist[HashID].m_Num != 64)
+		{
+			pHashlist[HashID].m_aIndex[pHashlist[HashID].m_Num] = i;
+			pHashlist[HashID].m_aKeys[pHashlist[HashID].m_Num] = Key;
+			pHashlist[HashID].m_Num++;
+		}
+	}
+}
+
+static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
+{
+	int HashID = ((Key>>12)&0xf0) | (Key&0xf);
+	for(int i = 0; i < pHashlist[HashID].m_Num; i++)
+	{
+		if(pHashlist[HashID].m_aKeys[i] == Key)
+			return pHashlist[HashID].m_aIndex[i];
+	}
+	return -1;
+}
+
+static int DiffItem(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	int Needed = 0;
+	while(Size)
+	{
+		*pOut = *pCurrent-*pPast;
+		Needed |= *pOut;
+		pOut++;
+		pPast++;
+		pCurrent++;
+		Size--;
+	}
+	return Needed;
+}
+
+// delta creation as it was before the snapshot indices
+static int CreateDeltaHashlist(const short *pItemSizes, CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
+{
+	CSnapshotDelta::CData *pDelta = (CSnapshotDelta::CData *)pDstData;
+	int *pData = (int *)pDelta->m_pData;
+
+	pDelta->m_NumDeletedItems = 0;
+	pDelta->m_NumUpdateItems = 0;
+	pDelta->m_NumTempItems = 0;
+
+	static CItemList s_aHashlist[HASHLIST_SIZE];
+	GenerateHash(s_aHashlist, pTo);
+
+	// pack deleted stuff
+	for(int i = 0; i < pFrom->NumItems(); i++)
+	{
+		CSnapshotItem *pFromItem = pFrom->GetItem(i);
+		if(GetItemIndexHashed(pFromItem->Key(), s_aHashlist) == -1)
+		{
+			pDelta->m_NumDeletedItems++;
+			*pData++ = pFromItem->Key();
+		}
+	}
+
+	GenerateHash(s_aHashlist, pFrom);
+	int aPastIndecies[1024];
+	const int NumItems = pTo->NumItems();
+	for(int i = 0; i < NumItems; i++)
+		aPastIndecies[i] = GetItemIndexHashed(pTo->GetItem(i)->Key(), s_aHashlist);
+
+	for(int i = 0; i < NumItems; i++)
+	{
+		int ItemSize = pTo->GetItemSize(i);
+		CSnapshotItem *pCurItem = pTo->GetItem(i);
+		int PastIndex = aPastIndecies[i];
+
+		if(PastIndex != -1)
+		{
+			int *pItemDataDst = pItemSizes[pCurItem->Type()] ? pData+2 : pData+3;
+			CSnapshotItem *pPastItem = pFrom->GetItem(PastIndex);
+			if(DiffItem(pPastItem->Data(), pCurItem->Data(), pItemDataDst, ItemSize/4))
+			{
+				*pData++ = pCurItem->Type();
+				*pData++ = pCurItem->ID();
+				if(!pItemSizes[pCurItem->Type()])
+					*pData++ = ItemSize/4;
+				pData += ItemSize/4;
+				pDelta->m_NumUpdateItems++;
+			}
+		}
+		else
+		{
+			*pData++ = pCurItem->Type();
+			*pData++ = pCurItem->ID();
+			if(!pItemSizes[pCurItem->Type()])
+				*pData++ = ItemSize/4;
+			mem_copy(pData, pCurItem->Data(), ItemSize);
+			pData += ItemSize/4;
+			pDelta->m_NumUpdateItems++;
+		}
+	}
+
+	if(!pDelta->m_NumDeletedItems && !pDelta->m_NumUpdateItems && !pDelta->m_NumTempItems)
+		return 0;
+
+	return (int)((char*)pData-(char*)pDstData);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumClients = argc > 1 ? clamp(str_toint(argv[1]), 1, (int)CBenchGame::MAX_PLAYERS) : 16; // ignore_convention
+	int NumTicks = argc > 2 ? clamp(str_toint(argv[2]), 2, 1000) : 150; // ignore_convention
+
+	CSnapshotDelta *pSnapshotDelta = new CSnapshotDelta();
+	CBenchGame::SetStaticSizes(pSnapshotDelta);
+	short aItemSizes[64] = {0};
+	aItemSizes[CBenchGame::TYPE_PROJECTILE] = CBenchGame::SIZE_PROJECTILE*4;
+	aItemSizes[CBenchGame::TYPE_PICKUP] = CBenchGame::SIZE_PICKUP*4;
+	aItemSizes[CBenchGame::TYPE_GAMEINFO] = CBenchGame::SIZE_GAMEINFO*4;
+	aItemSizes[CBenchGame::TYPE_CHARACTER] = CBenchGame::SIZE_CHARACTER*4;
+	aItemSizes[CBenchGame::TYPE_PLAYERINFO] = CBenchGame::SIZE_PLAYERINFO*4;
+	aItemSizes[CBenchGame::TYPE_CLIENTINFO] = CBenchGame::SIZE_CLIENTINFO*4;
+
+	CBenchGame Game;
+	Game.Init(NumClients, 1);
+	CSnapshotStorage *pStorages = new CSnapshotStorage[NumClients];
+	Game.Play(NumTicks, pStorages, NumClients);
+
+	char *pDeltaBefore = (char *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+	char *pDelta = (char *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+	CSnapshotIndexBuffer *pFromIndex = new CSnapshotIndexBuffer;
+	CSnapshotIndexBuffer *pToIndex = new CSnapshotIndexBuffer;
+	int NumDeltas = 0;
+	int NumItems = 0;
+	int NumDiffering = 0;
+	int64 aTime[3] = {0, 0, 0};
+
+	// every snapshot against the one stored before it, like a client that acks all of them
+	for(int r = 0; r < ROUNDS; r++)
+	{
+		for(int s = 0; s < NumClients; s++)
+		{
+			for(CSnapshotStorage::CHolder *pHolder = pStorages[s].m_pFirst; pHolder && pHolder->m_pNext; pHolder = pHolder->m_pNext)
+			{
+				CSnapshot *pFrom = pHolder->m_pSnap;
+				CSnapshot *pTo = pHolder->m_pNext->m_pSnap;
+
+				int64 Start = time_get();
+				int SizeBefore = CreateDeltaHashlist(aItemSizes, pFrom, pTo, pDeltaBefore);
+				int64 End = time_get();
+				aTime[0] += End-Start;
+
+				Start = End;
+				pFromIndex->Index()->Build(pFrom);
+				int SizeBuilt = pSnapshotDelta->CreateDelta(pFrom, pTo, pDelta, pFromIndex->Index(), pToIndex);
+				End = time_get();
+				aTime[1] += End-Start;
+				bool Differing = SizeBuilt != SizeBefore || mem_comp(pDelta, pDeltaBefore, SizeBefore) != 0;
+
+				Start = End;
+				int SizeStored = pSnapshotDelta->CreateDelta(pFrom, pTo, pDelta, pHolder->m_pIndex, pToIndex);
+				End = time_get();
+				aTime[2] += End-Start;
+				Differing |= SizeStored != SizeBefore || mem_comp(pDelta, pDeltaBefore, SizeBefore) != 0;
+
+				if(r == 0)
+				{
+					NumDeltas++;
+					NumItems += pTo->NumItems();
+					NumDiffering += Differing;
+				}
+			}
+		}
+	}
+
+	delete pToIndex;
+	delete pFromIndex;
+	mem_free(pDelta);
+	mem_free(pDeltaBefore);
+	delete [] pStorages;
+	delete pSnapshotDelta;
+
+	if(!NumDeltas)
+	{
+		printf("no stored snapshots to create deltas from\n");
+		return 1;
+	}
+
+	static const char *s_apNames[3] = {"hash lists (before)", "index per delta", "stored index"};
+	printf("%d deltas from %d clients, %.1f items per snapshot, %d rounds\n",
+		NumDeltas, NumClients, NumItems/(float)NumDeltas, (int)ROUNDS);
+	for(int i = 0; i < 3; i++)
+		printf("%-20s %8.2f us per client delta\n", s_apNames[i], aTime[i]*1000000.0/time_freq()/(NumDeltas*(int64)ROUNDS));
+	printf("deltas differing from before: %d\n", NumDiffering);
+	return NumDiffering ? 1 : 0;
+}
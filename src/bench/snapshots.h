@@ -0,0 +1,286 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BENCH_SNAPSHOTS_H
+#define BENCH_SNAPSHOTS_H
+
+#include <base/math.h>
+#include <base/system.h>
+
+#include <engine/shared/snapshot.h>
+
+/*
+	Class: CBenchGame
+		A made up round for the benchmarks that need snapshots: players
+		run around, shoot and pick things up, and every client sees the
+		characters and projectiles close to its own character, so the
+		snapshots differ per client and items come and go like on a
+		real server. The item sizes are close to the game's.
+*/
+class CBenchGame
+{
+public:
+	enum
+	{
+		MAX_PLAYERS=64,
+		MAX_PROJECTILES=128,
+		NUM_PICKUPS=24,
+
+		// item types and sizes in ints, the static ones are set on the delta
+		TYPE_PROJECTILE=3,
+		TYPE_PICKUP=5,
+		TYPE_GAMEINFO=6,
+		TYPE_CHARACTER=9,
+		TYPE_PLAYERINFO=10,
+		TYPE_CLIENTINFO=11,
+
+		SIZE_PROJECTILE=6,
+		SIZE_PICKUP=4,
+		SIZE_GAMEINFO=8,
+		SIZE_CHARACTER=22,
+		SIZE_PLAYERINFO=5,
+		SIZE_CLIENTINFO=17,
+
+		VIEW_RANGE=1200,
+		WORLD_SIZE=4000,
+	};
+
+private:
+	struct CPlayer
+	{
+		int m_X, m_Y;
+		int m_VelX, m_VelY;
+		int m_Angle;
+		int m_Weapon;
+		int m_Health;
+		int m_Score;
+		int m_Latency;
+		int m_AttackTick;
+	};
+
+	struct CProjectile
+	{
+		int m_X, m_Y;
+		int m_VelX, m_VelY;
+		int m_StartTick;
+		int m_ID;
+	};
+
+	CPlayer m_aPlayers[MAX_PLAYERS];
+	CProjectile m_aProjectiles[MAX_PROJECTILES];
+	int m_NumPlayers;
+	int m_NumProjectiles;
+	int m_NextProjectileID;
+	int m_Tick;
+	unsigned m_Seed;
+	CSnapshotBuilder m_Builder;
+
+	int Random(int Max)
+	{
+		m_Seed = m_Seed*1103515245+12345;
+		return (int)((m_Seed>>8)%(unsigned)Max);
+	}
+
+	bool InView(int ClientID, int X, int Y) const
+	{
+		return ClientID < 0 || (absolute(m_aPlayers[ClientID].m_X-X) < VIEW_RANGE && absolute(m_aPlayers[ClientID].m_Y-Y) < VIEW_RANGE);
+	}
+
+public:
+	void Init(int NumPlayers, unsigned Seed)
+	{
+		m_NumPlayers = clamp(NumPlayers, 1, (int)MAX_PLAYERS);
+		m_NumProjectiles = 0;
+		m_NextProjectileID = 0;
+		m_Tick = 0;
+		m_Seed = Seed;
+		for(int i = 0; i < m_NumPlayers; i++)
+		{
+			CPlayer *pPlayer = &m_aPlayers[i];
+			pPlayer->m_X = Random(WORLD_SIZE);
+			pPlayer->m_Y = Random(WORLD_SIZE);
+			pPlayer->m_VelX = pPlayer->m_VelY = 0;
+			pPlayer->m_Angle = Random(256);
+			pPlayer->m_Weapon = Random(5);
+			pPlayer->m_Health = 10;
+			pPlayer->m_Score = 0;
+			pPlayer->m_Latency = 20+Random(80);
+			pPlayer->m_AttackTick = 0;
+		}
+	}
+
+	static void SetStaticSizes(CSnapshotDelta *pDelta)
+	{
+		pDelta->SetStaticsize(TYPE_PROJECTILE, SIZE_PROJECTILE*4);
+		pDelta->SetStaticsize(TYPE_PICKUP, SIZE_PICKUP*4);
+		pDelta->SetStaticsize(TYPE_GAMEINFO, SIZE_GAMEINFO*4);
+		pDelta->SetStaticsize(TYPE_CHARACTER, SIZE_CHARACTER*4);
+		pDelta->SetStaticsize(TYPE_PLAYERINFO, SIZE_PLAYERINFO*4);
+		pDelta->SetStaticsize(TYPE_CLIENTINFO, SIZE_CLIENTINFO*4);
+	}
+
+	int NumPlayers() const { return m_NumPlayers; }
+	int CurrentTick() const { return m_Tick; }
+
+	void Tick()
+	{
+		m_Tick++;
+		for(int i = 0; i < m_NumPlayers; i++)
+		{
+			CPlayer *pPlayer = &m_aPlayers[i];
+			if(Random(8) == 0)
+				pPlayer->m_VelX = clamp(pPlayer->m_VelX+Random(9)-4, -20, 20);
+			if(Random(8) == 0)
+				pPlayer->m_VelY = clamp(pPlayer->m_VelY+Random(9)-4, -20, 20);
+			pPlayer->m_X = clamp(pPlayer->m_X+pPlayer->m_VelX, 0, (int)WORLD_SIZE);
+			pPlayer->m_Y = clamp(pPlayer->m_Y+pPlayer->m_VelY, 0, (int)WORLD_SIZE);
+			pPlayer->m_Angle = (pPlayer->m_Angle+Random(5)-2)&255;
+			if(Random(200) == 0)
+				pPlayer->m_Weapon = Random(5);
+			if(Random(100) == 0)
+				pPlayer->m_Latency = 20+Random(80);
+
+			// shoot now and then
+			if(Random(20) == 0 && m_NumProjectiles < MAX_PROJECTILES)
+			{
+				CProjectile *pProj = &m_aProjectiles[m_NumProjectiles++];
+				pProj->m_X = pPlayer->m_X;
+				pProj->m_Y = pPlayer->m_Y;
+				pProj->m_VelX = Random(61)-30;
+				pProj->m_VelY = Random(61)-30;
+				pProj->m_StartTick = m_Tick;
+				pProj->m_ID = m_NextProjectileID++&0x3fff;
+				pPlayer->m_AttackTick = m_Tick;
+			}
+			if(Random(300) == 0)
+			{
+				pPlayer->m_Health = max(pPlayer->m_Health-Random(5), 1);
+				m_aPlayers[Random(m_NumPlayers)].m_Score++;
+			}
+		}
+
+		// projectiles live for a second
+		for(int i = 0; i < m_NumProjectiles;)
+		{
+			if(m_Tick-m_aProjectiles[i].m_StartTick > 50)
+				m_aProjectiles[i] = m_aProjectiles[--m_NumProjectiles];
+			else
+				i++;
+		}
+	}
+
+	/*
+		Function: Snap
+			Builds the snapshot of the current tick as the given client
+			sees it, -1 for the demo which sees everything. Returns the
+			size of the snapshot written to pData, which must hold
+			CSnapshot::MAX_SIZE bytes.
+	*/
+	int Snap(int ClientID, void *pData)
+	{
+		m_Builder.Init();
+
+		int *pInfo = (int *)m_Builder.NewItem(TYPE_GAMEINFO, 0, SIZE_GAMEINFO*4);
+		pInfo[0] = 0;
+		pInfo[1] = 0;
+		pInfo[2] = 0; // round start tick
+		pInfo[3] = 20;
+		pInfo[4] = 10;
+		pInfo[5] = 0;
+		pInfo[6] = m_Tick/50;
+		pInfo[7] = 1;
+
+		for(int i = 0; i < NUM_PICKUPS; i++)
+		{
+			int X = (i*733)%WORLD_SIZE, Y = (i*1291)%WORLD_SIZE;
+			if(!InView(ClientID, X, Y))
+				continue;
+			int *pPickup = (int *)m_Builder.NewItem(TYPE_PICKUP, i, SIZE_PICKUP*4);
+			pPickup[0] = X;
+			pPickup[1] = Y;
+			pPickup[2] = i%3;
+			pPickup[3] = i%5;
+		}
+
+		for(int i = 0; i < m_NumProjectiles; i++)
+		{
+			CProjectile *pProj = &m_aProjectiles[i];
+			if(!InView(ClientID, pProj->m_X, pProj->m_Y))
+				continue;
+			int *pItem = (int *)m_Builder.NewItem(TYPE_PROJECTILE, pProj->m_ID, SIZE_PROJECTILE*4);
+			pItem[0] = pProj->m_X;
+			pItem[1] = pProj->m_Y;
+			pItem[2] = pProj->m_VelX;
+			pItem[3] = pProj->m_VelY;
+			pItem[4] = 1;
+			pItem[5] = pProj->m_StartTick;
+		}
+
+		for(int i = 0; i < m_NumPlayers; i++)
+		{
+			CPlayer *pPlayer = &m_aPlayers[i];
+
+			int *pClient = (int *)m_Builder.NewItem(TYPE_CLIENTINFO, i, SIZE_CLIENTINFO*4);
+			for(int k = 0; k < SIZE_CLIENTINFO; k++)
+				pClient[k] = (i+1)*0x01010101+k; // name, clan and skin, packed into ints
+
+			int *pPlayerInfo = (int *)m_Builder.NewItem(TYPE_PLAYERINFO, i, SIZE_PLAYERINFO*4);
+			pPlayerInfo[0] = i == ClientID;
+			pPlayerInfo[1] = i;
+			pPlayerInfo[2] = i&1;
+			pPlayerInfo[3] = pPlayer->m_Score;
+			pPlayerInfo[4] = pPlayer->m_Latency;
+
+			if(!InView(ClientID, pPlayer->m_X, pPlayer->m_Y))
+				continue;
+			int *pChar = (int *)m_Builder.NewItem(TYPE_CHARACTER, i, SIZE_CHARACTER*4);
+			pChar[0] = m_Tick;
+			pChar[1] = pPlayer->m_X;
+			pChar[2] = pPlayer->m_Y;
+			pChar[3] = pPlayer->m_VelX*256;
+			pChar[4] = pPlayer->m_VelY*256;
+			pChar[5] = pPlayer->m_Angle;
+			pChar[6] = pPlayer->m_VelX < 0 ? -1 : pPlayer->m_VelX > 0;
+			pChar[7] = 0;
+			pChar[8] = -1;
+			pChar[9] = 0;
+			pChar[10] = 0;
+			pChar[11] = pPlayer->m_X;
+			pChar[12] = pPlayer->m_Y;
+			pChar[13] = 0;
+			pChar[14] = 0;
+			// the own character carries the details
+			pChar[15] = i == ClientID || ClientID < 0 ? pPlayer->m_Health : 0;
+			pChar[16] = 0;
+			pChar[17] = i == ClientID || ClientID < 0 ? 10 : 0;
+			pChar[18] = pPlayer->m_Weapon;
+			pChar[19] = 0;
+			pChar[20] = pPlayer->m_AttackTick;
+			pChar[21] = 0;
+		}
+
+		return m_Builder.Finish(pData);
+	}
+
+	/*
+		Function: Play
+			Plays the given number of ticks and stores the snapshot of
+			every tick for each of the first NumStorages clients, like the
+			server does for clients that ack every snapshot.
+	*/
+	void Play(int NumTicks, CSnapshotStorage *pStorages, int NumStorages)
+	{
+		char *pData = (char *)mem_alloc(CSnapshot::MAX_SIZE, 1);
+		for(int t = 0; t < NumTicks; t++)
+		{
+			Tick();
+			for(int s = 0; s < NumStorages; s++)
+			{
+				int Size = Snap(s, pData);
+				pStorages[s].Add(m_Tick, 0, Size, pData, 0);
+			}
+		}
+		mem_free(pData);
+	}
+};
+
+#endif
@@ -27,6 +27,24 @@ public:
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual unsigned Crc() = 0;
+
+	/*
+		Function: Prepare
+			Loads a map next to the current one, which stays usable.
+			May run on another thread as long as nothing else touches
+			the prepared map meanwhile.
+	*/
+	virtual bool Prepare(const char *pMapName) = 0;
+	virtual unsigned PreparedCrc() = 0;
+	virtual unsigned PreparedSize() = 0;
+	virtual const unsigned char *PreparedData() = 0; // the raw map file
+
+	/*
+		Function: CommitPrepared
+			Replaces the current map with the prepared one.
+	*/
+	virtual void CommitPrepared() = 0;
+	virtual void DiscardPrepared() = 0;
 };
 
 extern IEngineMap *CreateEngineMap();
@@ -22,6 +22,7 @@
 #include <engine/shared/netban.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
+#include <engine/shared/profiler.h>
 #include <engine/shared/protocol.h>
 #include <engine/shared/snapshot.h>
 
@@ -31,6 +32,7 @@
 #include "server.h"
 
 #include <teeuniverses/components/localization.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -297,10 +299,15 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_CurrentGameTick = 0;
 	m_RunServer = 1;
 
-	m_pCurrentMapData = 0;
+	m_MapChunksSent = 0;
+	m_MapBytesSent = 0;
+	m_pNetWait = 0;
+	m_NumTickJitter = 0;
+	m_NetStatsTick = -1;
 	m_CurrentMapSize = 0;
 
 	m_MapReload = 0;
+	m_MapPreparing = false;
 
 	m_RconClientID = IServer::RCON_CID_SERV;
 	m_RconAuthLevel = AUTHED_ADMIN;
@@ -308,6 +315,10 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_ServerInfoFirstRequest = 0;
 	m_ServerInfoNumRequests = 0;
 	m_ServerInfoHighLoad = false;
+	ExpireServerInfo();
+
+	m_pSnapJobs = 0;
+	m_NumSnapWorkers = 0;
 
 	Init();
 }
@@ -344,6 +355,7 @@ int CServer::TrySetClientName(int ClientID, const char *pName)
 
 	// set the client name
 	str_copy(m_aClients[ClientID].m_aName, pName, MAX_NAME_LENGTH);
+	ExpireServerInfo();
 	return 0;
 }
 
@@ -378,7 +390,11 @@ void CServer::SetClientClan(int ClientID, const char *pClan)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY || !pClan)
 		return;
 
+	if(str_comp(m_aClients[ClientID].m_aClan, pClan) == 0)
+		return;
+
 	str_copy(m_aClients[ClientID].m_aClan, pClan, MAX_CLAN_LENGTH);
+	ExpireServerInfo();
 }
 
 void CServer::SetClientCountry(int ClientID, int Country)
@@ -386,14 +402,24 @@ void CServer::SetClientCountry(int ClientID, int Country)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
 
+	if(m_aClients[ClientID].m_Country == Country)
+		return;
+
 	m_aClients[ClientID].m_Country = Country;
+	ExpireServerInfo();
 }
 
 void CServer::SetClientScore(int ClientID, int Score)
 {
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
+
+	// called every tick by the game, only expire the server info on change
+	if(m_aClients[ClientID].m_Score == Score)
+		return;
+
 	m_aClients[ClientID].m_Score = Score;
+	ExpireServerInfo();
 }
 
 void CServer::Kick(int ClientID, const char *pReason)
@@ -572,10 +598,134 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 	return 0;
 }
 
+void CServer::PrepareSnapshot(CSnapJob *pJob)
+{
+	CClient *pClient = &m_aClients[pJob->m_ClientID];
+	pJob->m_Crc = ((CSnapshot*)pJob->m_aData)->Crc();
+	pJob->m_DeltaTime = 0;
+	pJob->m_CompressTime = 0;
+
+	// find snapshot that we can preform delta against
+	pJob->m_DeltaTick = -1;
+	pJob->m_pDeltashot = 0;
+	if(pClient->m_Snapshots.Get(pClient->m_LastAckedSnapshot, 0, &pJob->m_pDeltashot, 0, &pJob->m_pDeltaIndex) >= 0)
+		pJob->m_DeltaTick = pClient->m_LastAckedSnapshot;
+	else
+	{
+		pJob->m_pDeltashot = 0;
+		pJob->m_pDeltaIndex = 0;
+	}
+}
+
+void CServer::EncodeSnapshot(CSnapJob *pJob)
+{
+	CSnapshot *pData = (CSnapshot*)pJob->m_aData;	// Fix compiler warning for strict-aliasing
+	char aDeltaData[CSnapshot::MAX_SIZE];
+	CSnapshot EmptySnap;
+	CSnapshot *pDeltashot = pJob->m_pDeltashot;
+	if(!pDeltashot)
+	{
+		EmptySnap.Clear();
+		pDeltashot = &EmptySnap;
+	}
+
+	// create delta and compress it
+	int64 Start = time_get();
+	int DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData, pJob->m_pDeltaIndex, &pJob->m_ToIndex);
+	int64 DeltaEnd = time_get();
+	pJob->m_CompSize = DeltaSize ? CVariableInt::Compress(aDeltaData, DeltaSize, pJob->m_aCompData) : 0;
+	pJob->m_DeltaTime = DeltaEnd-Start;
+	pJob->m_CompressTime = time_get()-DeltaEnd;
+}
+
+void CServer::SendSnapshot(CSnapJob *pJob)
+{
+	int ClientID = pJob->m_ClientID;
+
+	// save it the snapshot
+	m_aClients[ClientID].m_Snapshots.Add(m_CurrentGameTick, time_get(), pJob->m_SnapshotSize, pJob->m_aData, 0);
+
+	// no acked package found, force client to recover rate
+	if(pJob->m_DeltaTick < 0 && m_aClients[ClientID].m_SnapRate == CClient::SNAPRATE_FULL)
+		m_aClients[ClientID].m_SnapRate = CClient::SNAPRATE_RECOVER;
+
+	if(pJob->m_CompSize)
+	{
+		const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
+		int NumPackets = (pJob->m_CompSize+MaxSize-1)/MaxSize;
+
+		for(int n = 0, Left = pJob->m_CompSize; Left; n++)
+		{
+			int Chunk = Left < MaxSize ? Left : MaxSize;
+			Left -= Chunk;
+
+			if(NumPackets == 1)
+			{
+				CMsgPacker Msg(NETMSG_SNAPSINGLE);
+				Msg.AddInt(m_CurrentGameTick);
+				Msg.AddInt(m_CurrentGameTick-pJob->m_DeltaTick);
+				Msg.AddInt(pJob->m_Crc);
+				Msg.AddInt(Chunk);
+				Msg.AddRaw(&pJob->m_aCompData[n*MaxSize], Chunk);
+				SendMsgEx(&Msg, MSGFLAG_FLUSH, ClientID, true);
+			}
+			else
+			{
+				CMsgPacker Msg(NETMSG_SNAP);
+				Msg.AddInt(m_CurrentGameTick);
+				Msg.AddInt(m_CurrentGameTick-pJob->m_DeltaTick);
+				Msg.AddInt(NumPackets);
+				Msg.AddInt(n);
+				Msg.AddInt(pJob->m_Crc);
+				Msg.AddInt(Chunk);
+				Msg.AddRaw(&pJob->m_aCompData[n*MaxSize], Chunk);
+				SendMsgEx(&Msg, MSGFLAG_FLUSH, ClientID, true);
+			}
+		}
+	}
+	else
+	{
+		CMsgPacker Msg(NETMSG_SNAPEMPTY);
+		Msg.AddInt(m_CurrentGameTick);
+		Msg.AddInt(m_CurrentGameTick-pJob->m_DeltaTick);
+		SendMsgEx(&Msg, MSGFLAG_FLUSH, ClientID, true);
+	}
+}
+
+void CServer::EncodeSnapshotRange(void *pUser, int Begin, int End)
+{
+	CServer *pThis = (CServer *)pUser;
+	for(int i = Begin; i < End; i++)
+		pThis->EncodeSnapshot(&pThis->m_pSnapJobs[i]);
+}
+
+void CServer::InitSnapWorkers(int NumThreads)
+{
+	m_NumSnapWorkers = clamp(NumThreads, 0, (int)MAX_SNAP_THREADS);
+
+	// without workers each client is encoded and sent before the next one is built
+	if(!m_NumSnapWorkers)
+	{
+		m_pSnapJobs = (CSnapJob *)mem_alloc(sizeof(CSnapJob), 1);
+		return;
+	}
+
+	m_pSnapJobs = (CSnapJob *)mem_alloc(sizeof(CSnapJob)*MAX_CLIENTS, 1);
+
+	m_SnapJobPool.Init(m_NumSnapWorkers);
+
+	char aBuf[128];
+	str_format(aBuf, sizeof(aBuf), "encoding snapshots on %d worker threads", m_NumSnapWorkers);
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
+}
+
 void CServer::DoSnapshot()
 {
 	GameServer()->OnPreSnap();
 
+	// the snapshot packets of all clients go out together when the pass is done
+	m_NetServer.BeginSendBatch();
+
 	// create snapshot for demo recording
 	if(m_DemoRecorder.IsRecording())
 	{
@@ -583,15 +733,20 @@ void CServer::DoSnapshot()
 		int SnapshotSize;
 
 		// build snap and possibly add some messages
+		g_Profiler.Begin(CProfiler::SCOPE_SNAP_BUILD);
 		m_SnapshotBuilder.Init();
 		GameServer()->OnSnap(-1);
 		SnapshotSize = m_SnapshotBuilder.Finish(aData);
+		g_Profiler.End(CProfiler::SCOPE_SNAP_BUILD);
 
 		// write snapshot
+		g_Profiler.Begin(CProfiler::SCOPE_SNAP_DEMO);
 		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
+		g_Profiler.End(CProfiler::SCOPE_SNAP_DEMO);
 	}
 
 	// create snapshots for all clients
+	int NumJobs = 0;
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
 		// client must be ingame to recive snapshots
@@ -606,101 +761,57 @@ void CServer::DoSnapshot()
 		if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_INIT && (Tick()%10) != 0)
 			continue;
 
-		{
-			char aData[CSnapshot::MAX_SIZE];
-			CSnapshot *pData = (CSnapshot*)aData;	// Fix compiler warning for strict-aliasing
-			char aDeltaData[CSnapshot::MAX_SIZE];
-			char aCompData[CSnapshot::MAX_SIZE];
-			int SnapshotSize;
-			int Crc;
-			static CSnapshot EmptySnap;
-			CSnapshot *pDeltashot = &EmptySnap;
-			int DeltashotSize;
-			int DeltaTick = -1;
-			int DeltaSize;
-
-			m_SnapshotBuilder.Init();
-
-			GameServer()->OnSnap(i);
+		// remove old snapshos
+		// keep 3 seconds worth of snapshots
+		m_aClients[i].m_Snapshots.PurgeUntil(m_CurrentGameTick-SERVER_TICK_SPEED*3);
 
-			// finish snapshot
-			SnapshotSize = m_SnapshotBuilder.Finish(pData);
-			Crc = pData->Crc();
-
-			// remove old snapshos
-			// keep 3 seconds worth of snapshots
-			m_aClients[i].m_Snapshots.PurgeUntil(m_CurrentGameTick-SERVER_TICK_SPEED*3);
-
-			// save it the snapshot
-			m_aClients[i].m_Snapshots.Add(m_CurrentGameTick, time_get(), SnapshotSize, pData, 0);
-
-			// find snapshot that we can preform delta against
-			EmptySnap.Clear();
+		g_Profiler.Begin(CProfiler::SCOPE_SNAP_BUILD);
+		m_SnapshotBuilder.Init();
 
-			{
-				DeltashotSize = m_aClients[i].m_Snapshots.Get(m_aClients[i].m_LastAckedSnapshot, 0, &pDeltashot, 0);
-				if(DeltashotSize >= 0)
-					DeltaTick = m_aClients[i].m_LastAckedSnapshot;
-				else
-				{
-					// no acked package found, force client to recover rate
-					if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_FULL)
-						m_aClients[i].m_SnapRate = CClient::SNAPRATE_RECOVER;
-				}
-			}
+		GameServer()->OnSnap(i);
 
-			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+		// the game callbacks are not reentrant, so only the finished snapshot goes to the workers
+		CSnapJob *pJob = m_NumSnapWorkers ? &m_pSnapJobs[NumJobs++] : m_pSnapJobs;
+		pJob->m_ClientID = i;
+		pJob->m_SnapshotSize = m_SnapshotBuilder.Finish(pJob->m_aData);
+		PrepareSnapshot(pJob);
+		g_Profiler.End(CProfiler::SCOPE_SNAP_BUILD);
 
-			if(DeltaSize)
-			{
-				// compress it
-				int SnapshotSize;
-				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
-				int NumPackets;
+		if(!m_NumSnapWorkers)
+		{
+			EncodeSnapshot(pJob);
+			g_Profiler.Add(CProfiler::SCOPE_SNAP_DELTA, pJob->m_DeltaTime);
+			g_Profiler.Add(CProfiler::SCOPE_SNAP_COMPRESS, pJob->m_CompressTime);
 
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData);
-				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
+			g_Profiler.Begin(CProfiler::SCOPE_SNAP_SEND);
+			SendSnapshot(pJob);
+			g_Profiler.End(CProfiler::SCOPE_SNAP_SEND);
+		}
+	}
 
-				for(int n = 0, Left = SnapshotSize; Left; n++)
-				{
-					int Chunk = Left < MaxSize ? Left : MaxSize;
-					Left -= Chunk;
+	if(NumJobs)
+	{
+		// the tick thread takes a share of the clients and returns when all are encoded
+		m_SnapJobPool.ParallelFor(NumJobs, EncodeSnapshotRange, this);
 
-					if(NumPackets == 1)
-					{
-						CMsgPacker Msg(NETMSG_SNAPSINGLE);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick-DeltaTick);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
-						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
-					}
-					else
-					{
-						CMsgPacker Msg(NETMSG_SNAP);
-						Msg.AddInt(m_CurrentGameTick);
-						Msg.AddInt(m_CurrentGameTick-DeltaTick);
-						Msg.AddInt(NumPackets);
-						Msg.AddInt(n);
-						Msg.AddInt(Crc);
-						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
-						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
-					}
-				}
-			}
-			else
-			{
-				CMsgPacker Msg(NETMSG_SNAPEMPTY);
-				Msg.AddInt(m_CurrentGameTick);
-				Msg.AddInt(m_CurrentGameTick-DeltaTick);
-				SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
-			}
+		// the encoding times are summed up over all workers
+		for(int i = 0; i < NumJobs; i++)
+		{
+			g_Profiler.Add(CProfiler::SCOPE_SNAP_DELTA, m_pSnapJobs[i].m_DeltaTime);
+			g_Profiler.Add(CProfiler::SCOPE_SNAP_COMPRESS, m_pSnapJobs[i].m_CompressTime);
 		}
+
+		// sending stays on the tick thread and keeps the client order
+		g_Profiler.Begin(CProfiler::SCOPE_SNAP_SEND);
+		for(int i = 0; i < NumJobs; i++)
+			SendSnapshot(&m_pSnapJobs[i]);
+		g_Profiler.End(CProfiler::SCOPE_SNAP_SEND);
 	}
 
+	g_Profiler.Begin(CProfiler::SCOPE_SNAP_SEND);
+	m_NetServer.EndSendBatch();
+	g_Profiler.End(CProfiler::SCOPE_SNAP_SEND);
+
 	GameServer()->OnPostSnap();
 }
 
@@ -715,7 +826,9 @@ int CServer::NewClientNoAuthCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].m_CustClt = 0;
+	pThis->m_aClients[ClientID].m_InfoIsPlayer = false;
 	pThis->m_aClients[ClientID].Reset();
+	pThis->ExpireServerInfo();
 
 	pThis->SendMap(ClientID);
 
@@ -733,8 +846,11 @@ int CServer::NewClientCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_Authed = AUTHED_NO;
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
+	pThis->m_aClients[ClientID].m_MapChunk = -1;
 	memset(&pThis->m_aClients[ClientID].m_Addr, 0, sizeof(NETADDR));
+	pThis->m_aClients[ClientID].m_InfoIsPlayer = false;
 	pThis->m_aClients[ClientID].Reset();
+	pThis->ExpireServerInfo();
 	return 0;
 }
 
@@ -761,6 +877,7 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].m_CustClt = 0;
 	pThis->m_aClients[ClientID].m_Snapshots.PurgeAll();
+	pThis->ExpireServerInfo();
 	return 0;
 }
 
@@ -771,6 +888,109 @@ void CServer::SendMap(int ClientID)
 	Msg.AddInt(m_CurrentMapCrc);
 	Msg.AddInt(m_CurrentMapSize);
 	SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID, true);
+
+	m_aClients[ClientID].m_MapChunk = -1;
+	m_aClients[ClientID].m_NextMapChunk = 0;
+}
+
+void CServer::CMapChunkTable::Build(const unsigned char *pMap, int MapSize, unsigned MapCrc)
+{
+	Free();
+	m_pMap = pMap;
+	m_MapSize = MapSize;
+	m_NumChunks = MapSize > 0 ? (MapSize-1)/MAP_CHUNK_SIZE+1 : 1;
+	m_pOffsets = (int *)mem_alloc((m_NumChunks+1)*sizeof(int), 1);
+	m_pHeaders = (unsigned char *)mem_alloc(m_NumChunks*MAP_CHUNK_HEADER_SIZE, 1);
+
+	int Size = 0;
+	for(int i = 0; i < m_NumChunks; i++)
+	{
+		int Offset = i*MAP_CHUNK_SIZE;
+		int ChunkSize = min((int)MAP_CHUNK_SIZE, MapSize-Offset);
+
+		// same layout as SendMsgEx gives a system message, minus the data
+		CPacker Msg;
+		Msg.Reset();
+		Msg.AddInt((NETMSG_MAP_DATA<<1)|1);
+		Msg.AddInt(i == m_NumChunks-1); // last
+		Msg.AddInt(MapCrc);
+		Msg.AddInt(i);
+		Msg.AddInt(ChunkSize);
+		dbg_assert(Msg.Size() <= MAP_CHUNK_HEADER_SIZE, "map chunk header too large");
+
+		m_pOffsets[i] = Size;
+		mem_copy(m_pHeaders+Size, Msg.Data(), Msg.Size());
+		Size += Msg.Size();
+	}
+	m_pOffsets[m_NumChunks] = Size;
+}
+
+void CServer::CMapChunkTable::Free()
+{
+	mem_free(m_pHeaders);
+	mem_free(m_pOffsets);
+	m_pMap = 0;
+	m_MapSize = 0;
+	m_pHeaders = 0;
+	m_pOffsets = 0;
+	m_NumChunks = 0;
+}
+
+int CServer::CMapChunkTable::Message(int Chunk, unsigned char *pBuf) const
+{
+	int HeaderSize = m_pOffsets[Chunk+1]-m_pOffsets[Chunk];
+	int Offset = Chunk*MAP_CHUNK_SIZE;
+	int ChunkSize = min((int)MAP_CHUNK_SIZE, m_MapSize-Offset);
+	memcpy(pBuf, m_pHeaders+m_pOffsets[Chunk], HeaderSize);
+	if(ChunkSize > 0)
+		memcpy(pBuf+HeaderSize, m_pMap+Offset, ChunkSize);
+	return HeaderSize+max(ChunkSize, 0);
+}
+
+void CServer::SendMapData(int ClientID, int Chunk)
+{
+	CNetChunk Packet;
+	mem_zero(&Packet, sizeof(CNetChunk));
+	Packet.m_ClientID = ClientID;
+	Packet.m_Flags = NETSENDFLAG_VITAL|NETSENDFLAG_FLUSH;
+	unsigned char aData[MAP_CHUNK_HEADER_SIZE+MAP_CHUNK_SIZE];
+	Packet.m_DataSize = m_MapChunks.Message(Chunk, aData);
+	Packet.m_pData = aData;
+	m_NetServer.Send(&Packet);
+
+	m_MapChunksSent++;
+	m_MapBytesSent += Packet.m_DataSize;
+
+	if(g_Config.m_Debug)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "sending chunk %d with size %d", Chunk, Packet.m_DataSize);
+		Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+	}
+}
+
+void CServer::FillMapWindow(int ClientID)
+{
+	// vital chunks arrive in order, so the client takes the chunks sent
+	// ahead one after another and its requests only move the window on.
+	// the resend buffer bounds what is in flight, running out of it drops the client
+	CClient *pClient = &m_aClients[ClientID];
+	int End = min(pClient->m_MapChunk+1+g_Config.m_SvMapWindow, NumMapChunks());
+	while(pClient->m_NextMapChunk < End && m_NetServer.ResendBufferSize(ClientID) < MAP_WINDOW_BUFFER)
+		SendMapData(ClientID, pClient->m_NextMapChunk++);
+}
+
+void CServer::UpdateMapDownloads()
+{
+	// go on with downloads that were held back by a full resend buffer
+	if(!g_Config.m_SvMapWindow)
+		return;
+
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_aClients[i].m_State == CClient::STATE_CONNECTING && m_aClients[i].m_MapChunk >= 0)
+			FillMapWindow(i);
+	}
 }
 
 void CServer::SendConnectionReady(int ClientID)
@@ -804,13 +1024,14 @@ void CServer::SendRconLineAuthed(const char *pLine, void *pUser)
 	ReentryGuard--;
 }
 
-void CServer::SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID)
+int CServer::SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID)
 {
 	CMsgPacker Msg(NETMSG_RCON_CMD_ADD);
 	Msg.AddString(pCommandInfo->m_pName, IConsole::TEMPCMD_NAME_LENGTH);
 	Msg.AddString(pCommandInfo->m_pHelp, IConsole::TEMPCMD_HELP_LENGTH);
 	Msg.AddString(pCommandInfo->m_pParams, IConsole::TEMPCMD_PARAMS_LENGTH);
 	SendMsgEx(&Msg, MSGFLAG_VITAL, ClientID, true);
+	return Msg.Size();
 }
 
 void CServer::SendRconCmdRem(const IConsole::CCommandInfo *pCommandInfo, int ClientID)
@@ -822,16 +1043,23 @@ void CServer::SendRconCmdRem(const IConsole::CCommandInfo *pCommandInfo, int Cli
 
 void CServer::UpdateClientRconCommands()
 {
-	int ClientID = Tick() % MAX_CLIENTS;
-
-	if(m_aClients[ClientID].m_State != CClient::STATE_EMPTY && m_aClients[ClientID].m_Authed)
+	// every authed client gets its commands each tick until it has all of them.
+	// the messages are only flushed at the end, so the connection fills whole packets with them
+	for(int ClientID = 0; ClientID < MAX_CLIENTS; ClientID++)
 	{
-		int ConsoleAccessLevel = m_aClients[ClientID].m_Authed == AUTHED_ADMIN ? IConsole::ACCESS_LEVEL_ADMIN : IConsole::ACCESS_LEVEL_MOD;
-		for(int i = 0; i < MAX_RCONCMD_SEND && m_aClients[ClientID].m_pRconCmdToSend; ++i)
+		CClient *pClient = &m_aClients[ClientID];
+		if(pClient->m_State == CClient::STATE_EMPTY || !pClient->m_Authed || !pClient->m_pRconCmdToSend)
+			continue;
+
+		int ConsoleAccessLevel = pClient->m_Authed == AUTHED_ADMIN ? IConsole::ACCESS_LEVEL_ADMIN : IConsole::ACCESS_LEVEL_MOD;
+		int Bytes = 0;
+		while(pClient->m_pRconCmdToSend && Bytes < RCONCMD_SEND_BYTES && m_NetServer.ResendBufferSize(ClientID) < RCONCMD_BUFFER)
 		{
-			SendRconCmdAdd(m_aClients[ClientID].m_pRconCmdToSend, ClientID);
-			m_aClients[ClientID].m_pRconCmdToSend = m_aClients[ClientID].m_pRconCmdToSend->NextCommandInfo(ConsoleAccessLevel, CFGFLAG_SERVER);
+			Bytes += SendRconCmdAdd(pClient->m_pRconCmdToSend, ClientID);
+			pClient->m_pRconCmdToSend = pClient->m_pRconCmdToSend->NextCommandInfo(ConsoleAccessLevel, CFGFLAG_SERVER);
 		}
+		if(Bytes)
+			m_NetServer.Flush(ClientID);
 	}
 }
 
@@ -884,36 +1112,20 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				return;
 
 			int Chunk = Unpacker.GetInt();
-			unsigned int ChunkSize = 1024-128;
-			unsigned int Offset = Chunk * ChunkSize;
-			int Last = 0;
 
 			// drop faulty map data requests
-			if(Chunk < 0 || Offset > (unsigned int) m_CurrentMapSize)
+			if(Chunk < 0 || Chunk >= NumMapChunks())
 				return;
 
-			if(Offset+ChunkSize >= (unsigned int) m_CurrentMapSize)
-			{
-				ChunkSize = m_CurrentMapSize-Offset;
-				if(ChunkSize < 0)
-					ChunkSize = 0;
-				Last = 1;
-			}
-
-			CMsgPacker Msg(NETMSG_MAP_DATA);
-			Msg.AddInt(Last);
-			Msg.AddInt(m_CurrentMapCrc);
-			Msg.AddInt(Chunk);
-			Msg.AddInt(ChunkSize);
-			Msg.AddRaw(&m_pCurrentMapData[Offset], ChunkSize);
-			SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID, true);
-
-			if(g_Config.m_Debug)
+			// a request for a chunk that was sent ahead already just acks the one before
+			CClient *pClient = &m_aClients[ClientID];
+			if(Chunk >= pClient->m_NextMapChunk || !g_Config.m_SvMapWindow)
 			{
-				char aBuf[256];
-				str_format(aBuf, sizeof(aBuf), "sending chunk %d with size %d", Chunk, ChunkSize);
-				Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+				SendMapData(ClientID, Chunk);
+				pClient->m_NextMapChunk = Chunk+1;
 			}
+			pClient->m_MapChunk = Chunk;
+			FillMapWindow(ClientID);
 		}
 		else if(Msg == NETMSG_READY)
 		{
@@ -1160,12 +1372,23 @@ void CServer::SendServerInfoConnless(const NETADDR *pAddr, int Token, int Type)
 	SendServerInfo(pAddr, Token, Type, SendClients);
 }
 
-void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool SendClients)
+void CServer::CServerInfoCache::AddChunk(const void *pData, int Size)
+{
+	dbg_assert(m_NumChunks < MAX_CHUNKS, "too many server info chunks");
+	dbg_assert(Size <= (int)sizeof(m_aChunks[0].m_aData), "server info chunk too large");
+	m_aChunks[m_NumChunks].m_DataSize = Size;
+	mem_copy(m_aChunks[m_NumChunks].m_aData, pData, Size);
+	m_NumChunks++;
+}
+
+void CServer::CacheServerInfo(CServerInfoCache *pCache, int Type, bool SendClients)
 {
 	// One chance to improve the protocol!
 	CPacker p;
 	char aBuf[256];
 
+	pCache->Clear();
+
 	// count the players
 	int PlayerCount = 0, ClientCount = 0;
 	for(int i = 0; i < MAX_CLIENTS; i++)
@@ -1181,7 +1404,6 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 
 	p.Reset();
 
-#define ADD_RAW(p, x) (p).AddRaw(x, sizeof(x))
 #define ADD_INT(p, x) \
 	do \
 	{ \
@@ -1189,17 +1411,7 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 		(p).AddString(aBuf, 0); \
 	} while(0)
 
-	switch(Type)
-	{
-	case SERVERINFO_EXTENDED: ADD_RAW(p, SERVERBROWSE_INFO_EXTENDED); break;
-	case SERVERINFO_64_LEGACY: ADD_RAW(p, SERVERBROWSE_INFO_64_LEGACY); break;
-	case SERVERINFO_VANILLA: ADD_RAW(p, SERVERBROWSE_INFO); break;
-	case SERVERINFO_INGAME: ADD_RAW(p, SERVERBROWSE_INFO); break;
-	default: dbg_assert(false, "unknown serverinfo type");
-	}
-
-	ADD_INT(p, Token);
-
+	// the header and the token are added per request in SendServerInfo
 	p.AddString(GameServer()->Version(), 32);
 
 	memcpy(aBuf, g_Config.m_SvName, sizeof(aBuf));
@@ -1264,22 +1476,13 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 	const void *pPrefix = p.Data();
 	int PrefixSize = p.Size();
 
+	// leave room for the packet header and the longest possible token
+	const int MaxChunkSize = NET_MAX_PAYLOAD - (int)sizeof(SERVERBROWSE_INFO_EXTENDED) - 12;
+
 	CPacker pp;
-	CNetChunk Packet;
-	int PacketsSent = 0;
 	int PlayersSent = 0;
-	Packet.m_ClientID = -1;
-	Packet.m_Address = *pAddr;
-	Packet.m_Flags = NETSENDFLAG_CONNLESS;
 
-	#define SEND(size) \
-		do \
-		{ \
-			Packet.m_pData = pp.Data(); \
-			Packet.m_DataSize = size; \
-			m_NetServer.Send(&Packet); \
-			PacketsSent++; \
-		} while(0)
+	#define ADD_CHUNK(size) pCache->AddChunk(pp.Data(), size)
 
 	#define RESET() \
 		do \
@@ -1295,14 +1498,16 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 
 	if(!SendClients)
 	{
-		SEND(pp.Size());
+		ADD_CHUNK(pp.Size());
+		pCache->m_Valid = true;
 		return;
 	}
 
 	if(Type == SERVERINFO_EXTENDED)
 	{
-		pPrefix = SERVERBROWSE_INFO_EXTENDED_MORE;
-		PrefixSize = sizeof(SERVERBROWSE_INFO_EXTENDED_MORE);
+		// continuation packets only carry the SERVERBROWSE_INFO_EXTENDED_MORE header and the token
+		pPrefix = 0;
+		PrefixSize = 0;
 	}
 
 	int Remaining;
@@ -1312,7 +1517,7 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 	case SERVERINFO_64_LEGACY: Remaining = 24; break;
 	case SERVERINFO_VANILLA: Remaining = VANILLA_MAX_CLIENTS; break;
 	case SERVERINFO_INGAME: Remaining = VANILLA_MAX_CLIENTS; break;
-	default: dbg_assert(0, "caught earlier, unreachable"); return;
+	default: dbg_assert(0, "unknown serverinfo type"); return;
 	}
 
 	// Use the following strategy for sending:
@@ -1335,7 +1540,7 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 					break;
 
 				// Otherwise we're SERVERINFO_64_LEGACY.
-				SEND(pp.Size());
+				ADD_CHUNK(pp.Size());
 				RESET();
 				pp.AddInt(PlayersSent); // offset
 				Remaining = 24;
@@ -1358,14 +1563,13 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 
 			if(Type == SERVERINFO_EXTENDED)
 			{
-				if(pp.Size() >= NET_MAX_PAYLOAD)
+				if(pp.Size() >= MaxChunkSize)
 				{
 					// Retry current player.
 					i--;
-					SEND(PreviousSize);
+					ADD_CHUNK(PreviousSize);
 					RESET();
-					ADD_INT(pp, Token);
-					ADD_INT(pp, PacketsSent);
+					ADD_INT(pp, pCache->m_NumChunks);
 					pp.AddString("", 0); // extra info, reserved
 					continue;
 				}
@@ -1374,15 +1578,82 @@ void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool Sen
 		}
 	}
 
-	SEND(pp.Size());
-	#undef SEND
+	ADD_CHUNK(pp.Size());
+	pCache->m_Valid = true;
+	#undef ADD_CHUNK
 	#undef RESET
-	#undef ADD_RAW
 	#undef ADD_INT
 }
 
+void CServer::SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool SendClients)
+{
+	dbg_assert(Type >= SERVERINFO_VANILLA && Type <= SERVERINFO_INGAME && Type != SERVERINFO_EXTENDED_MORE, "unknown serverinfo type");
+
+	CServerInfoCache *pCache = &m_aServerInfoCache[Type*2 + (SendClients ? 1 : 0)];
+	if(!pCache->m_Valid)
+		CacheServerInfo(pCache, Type, SendClients);
+
+	const unsigned char *pHeader;
+	switch(Type)
+	{
+	case SERVERINFO_EXTENDED: pHeader = SERVERBROWSE_INFO_EXTENDED; break;
+	case SERVERINFO_64_LEGACY: pHeader = SERVERBROWSE_INFO_64_LEGACY; break;
+	default: pHeader = SERVERBROWSE_INFO;
+	}
+
+	char aToken[16];
+	str_format(aToken, sizeof(aToken), "%d", Token);
+	int TokenSize = str_length(aToken)+1;
+
+	unsigned char aData[NET_MAX_PAYLOAD];
+	CNetChunk Packet;
+	Packet.m_ClientID = -1;
+	Packet.m_Address = *pAddr;
+	Packet.m_Flags = NETSENDFLAG_CONNLESS;
+	Packet.m_pData = aData;
+
+	// every packet is the header, the token and one cached chunk
+	for(int i = 0; i < pCache->m_NumChunks; i++)
+	{
+		const CServerInfoCache::CChunk *pChunk = &pCache->m_aChunks[i];
+		if(Type == SERVERINFO_EXTENDED && i > 0)
+			pHeader = SERVERBROWSE_INFO_EXTENDED_MORE;
+
+		mem_copy(aData, pHeader, sizeof(SERVERBROWSE_INFO));
+		mem_copy(aData+sizeof(SERVERBROWSE_INFO), aToken, TokenSize);
+		mem_copy(aData+sizeof(SERVERBROWSE_INFO)+TokenSize, pChunk->m_aData, pChunk->m_DataSize);
+		Packet.m_DataSize = sizeof(SERVERBROWSE_INFO)+TokenSize+pChunk->m_DataSize;
+		m_NetServer.Send(&Packet);
+	}
+}
+
+void CServer::ExpireServerInfo()
+{
+	for(unsigned i = 0; i < sizeof(m_aServerInfoCache)/sizeof(m_aServerInfoCache[0]); i++)
+		m_aServerInfoCache[i].m_Valid = false;
+}
+
+void CServer::CheckServerInfoPlayers()
+{
+	// team changes are made by the game, pick them up once per tick
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_aClients[i].m_State == CClient::STATE_EMPTY)
+			continue;
+
+		bool IsPlayer = GameServer()->IsClientPlayer(i);
+		if(m_aClients[i].m_InfoIsPlayer != IsPlayer)
+		{
+			m_aClients[i].m_InfoIsPlayer = IsPlayer;
+			ExpireServerInfo();
+		}
+	}
+}
+
 void CServer::UpdateServerInfo()
 {
+	ExpireServerInfo();
+
 	for(int i = 0; i < MAX_CLIENTS; ++i)
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
@@ -1465,23 +1736,59 @@ char *CServer::GetMapName()
 
 int CServer::LoadMap(const char *pMapName)
 {
-	//DATAFILE *df;
+	str_copy(m_PreparedMap.m_aName, pMapName, sizeof(m_PreparedMap.m_aName));
+	if(!PrepareMap())
+	{
+		if(m_PreparedMap.m_Invalid)
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
+		return 0;
+	}
+
+	CommitMap();
+	return 1;
+}
+
+bool CServer::PrepareMap()
+{
+	// runs on the map worker during a map change, so only touch the prepared map
+	int64 StartTime = time_get();
 	char aBuf[512];
-	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", m_PreparedMap.m_aName);
+	m_PreparedMap.m_Loaded = false;
+	m_PreparedMap.m_Invalid = false;
+
+	// the map is read once, the crc, the map data and the download are all taken from that copy
+	if(!m_pMap->Prepare(aBuf))
+		return false;
+	m_PreparedMap.m_Crc = m_pMap->PreparedCrc();
 
-	/*df = datafile_load(buf);
-	if(!df)
-		return 0;*/
+	m_PreparedMap.m_Size = (int)m_pMap->PreparedSize();
 
 	// check for valid standard map
-	if(!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
+	if(!m_MapChecker.ValidateMap(aBuf, m_PreparedMap.m_Crc, m_PreparedMap.m_Size))
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
-		return 0;
+		m_pMap->DiscardPrepared();
+		m_PreparedMap.m_Invalid = true;
+		return false;
 	}
 
-	if(!m_pMap->Load(aBuf))
-		return 0;
+	// pack the download headers once, the payloads stay in the map's copy of
+	// the file, which CommitPrepared hands over to the current map as it is
+	m_PreparedMap.m_Chunks.Build(m_pMap->PreparedData(), m_PreparedMap.m_Size, m_PreparedMap.m_Crc);
+
+	m_PreparedMap.m_Loaded = true;
+	m_PreparedMap.m_PrepareTime = time_get()-StartTime;
+	return true;
+}
+
+int CServer::PrepareMapThread(void *pUser)
+{
+	return ((CServer *)pUser)->PrepareMap();
+}
+
+void CServer::CommitMap()
+{
+	m_pMap->CommitPrepared();
 
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
@@ -1490,25 +1797,18 @@ int CServer::LoadMap(const char *pMapName)
 	m_IDPool.TimeoutIDs();
 
 	// get the crc of the map
-	m_CurrentMapCrc = m_pMap->Crc();
+	m_CurrentMapCrc = m_PreparedMap.m_Crc;
 	char aBufMsg[256];
-	str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, m_CurrentMapCrc);
+	str_format(aBufMsg, sizeof(aBufMsg), "maps/%s.map crc is %08x", m_PreparedMap.m_aName, m_CurrentMapCrc);
 	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
 
-	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
-	//map_set(df);
+	str_copy(m_aCurrentMap, m_PreparedMap.m_aName, sizeof(m_aCurrentMap));
 
-	// load complete map into memory for download
-	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		m_CurrentMapSize = (int)io_length(File);
-		if(m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
-		io_close(File);
-	}
-	return 1;
+	m_CurrentMapSize = m_PreparedMap.m_Size;
+	m_MapChunks.Free();
+	m_MapChunks = m_PreparedMap.m_Chunks;
+	m_PreparedMap.m_Chunks = CMapChunkTable();
+	m_PreparedMap.m_Loaded = false;
 }
 
 void CServer::InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole)
@@ -1550,9 +1850,13 @@ int CServer::Run()
 	}
 
 	m_NetServer.SetCallbacks(NewClientCallback, NewClientNoAuthCallback, DelClientCallback, this);
+	m_NetServer.SetBatching(g_Config.m_SvNetBatching);
 
 	m_Econ.Init(Console(), &m_ServerBan);
 
+	InitSnapWorkers(g_Config.m_SvSnapThreads);
+	m_MapJobPool.Init(1);
+
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "server name is '%s'", g_Config.m_SvName);
 	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
@@ -1568,10 +1872,21 @@ int CServer::Run()
 	{
 		int64 ReportTime = time_get();
 		int ReportInterval = 3;
+		int64 PerfReportTime = time_get();
 
 		m_Lastheartbeat = 0;
 		m_GameStartTime = time_get();
 
+		// the sockets are watched for the whole run, econ adds and removes its clients itself
+		m_pNetWait = net_wait_create();
+		if(m_pNetWait)
+		{
+			net_wait_add(m_pNetWait, m_NetServer.Socket());
+			m_Econ.SetWait(m_pNetWait);
+		}
+		else
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "falling back to polling the network");
+
 		if(g_Config.m_Debug)
 		{
 			str_format(aBuf, sizeof(aBuf), "baseline memory usage %dk", mem_stats()->allocated/1024);
@@ -1583,16 +1898,27 @@ int CServer::Run()
 			int64 t = time_get();
 			int NewTicks = 0;
 
-			// load new map TODO: don't poll this
-			if(str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload)
+			// load new map in the background, the game goes on meanwhile
+			if(!m_MapPreparing && (str_comp(g_Config.m_SvMap, m_aCurrentMap) != 0 || m_MapReload))
 			{
 				m_MapReload = 0;
+				m_MapPreparing = true;
+				str_copy(m_PreparedMap.m_aName, g_Config.m_SvMap, sizeof(m_PreparedMap.m_aName));
+				m_MapJobPool.Add(&m_MapJob, PrepareMapThread, this, &m_MapJobCounter);
+			}
+
+			// switch over once it is ready
+			if(m_MapPreparing && !m_MapJobCounter.Pending())
+			{
+				m_MapPreparing = false;
 
-				// load map
-				if(LoadMap(g_Config.m_SvMap))
+				if(m_PreparedMap.m_Loaded)
 				{
+					int64 StallStart = time_get();
+
 					// new map loaded
 					GameServer()->OnShutdown();
+					CommitMap();
 
 					for(int c = 0; c < MAX_CLIENTS; c++)
 					{
@@ -1609,12 +1935,21 @@ int CServer::Run()
 					Kernel()->ReregisterInterface(GameServer());
 					GameServer()->OnInit();
 					UpdateServerInfo();
+
+					str_format(aBuf, sizeof(aBuf), "map change: loaded in %.2f ms on a worker, game stalled for %.2f ms",
+						m_PreparedMap.m_PrepareTime*1000.0/time_freq(), (time_get()-StallStart)*1000.0/time_freq());
+					Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 				}
 				else
 				{
-					str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", g_Config.m_SvMap);
+					if(m_PreparedMap.m_Invalid)
+						Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
+					str_format(aBuf, sizeof(aBuf), "failed to load map. mapname='%s'", m_PreparedMap.m_aName);
 					Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-					str_copy(g_Config.m_SvMap, m_aCurrentMap, sizeof(g_Config.m_SvMap));
+
+					// keep a map that was set while this one was loading
+					if(str_comp(g_Config.m_SvMap, m_PreparedMap.m_aName) == 0)
+						str_copy(g_Config.m_SvMap, m_aCurrentMap, sizeof(g_Config.m_SvMap));
 				}
 			}
 
@@ -1623,6 +1958,12 @@ int CServer::Run()
 				m_CurrentGameTick++;
 				NewTicks++;
 
+				if(g_Config.m_DbgTickJitter)
+					RecordTickJitter((int)((t-TickStartTime(m_CurrentGameTick))*1000000/time_freq()));
+
+				if(g_Config.m_DbgNetStats && (m_CurrentGameTick%(SERVER_TICK_SPEED*5)) == 0)
+					ReportNetStats();
+
 				// apply new input
 				for(int c = 0; c < MAX_CLIENTS; c++)
 				{
@@ -1639,51 +1980,65 @@ int CServer::Run()
 					}
 				}
 
+				g_Profiler.Begin(CProfiler::SCOPE_TICK);
 				GameServer()->OnTick();
+				g_Profiler.End(CProfiler::SCOPE_TICK);
+				CheckServerInfoPlayers();
 			}
 
 			// snap game
 			if(NewTicks)
 			{
+				UpdateMapDownloads();
+
 				if(g_Config.m_SvHighBandwidth || (m_CurrentGameTick%2) == 0)
+				{
+					g_Profiler.Begin(CProfiler::SCOPE_SNAP);
 					DoSnapshot();
+					g_Profiler.End(CProfiler::SCOPE_SNAP);
+				}
 
+				g_Profiler.Begin(CProfiler::SCOPE_RCONCMDS);
 				UpdateClientRconCommands();
+				g_Profiler.End(CProfiler::SCOPE_RCONCMDS);
+
+				g_Profiler.NextFrame();
 			}
 
 			// master server stuff
 			m_Register.RegisterUpdate(m_NetServer.NetType());
 
+			g_Profiler.Begin(CProfiler::SCOPE_NETWORK);
 			PumpNetwork();
+			g_Profiler.End(CProfiler::SCOPE_NETWORK);
 
 			if(ReportTime < time_get())
 			{
-				if(g_Config.m_Debug)
-				{
-					/*
-					static NETSTATS prev_stats;
-					NETSTATS stats;
-					netserver_stats(net, &stats);
-
-					perf_next();
-
-					if(config.dbg_pref)
-						perf_dump(&rootscope);
-
-					dbg_msg("server", "send=%8d recv=%8d",
-						(stats.send_bytes - prev_stats.send_bytes)/reportinterval,
-						(stats.recv_bytes - prev_stats.recv_bytes)/reportinterval);
-
-					prev_stats = stats;
-					*/
-				}
+				if(g_Config.m_Debug && g_Config.m_DbgPref)
+					PerfDump();
 
 				ReportTime += time_freq()*ReportInterval;
 			}
 
-			// wait for incomming data
-			net_socket_read_wait(m_NetServer.Socket(), 5);
+			if(g_Config.m_EcPerfReport && PerfReportTime < time_get())
+			{
+				SendPerfReport();
+				PerfReportTime = time_get()+time_freq()*g_Config.m_EcPerfReport;
+			}
+
+			// wait for incomming data or the next tick
+			if(m_pNetWait)
+				net_wait(m_pNetWait, TickStartTime(m_CurrentGameTick+1));
+			else
+				net_socket_read_wait(m_NetServer.Socket(), 5);
 		}
+
+		if(m_pNetWait)
+		{
+			m_Econ.SetWait(0);
+			net_wait_destroy(m_pNetWait);
+		}
+		m_pNetWait = 0;
 	}
 	// disconnect all clients on shutdown
 	for(int i = 0; i < MAX_CLIENTS; ++i)
@@ -1695,10 +2050,14 @@ int CServer::Run()
 	}
 
 	GameServer()->OnShutdown();
+	m_MapJobPool.Wait(&m_MapJobCounter);
+	m_pMap->DiscardPrepared();
 	m_pMap->Unload();
+	m_MapChunks.Free();
+	m_PreparedMap.m_Chunks.Free();
 
-	if(m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
+	mem_free(m_pSnapJobs);
+	m_pSnapJobs = 0;
 	return 0;
 }
 
@@ -1816,6 +2175,117 @@ void CServer::ConLogout(IConsole::IResult *pResult, void *pUser)
 	}
 }
 
+void CServer::PerfDump()
+{
+	char aBuf[256];
+	for(int i = 0; i < CProfiler::NUM_SCOPES; i++)
+	{
+		CProfiler::CStats Stats;
+		g_Profiler.GetStats(i, &Stats);
+		str_format(aBuf, sizeof(aBuf), "%*s%-*s p50=%6.2fms p99=%6.2fms max=%6.2fms samples=%d",
+			CProfiler::ScopeDepth(i)*2, "", 12-CProfiler::ScopeDepth(i)*2, CProfiler::ScopeName(i),
+			Stats.m_P50/1000.0f, Stats.m_P99/1000.0f, Stats.m_Max/1000.0f, Stats.m_NumSamples);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	}
+
+	str_format(aBuf, sizeof(aBuf), "map download: %lld chunks sent from the map file copy, %lld KB", m_MapChunksSent, m_MapBytesSent/1024);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+}
+
+void CServer::SendPerfReport()
+{
+	// one line with the top level phases, p50/p99/max in milliseconds
+	char aBuf[512];
+	str_copy(aBuf, "[perf]", sizeof(aBuf));
+	for(int i = 0; i < CProfiler::NUM_SCOPES; i++)
+	{
+		if(CProfiler::ScopeParent(i) >= 0)
+			continue;
+
+		CProfiler::CStats Stats;
+		g_Profiler.GetStats(i, &Stats);
+		char aScope[64];
+		str_format(aScope, sizeof(aScope), " %s=%.2f/%.2f/%.2f", CProfiler::ScopeName(i),
+			Stats.m_P50/1000.0f, Stats.m_P99/1000.0f, Stats.m_Max/1000.0f);
+		str_append(aBuf, aScope, sizeof(aBuf));
+	}
+	m_Econ.Send(-1, aBuf);
+}
+
+void CServer::RecordTickJitter(int Lateness)
+{
+	m_aTickJitter[m_NumTickJitter++] = Lateness;
+	if(m_NumTickJitter < (int)(sizeof(m_aTickJitter)/sizeof(m_aTickJitter[0])))
+		return;
+
+	int64 Total = 0;
+	for(int i = 0; i < m_NumTickJitter; i++)
+		Total += m_aTickJitter[i];
+	std::sort(m_aTickJitter, m_aTickJitter+m_NumTickJitter);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "tick start jitter over %d ticks: avg=%.3fms p50=%.3fms p99=%.3fms max=%.3fms",
+		m_NumTickJitter, Total/(float)m_NumTickJitter/1000.0f, m_aTickJitter[m_NumTickJitter/2]/1000.0f,
+		m_aTickJitter[(m_NumTickJitter-1)*99/100]/1000.0f, m_aTickJitter[m_NumTickJitter-1]/1000.0f);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	m_NumTickJitter = 0;
+}
+
+void CServer::ReportNetStats()
+{
+	NETSTATS Stats;
+	net_stats(&Stats);
+
+	int Ticks = m_CurrentGameTick-m_NetStatsTick;
+	if(Ticks > 0 && m_NetStatsTick >= 0)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "net per tick: sent %.1f packets in %.1f syscalls, recv %.1f packets in %.1f syscalls",
+			(Stats.sent_packets-m_LastNetStats.sent_packets)/(float)Ticks, (Stats.send_calls-m_LastNetStats.send_calls)/(float)Ticks,
+			(Stats.recv_packets-m_LastNetStats.recv_packets)/(float)Ticks, (Stats.recv_calls-m_LastNetStats.recv_calls)/(float)Ticks);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+
+	m_LastNetStats = Stats;
+	m_NetStatsTick = m_CurrentGameTick;
+}
+
+void CServer::ConchainNetBatchingUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments())
+		((CServer *)pUserData)->m_NetServer.SetBatching(pResult->GetInteger(0) != 0);
+}
+
+void CServer::ConPerfDump(IConsole::IResult *pResult, void *pUser)
+{
+	((CServer *)pUser)->PerfDump();
+}
+
+void CServer::ConSnapMemory(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	char aBuf[256];
+	int NumArenas = 0, TotalArena = 0, TotalUsed = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CSnapshotStorage *pStorage = &pThis->m_aClients[i].m_Snapshots;
+		if(!pStorage->ArenaSize())
+			continue;
+
+		NumArenas++;
+		TotalArena += pStorage->ArenaSize();
+		TotalUsed += pStorage->UsedSize();
+		if(pThis->m_aClients[i].m_State == CClient::STATE_EMPTY)
+			continue;
+		str_format(aBuf, sizeof(aBuf), "id=%d snapshots=%d used=%dKB arena=%dKB grows=%d name='%s'", i,
+			pStorage->NumSnapshots(), pStorage->UsedSize()/1024, pStorage->ArenaSize()/1024, pStorage->NumGrows(), pThis->ClientName(i));
+		pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+	str_format(aBuf, sizeof(aBuf), "snapshot history: %d arenas, %dKB used of %dKB", NumArenas, TotalUsed/1024, TotalArena/1024);
+	pThis->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+}
+
 void CServer::ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -1886,11 +2356,15 @@ void CServer::RegisterCommands()
 	Console()->Register("stoprecord", "", CFGFLAG_SERVER, ConStopRecord, this, "Stop recording");
 
 	Console()->Register("reload", "", CFGFLAG_SERVER, ConMapReload, this, "Reload the map");
+	Console()->Register("perf_dump", "", CFGFLAG_SERVER, ConPerfDump, this, "Show tick phase timings (p50/p99/max) and map download counters");
+	Console()->Register("snap_memory", "", CFGFLAG_SERVER, ConSnapMemory, this, "Show the snapshot history memory of every client");
 
 	Console()->Chain("sv_name", ConchainSpecialInfoupdate, this);
 	Console()->Chain("password", ConchainSpecialInfoupdate, this);
+	Console()->Chain("sv_spectator_slots", ConchainSpecialInfoupdate, this);
 
 	Console()->Chain("sv_max_clients_per_ip", ConchainMaxclientsperipUpdate, this);
+	Console()->Chain("sv_net_batching", ConchainNetBatchingUpdate, this);
 	Console()->Chain("mod_command", ConchainModCommandUpdate, this);
 	Console()->Chain("console_output_level", ConchainConsoleOutputLevelUpdate, this);
 	// register console commands in sub parts
@@ -4,6 +4,7 @@
 #define ENGINE_SERVER_SERVER_H
 
 #include <engine/server.h>
+#include <engine/shared/jobs.h>
 
 
 class CSnapIDPool
@@ -75,7 +76,17 @@ public:
 		AUTHED_MOD,
 		AUTHED_ADMIN,
 
-		MAX_RCONCMD_SEND=16,
+		// rcon commands sent to a client per tick, in full packets, as long
+		// as the resend buffer of the connection is below the limit
+		RCONCMD_SEND_BYTES=4*NET_MAX_PAYLOAD,
+		RCONCMD_BUFFER=NET_CONN_BUFFERSIZE/4,
+
+		MAX_SNAP_THREADS=16,
+
+		MAP_CHUNK_SIZE=1024-128,
+		MAP_CHUNK_HEADER_SIZE=24, // message id and the four ints in front of the data, packed
+		// map chunks sent ahead stop when the resend buffer of the connection is this full
+		MAP_WINDOW_BUFFER=NET_CONN_BUFFERSIZE/2,
 	};
 
 	class CClient
@@ -125,16 +136,43 @@ public:
 
 		const IConsole::CCommandInfo *m_pRconCmdToSend;
 
+		// map download, the client asked for m_MapChunk last and everything below m_NextMapChunk is sent
+		int m_MapChunk;
+		int m_NextMapChunk;
+
 		void Reset();
 
 		char m_aLanguage[16];
 		NETADDR m_Addr;
 		bool m_CustClt;
+		bool m_InfoIsPlayer; // player flag the cached server info was built with
 	};
 
 	CClient m_aClients[MAX_CLIENTS];
 	int IdMap[MAX_CLIENTS * VANILLA_MAX_CLIENTS];
 
+	// per-client snapshot work, filled on the tick thread and encoded by the snap workers
+	class CSnapJob
+	{
+	public:
+		int m_ClientID;
+		int m_SnapshotSize;
+		int m_Crc;
+		int m_DeltaTick;
+		CSnapshot *m_pDeltashot; // acked snapshot the delta is made against, 0 for a full one
+		CSnapshotIndex *m_pDeltaIndex;
+		CSnapshotIndexBuffer m_ToIndex; // built by CreateDelta
+		int m_CompSize;
+		int64 m_DeltaTime; // encoding time for the profiler, may be measured on a worker
+		int64 m_CompressTime;
+		char m_aData[CSnapshot::MAX_SIZE];
+		char m_aCompData[CSnapshot::MAX_SIZE];
+	};
+
+	CSnapJob *m_pSnapJobs;
+	CJobPool m_SnapJobPool;
+	int m_NumSnapWorkers;
+
 	CSnapshotDelta m_SnapshotDelta;
 	CSnapshotBuilder m_SnapshotBuilder;
 	CSnapIDPool m_IDPool;
@@ -153,17 +191,95 @@ public:
 	int m_PrintCBIndex;
 
 	int64 m_Lastheartbeat;
+
+	NETWAIT *m_pNetWait;
+
+	// tick start lateness in microseconds, see dbg_tick_jitter
+	int m_aTickJitter[SERVER_TICK_SPEED*5];
+	int m_NumTickJitter;
+
+	// socket stats at the last dbg_net_stats report
+	NETSTATS m_LastNetStats;
+	int m_NetStatsTick;
 	//static NETADDR4 master_server;
 
 	char m_aCurrentMap[64];
 	unsigned m_CurrentMapCrc;
-	unsigned char *m_pCurrentMapData;
 	int m_CurrentMapSize;
 
+	// the map data message headers of a map, packed once, the chunk
+	// payloads are sent straight from the map's copy of the file
+	class CMapChunkTable
+	{
+		const unsigned char *m_pMap; // owned by the map, see IEngineMap::PreparedData
+		int m_MapSize;
+		unsigned char *m_pHeaders; // all headers back to back
+		int *m_pOffsets; // m_NumChunks+1 offsets into m_pHeaders
+		int m_NumChunks;
+	public:
+		CMapChunkTable() { m_pMap = 0; m_MapSize = 0; m_pHeaders = 0; m_pOffsets = 0; m_NumChunks = 0; }
+
+		void Build(const unsigned char *pMap, int MapSize, unsigned MapCrc);
+		void Free();
+
+		int NumChunks() const { return m_NumChunks; }
+		// pBuf has to hold MAP_CHUNK_HEADER_SIZE+MAP_CHUNK_SIZE bytes, returns the message size
+		int Message(int Chunk, unsigned char *pBuf) const;
+	};
+
+	CMapChunkTable m_MapChunks;
+	int64 m_MapChunksSent;
+	int64 m_MapBytesSent;
+
+	// next map, loaded on a worker while the game goes on
+	class CPreparedMap
+	{
+	public:
+		char m_aName[64];
+		bool m_Loaded;
+		bool m_Invalid; // failed the standard map check
+		unsigned m_Crc;
+		int m_Size;
+		CMapChunkTable m_Chunks;
+		int64 m_PrepareTime;
+	};
+
+	CPreparedMap m_PreparedMap;
+	CJobPool m_MapJobPool;
+	CJob m_MapJob;
+	CJobCounter m_MapJobCounter;
+	bool m_MapPreparing;
+
 	bool m_ServerInfoHighLoad;
 	int64 m_ServerInfoFirstRequest;
 	int m_ServerInfoNumRequests;
 
+	// packed server info responses, stored without the packet header and the token
+	class CServerInfoCache
+	{
+	public:
+		enum
+		{
+			MAX_CHUNKS=8,
+		};
+
+		class CChunk
+		{
+		public:
+			int m_DataSize;
+			unsigned char m_aData[NET_MAX_PAYLOAD];
+		};
+
+		bool m_Valid;
+		int m_NumChunks;
+		CChunk m_aChunks[MAX_CHUNKS];
+
+		void Clear() { m_Valid = false; m_NumChunks = 0; }
+		void AddChunk(const void *pData, int Size);
+	};
+
+	CServerInfoCache m_aServerInfoCache[(SERVERINFO_INGAME+1)*2];
+
 	CDemoRecorder m_DemoRecorder;
 	CRegister m_Register;
 	CMapChecker m_MapChecker;
@@ -202,6 +318,11 @@ public:
 	int SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System);
 
 	void DoSnapshot();
+	void InitSnapWorkers(int NumThreads);
+	void PrepareSnapshot(CSnapJob *pJob);
+	void EncodeSnapshot(CSnapJob *pJob);
+	void SendSnapshot(CSnapJob *pJob);
+	static void EncodeSnapshotRange(void *pUser, int Begin, int End);
 	
 	static int ClientRejoinCallback(int ClientID, void *pUser);
 	static int NewClientCallback(int ClientID, void *pUser);
@@ -209,11 +330,15 @@ public:
 	static int DelClientCallback(int ClientID, const char *pReason, void *pUser);
 
 	void SendMap(int ClientID);
+	int NumMapChunks() const { return m_MapChunks.NumChunks(); }
+	void SendMapData(int ClientID, int Chunk);
+	void FillMapWindow(int ClientID);
+	void UpdateMapDownloads();
 	void SendConnectionReady(int ClientID);
 	void SendRconLine(int ClientID, const char *pLine);
 	static void SendRconLineAuthed(const char *pLine, void *pUser);
 
-	void SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID);
+	int SendRconCmdAdd(const IConsole::CCommandInfo *pCommandInfo, int ClientID);
 	void SendRconCmdRem(const IConsole::CCommandInfo *pCommandInfo, int ClientID);
 	void UpdateClientRconCommands();
 
@@ -221,12 +346,23 @@ public:
 
 	void SendServerInfoConnless(const NETADDR *pAddr, int Token, int Type);
 	void SendServerInfo(const NETADDR *pAddr, int Token, int Type, bool SendClients);
+	void CacheServerInfo(CServerInfoCache *pCache, int Type, bool SendClients);
+	void ExpireServerInfo();
+	void CheckServerInfoPlayers();
 	void UpdateServerInfo();
 
+	void PerfDump();
+	void SendPerfReport();
+	void RecordTickJitter(int Lateness);
+	void ReportNetStats();
+
 	void PumpNetwork();
 
 	char *GetMapName();
 	int LoadMap(const char *pMapName);
+	bool PrepareMap();
+	static int PrepareMapThread(void *pUser);
+	void CommitMap();
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole);
 	int Run();
@@ -237,6 +373,9 @@ public:
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
+	static void ConPerfDump(IConsole::IResult *pResult, void *pUser);
+	static void ConSnapMemory(IConsole::IResult *pResult, void *pUser);
+	static void ConchainNetBatchingUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConLogout(IConsole::IResult *pResult, void *pUser);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainMaxclientsperipUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
@@ -1,9 +1,18 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <string.h>
+
 #include <base/system.h>
 
 #include "compression.h"
 
+#if defined(CONF_SSE2)
+	#include <emmintrin.h>
+#endif
+#if defined(CONF_AVX2)
+	#include <immintrin.h>
+#endif
+
 // Format: ESDDDDDD EDDDDDDD EDD... Extended, Data, Sign
 unsigned char *CVariableInt::Pack(unsigned char *pDst, int i)
 {
@@ -60,7 +69,7 @@ const unsigned char *CVariableInt::Unpack(const unsigned char *pSrc, int *pInOut
 }
 
 
-long CVariableInt::Decompress(const void *pSrc_, int Size, void *pDst_)
+static long DecompressScalar(const void *pSrc_, int Size, void *pDst_)
 {
 	const unsigned char *pSrc = (unsigned char *)pSrc_;
 	const unsigned char *pEnd = pSrc + Size;
@@ -73,7 +82,7 @@ long CVariableInt::Decompress(const void *pSrc_, int Size, void *pDst_)
 	return (long)((unsigned char *)pDst-(unsigned char *)pDst_);
 }
 
-long CVariableInt::Compress(const void *pSrc_, int Size, void *pDst_)
+static long CompressScalar(const void *pSrc_, int Size, void *pDst_)
 {
 	int *pSrc = (int *)pSrc_;
 	unsigned char *pDst = (unsigned char *)pDst_;
@@ -87,3 +96,239 @@ long CVariableInt::Compress(const void *pSrc_, int Size, void *pDst_)
 	return (long)(pDst-(unsigned char *)pDst_);
 }
 
+#if defined(CONF_SSE2)
+// the kernels use memcpy instead of mem_copy, so the small copies become single stores
+
+// packs four integers, in one go if all of them fit into a single byte
+static inline unsigned char *Pack4SSE2(unsigned char *pDst, const int *pSrc)
+{
+	__m128i Value = _mm_loadu_si128((const __m128i *)pSrc);
+	__m128i Sign = _mm_srai_epi32(Value, 31);
+	__m128i Magnitude = _mm_xor_si128(Value, Sign); // if(i<0) i = ~i
+	if(_mm_movemask_epi8(_mm_cmpgt_epi32(Magnitude, _mm_set1_epi32(0x3F))))
+	{
+		for(int i = 0; i < 4; i++)
+			pDst = CVariableInt::Pack(pDst, pSrc[i]);
+		return pDst;
+	}
+
+	__m128i Bytes = _mm_or_si128(Magnitude, _mm_and_si128(Sign, _mm_set1_epi32(0x40)));
+	Bytes = _mm_packs_epi32(Bytes, Bytes);
+	Bytes = _mm_packus_epi16(Bytes, Bytes);
+	int Packed = _mm_cvtsi128_si32(Bytes);
+	memcpy(pDst, &Packed, 4);
+	return pDst+4;
+}
+
+// turns the four single byte integers in the low bytes into ints
+static inline __m128i Expand4SSE2(__m128i Bytes)
+{
+	__m128i Zero = _mm_setzero_si128();
+	__m128i Ints = _mm_unpacklo_epi16(_mm_unpacklo_epi8(Bytes, Zero), Zero);
+	__m128i Sign = _mm_srai_epi32(_mm_slli_epi32(Ints, 25), 31);
+	return _mm_xor_si128(_mm_and_si128(Ints, _mm_set1_epi32(0x3F)), Sign);
+}
+
+static long CompressSSE2(const void *pSrc_, int Size, void *pDst_)
+{
+	const int *pSrc = (const int *)pSrc_;
+	unsigned char *pDst = (unsigned char *)pDst_;
+	int Num = Size/4;
+	int i = 0;
+	for(; i+4 <= Num; i += 4)
+		pDst = Pack4SSE2(pDst, pSrc+i);
+	for(; i < Num; i++)
+		pDst = CVariableInt::Pack(pDst, pSrc[i]);
+	return (long)(pDst-(unsigned char *)pDst_);
+}
+
+static long DecompressSSE2(const void *pSrc_, int Size, void *pDst_)
+{
+	const unsigned char *pSrc = (const unsigned char *)pSrc_;
+	const unsigned char *pEnd = pSrc + Size;
+	int *pDst = (int *)pDst_;
+	while(pEnd-pSrc >= 16)
+	{
+		__m128i Bytes = _mm_loadu_si128((const __m128i *)pSrc);
+		int Extended = _mm_movemask_epi8(Bytes);
+		if(Extended&0xF)
+		{
+			pSrc = CVariableInt::Unpack(pSrc, pDst);
+			pDst++;
+			continue;
+		}
+
+		// groups of four integers without extend bits
+		for(int Group = 0; Group < 4 && !(Extended&0xF); Group++)
+		{
+			_mm_storeu_si128((__m128i *)pDst, Expand4SSE2(Bytes));
+			pDst += 4;
+			pSrc += 4;
+			Bytes = _mm_srli_si128(Bytes, 4);
+			Extended >>= 4;
+		}
+	}
+	while(pSrc < pEnd)
+	{
+		pSrc = CVariableInt::Unpack(pSrc, pDst);
+		pDst++;
+	}
+	return (long)((unsigned char *)pDst-(unsigned char *)pDst_);
+}
+#endif
+
+#if defined(CONF_AVX2)
+CONF_TARGET_AVX2 static long CompressAVX2(const void *pSrc_, int Size, void *pDst_)
+{
+	const int *pSrc = (const int *)pSrc_;
+	unsigned char *pDst = (unsigned char *)pDst_;
+	int Num = Size/4;
+	int i = 0;
+	for(; i+8 <= Num; i += 8)
+	{
+		__m256i Value = _mm256_loadu_si256((const __m256i *)(pSrc+i));
+		__m256i Sign = _mm256_srai_epi32(Value, 31);
+		__m256i Magnitude = _mm256_xor_si256(Value, Sign);
+		if(_mm256_movemask_epi8(_mm256_cmpgt_epi32(Magnitude, _mm256_set1_epi32(0x3F))))
+		{
+			pDst = Pack4SSE2(pDst, pSrc+i);
+			pDst = Pack4SSE2(pDst, pSrc+i+4);
+			continue;
+		}
+
+		// packing works per 128 bit lane, the bytes end up in the low dword of each
+		__m256i Bytes = _mm256_or_si256(Magnitude, _mm256_and_si256(Sign, _mm256_set1_epi32(0x40)));
+		Bytes = _mm256_packs_epi32(Bytes, Bytes);
+		Bytes = _mm256_packus_epi16(Bytes, Bytes);
+		int aPacked[2] = {
+			_mm_cvtsi128_si32(_mm256_castsi256_si128(Bytes)),
+			_mm_cvtsi128_si32(_mm256_extracti128_si256(Bytes, 1))
+		};
+		memcpy(pDst, aPacked, 8);
+		pDst += 8;
+	}
+	_mm256_zeroupper();
+	for(; i+4 <= Num; i += 4)
+		pDst = Pack4SSE2(pDst, pSrc+i);
+	for(; i < Num; i++)
+		pDst = CVariableInt::Pack(pDst, pSrc[i]);
+	return (long)(pDst-(unsigned char *)pDst_);
+}
+
+CONF_TARGET_AVX2 static long DecompressAVX2(const void *pSrc_, int Size, void *pDst_)
+{
+	const unsigned char *pSrc = (const unsigned char *)pSrc_;
+	const unsigned char *pEnd = pSrc + Size;
+	int *pDst = (int *)pDst_;
+	while(pEnd-pSrc >= 8)
+	{
+		__m128i Bytes = _mm_loadl_epi64((const __m128i *)pSrc);
+		int Extended = _mm_movemask_epi8(Bytes)&0xFF;
+		if(!Extended)
+		{
+			// eight integers without extend bits
+			__m256i Ints = _mm256_cvtepu8_epi32(Bytes);
+			__m256i Sign = _mm256_srai_epi32(_mm256_slli_epi32(Ints, 25), 31);
+			_mm256_storeu_si256((__m256i *)pDst, _mm256_xor_si256(_mm256_and_si256(Ints, _mm256_set1_epi32(0x3F)), Sign));
+			pDst += 8;
+			pSrc += 8;
+		}
+		else if(!(Extended&0xF))
+		{
+			_mm_storeu_si128((__m128i *)pDst, Expand4SSE2(Bytes));
+			pDst += 4;
+			pSrc += 4;
+		}
+		else
+		{
+			pSrc = CVariableInt::Unpack(pSrc, pDst);
+			pDst++;
+		}
+	}
+	_mm256_zeroupper();
+	while(pSrc < pEnd)
+	{
+		pSrc = CVariableInt::Unpack(pSrc, pDst);
+		pDst++;
+	}
+	return (long)((unsigned char *)pDst-(unsigned char *)pDst_);
+}
+#endif
+
+typedef long (*CONVERTFUNC)(const void *pSrc, int Size, void *pDst);
+
+static const CONVERTFUNC s_apfnCompress[CVariableInt::NUM_KERNELS] = {
+	CompressScalar,
+#if defined(CONF_SSE2)
+	CompressSSE2,
+#else
+	0,
+#endif
+#if defined(CONF_AVX2)
+	CompressAVX2,
+#else
+	0,
+#endif
+};
+
+static const CONVERTFUNC s_apfnDecompress[CVariableInt::NUM_KERNELS] = {
+	DecompressScalar,
+#if defined(CONF_SSE2)
+	DecompressSSE2,
+#else
+	0,
+#endif
+#if defined(CONF_AVX2)
+	DecompressAVX2,
+#else
+	0,
+#endif
+};
+
+static const int s_Kernel = CVariableInt::BestKernel();
+
+bool CVariableInt::KernelSupported(int Kernel)
+{
+	static const int s_Features = cpu_features();
+	switch(Kernel)
+	{
+	case KERNEL_SCALAR: return true;
+	case KERNEL_SSE2: return s_apfnCompress[KERNEL_SSE2] && (s_Features&CPUFEATURE_SSE2);
+	case KERNEL_AVX2: return s_apfnCompress[KERNEL_AVX2] && (s_Features&CPUFEATURE_AVX2);
+	}
+	return false;
+}
+
+int CVariableInt::BestKernel()
+{
+	int Kernel = NUM_KERNELS-1;
+	while(!KernelSupported(Kernel))
+		Kernel--;
+	return Kernel;
+}
+
+const char *CVariableInt::KernelName(int Kernel)
+{
+	static const char *s_apNames[NUM_KERNELS] = {"scalar", "sse2", "avx2"};
+	return s_apNames[Kernel];
+}
+
+long CVariableInt::Compress(const void *pSrc, int Size, void *pDst)
+{
+	return s_apfnCompress[s_Kernel](pSrc, Size, pDst);
+}
+
+long CVariableInt::Decompress(const void *pSrc, int Size, void *pDst)
+{
+	return s_apfnDecompress[s_Kernel](pSrc, Size, pDst);
+}
+
+long CVariableInt::Compress(int Kernel, const void *pSrc, int Size, void *pDst)
+{
+	return s_apfnCompress[Kernel](pSrc, Size, pDst);
+}
+
+long CVariableInt::Decompress(int Kernel, const void *pSrc, int Size, void *pDst)
+{
+	return s_apfnDecompress[Kernel](pSrc, Size, pDst);
+}
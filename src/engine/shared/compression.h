@@ -6,9 +6,32 @@
 class CVariableInt
 {
 public:
+	enum
+	{
+		KERNEL_SCALAR=0,
+		KERNEL_SSE2,
+		KERNEL_AVX2,
+		NUM_KERNELS
+	};
+
 	static unsigned char *Pack(unsigned char *pDst, int i);
 	static const unsigned char *Unpack(const unsigned char *pSrc, int *pInOut);
+
+	// use the best kernel this machine supports
 	static long Compress(const void *pSrc, int Size, void *pDst);
 	static long Decompress(const void *pSrc, int Size, void *pDst);
+
+	/*
+		Function: Compress, Decompress
+			Same as above with the given kernel. All kernels produce
+			the same output, the vectorized ones handle runs of
+			integers that fit into a single byte at once.
+	*/
+	static long Compress(int Kernel, const void *pSrc, int Size, void *pDst);
+	static long Decompress(int Kernel, const void *pSrc, int Size, void *pDst);
+
+	static int BestKernel();
+	static bool KernelSupported(int Kernel);
+	static const char *KernelName(int Kernel);
 };
 #endif
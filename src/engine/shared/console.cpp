@@ -375,9 +375,23 @@ void CConsole::PossibleCommands(const char *pStr, int FlagMask, bool Temp, FPoss
 	}
 }
 
+unsigned CConsole::CommandHash(const char *pName)
+{
+	// case insensitive like the lookup
+	unsigned Hash = 5381;
+	for(; *pName; pName++)
+	{
+		unsigned char c = *pName;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = ((Hash << 5) + Hash) + c;
+	}
+	return Hash&(COMMAND_HASH_SIZE-1);
+}
+
 CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask)
 		{
@@ -686,6 +700,7 @@ CConsole::CConsole(int FlagMask)
 	m_paStrokeStr[1] = "1";
 	m_ExecutionQueue.Reset();
 	m_pFirstCommand = 0;
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
 	m_pFirstExec = 0;
 	mem_zero(m_aPrintCB, sizeof(m_aPrintCB));
 	m_NumPrintCB = 0;
@@ -749,10 +764,7 @@ void CConsole::AddCommandSorted(CCommand *pCommand)
 {
 	if(!m_pFirstCommand || str_comp(pCommand->m_pName, m_pFirstCommand->m_pName) <= 0)
 	{
-		if(m_pFirstCommand && m_pFirstCommand->m_pNext)
-			pCommand->m_pNext = m_pFirstCommand;
-		else
-			pCommand->m_pNext = 0;
+		pCommand->m_pNext = m_pFirstCommand;
 		m_pFirstCommand = pCommand;
 	}
 	else
@@ -767,6 +779,25 @@ void CConsole::AddCommandSorted(CCommand *pCommand)
 			}
 		}
 	}
+
+	// the same place within the bucket, so lookups find the same command first
+	CCommand **ppSlot = &m_apCommandHash[CommandHash(pCommand->m_pName)];
+	while(*ppSlot && str_comp(pCommand->m_pName, (*ppSlot)->m_pName) > 0)
+		ppSlot = &(*ppSlot)->m_pNextHash;
+	pCommand->m_pNextHash = *ppSlot;
+	*ppSlot = pCommand;
+}
+
+void CConsole::RemoveCommandHash(CCommand *pCommand)
+{
+	for(CCommand **ppSlot = &m_apCommandHash[CommandHash(pCommand->m_pName)]; *ppSlot; ppSlot = &(*ppSlot)->m_pNextHash)
+	{
+		if(*ppSlot == pCommand)
+		{
+			*ppSlot = pCommand->m_pNextHash;
+			return;
+		}
+	}
 }
 
 void CConsole::Register(const char *pName, const char *pParams,
@@ -857,6 +888,7 @@ void CConsole::DeregisterTemp(const char *pName)
 	// add to recycle list
 	if(pRemoved)
 	{
+		RemoveCommandHash(pRemoved);
 		pRemoved->m_pNext = m_pRecycleList;
 		m_pRecycleList = pRemoved;
 	}
@@ -878,6 +910,17 @@ void CConsole::DeregisterTempAll()
 		}
 	}
 
+	for(int i = 0; i < COMMAND_HASH_SIZE; i++)
+	{
+		for(CCommand **ppSlot = &m_apCommandHash[i]; *ppSlot;)
+		{
+			if((*ppSlot)->m_Temp)
+				*ppSlot = (*ppSlot)->m_pNextHash;
+			else
+				ppSlot = &(*ppSlot)->m_pNextHash;
+		}
+	}
+
 	m_TempCommands.Reset();
 	m_pRecycleList = 0;
 }
@@ -927,7 +970,7 @@ void CConsole::StoreCommands(bool Store)
 
 const IConsole::CCommandInfo *CConsole::GetCommandInfo(const char *pName, int FlagMask, bool Temp)
 {
-	for(CCommand *pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(CCommand *pCommand = m_apCommandHash[CommandHash(pName)]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask && pCommand->m_Temp == Temp)
 		{
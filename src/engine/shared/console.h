@@ -12,6 +12,7 @@ class CConsole : public IConsole
 	{
 	public:
 		CCommand *m_pNext;
+		CCommand *m_pNextHash;
 		int m_Flags;
 		bool m_Temp;
 		FCommandCallback m_pfnCallback;
@@ -32,11 +33,20 @@ class CConsole : public IConsole
 		void *m_pUserData;
 	};
 
+	enum
+	{
+		COMMAND_HASH_SIZE=512, // power of two
+	};
+
 	int m_FlagMask;
 	int m_ClientID;
 	bool m_StoreCommands;
 	const char *m_paStrokeStr[2];
 	CCommand *m_pFirstCommand;
+
+	// same commands as the list, a bucket keeps the order of the list
+	CCommand *m_apCommandHash[COMMAND_HASH_SIZE];
+
 	class CExecFile
 	{
 	public:
@@ -151,7 +161,9 @@ class CConsole : public IConsole
 		}
 	} m_ExecutionQueue;
 
+	static unsigned CommandHash(const char *pName);
 	void AddCommandSorted(CCommand *pCommand);
+	void RemoveCommandHash(CCommand *pCommand);
 	CCommand *FindCommand(const char *pName, int FlagMask);
 
 public:
@@ -57,7 +57,9 @@ struct CDatafileInfo
 
 struct CDatafile
 {
-	IOHANDLE m_File;
+	IOHANDLE m_File; // 0 when the whole file is in m_pImage
+	unsigned char *m_pImage;
+	unsigned m_ImageSize;
 	unsigned m_Crc;
 	CDatafileInfo m_Info;
 	CDatafileHeader m_Header;
@@ -66,7 +68,7 @@ struct CDatafile
 	char *m_pData;
 };
 
-bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool InMemory)
 {
 	dbg_msg("datafile", "loading. filename='%s'", pFilename);
 
@@ -77,9 +79,32 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		return false;
 	}
 
+	// keep a copy of the whole file, not a mapping, so that the file
+	// can be rewritten on disk while it is in use
+	unsigned char *pImage = 0;
+	unsigned ImageSize = 0;
+	if(InMemory)
+	{
+		ImageSize = (unsigned)io_length(File);
+		pImage = (unsigned char *)mem_alloc(max(ImageSize, 1u), 1);
+		if(io_read(File, pImage, ImageSize) != ImageSize)
+		{
+			dbg_msg("datafile", "couldn't read '%s'", pFilename);
+			mem_free(pImage);
+			io_close(File);
+			return false;
+		}
+
+		// no more reads from the file
+		io_close(File);
+		File = 0;
+	}
 
 	// take the CRC of the file and store it
 	unsigned Crc = 0;
+	if(pImage)
+		Crc = crc32(Crc, pImage, ImageSize); // ignore_convention
+	else
 	{
 		enum
 		{
@@ -99,15 +124,20 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		io_seek(File, 0, IOSEEK_START);
 	}
 
-
 	// TODO: change this header
 	CDatafileHeader Header;
-	io_read(File, &Header, sizeof(Header));
+	mem_zero(&Header, sizeof(Header));
+	if(pImage)
+		mem_copy(&Header, pImage, min((unsigned)sizeof(Header), ImageSize));
+	else
+		io_read(File, &Header, sizeof(Header));
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
 	{
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+			if(pImage)
+				mem_free(pImage);
 			return 0;
 		}
 	}
@@ -118,6 +148,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	if(Header.m_Version != 3 && Header.m_Version != 4)
 	{
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		if(pImage)
+			mem_free(pImage);
 		return 0;
 	}
 
@@ -139,16 +171,28 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	pTmpDataFile->m_ppDataPtrs = (char**)(pTmpDataFile+1);
 	pTmpDataFile->m_pData = (char *)(pTmpDataFile+1)+Header.m_NumRawData*sizeof(char *);
 	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_pImage = pImage;
+	pTmpDataFile->m_ImageSize = ImageSize;
 	pTmpDataFile->m_Crc = Crc;
 
 	// clear the data pointers
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData*sizeof(void*));
 
 	// read types, offsets, sizes and item data
-	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
+	unsigned ReadSize;
+	if(pImage)
+	{
+		ReadSize = ImageSize > sizeof(CDatafileHeader) ? min(Size, (unsigned)(ImageSize-sizeof(CDatafileHeader))) : 0;
+		mem_copy(pTmpDataFile->m_pData, pImage+sizeof(CDatafileHeader), ReadSize);
+	}
+	else
+		ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
 	if(ReadSize != Size)
 	{
-		io_close(pTmpDataFile->m_File);
+		if(pImage)
+			mem_free(pImage);
+		else
+			io_close(pTmpDataFile->m_File);
 		mem_free(pTmpDataFile);
 		pTmpDataFile = 0;
 		dbg_msg("datafile", "couldn't load the whole thing, wanted=%d got=%d", Size, ReadSize);
@@ -277,10 +321,23 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 		int SwapSize = DataSize;
 #endif
 
+		// with the file in memory the data is taken straight from there
+		const unsigned char *pImageData = 0;
+		if(m_pDataFile->m_pImage)
+		{
+			unsigned Offset = m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index];
+			if(DataSize < 0 || Offset > m_pDataFile->m_ImageSize || (unsigned)DataSize > m_pDataFile->m_ImageSize-Offset)
+			{
+				dbg_msg("datafile", "data out of bounds. index=%d", Index);
+				return 0;
+			}
+			pImageData = m_pDataFile->m_pImage+Offset;
+		}
+
 		if(m_pDataFile->m_Header.m_Version == 4)
 		{
 			// v4 has compressed data
-			void *pTemp = (char *)mem_alloc(DataSize, 1);
+			void *pTemp = 0;
 			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
 			unsigned long s;
 
@@ -288,12 +345,17 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
 
 			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
+			if(!pImageData)
+			{
+				pTemp = mem_alloc(DataSize, 1);
+				io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
+				io_read(m_pDataFile->m_File, pTemp, DataSize);
+				pImageData = (const unsigned char *)pTemp;
+			}
 
 			// decompress the data, TODO: check for errors
 			s = UncompressedSize;
-			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pTemp, DataSize); // ignore_convention
+			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (const Bytef*)pImageData, DataSize); // ignore_convention
 #if defined(CONF_ARCH_ENDIAN_BIG)
 			SwapSize = s;
 #endif
@@ -306,8 +368,13 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 			// load the data
 			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
 			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(DataSize, 1);
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
+			if(pImageData)
+				mem_copy(m_pDataFile->m_ppDataPtrs[Index], pImageData, DataSize);
+			else
+			{
+				io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
+				io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
+			}
 		}
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
@@ -410,7 +477,10 @@ bool CDataFileReader::Close()
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
 		mem_free(m_pDataFile->m_ppDataPtrs[i]);
 
-	io_close(m_pDataFile->m_File);
+	if(m_pDataFile->m_pImage)
+		mem_free(m_pDataFile->m_pImage);
+	else
+		io_close(m_pDataFile->m_File);
 	mem_free(m_pDataFile);
 	m_pDataFile = 0;
 	return true;
@@ -422,6 +492,16 @@ unsigned CDataFileReader::Crc()
 	return m_pDataFile->m_Crc;
 }
 
+const unsigned char *CDataFileReader::FileData()
+{
+	return m_pDataFile ? m_pDataFile->m_pImage : 0;
+}
+
+unsigned CDataFileReader::FileSize()
+{
+	return m_pDataFile ? m_pDataFile->m_ImageSize : 0;
+}
+
 
 CDataFileWriter::CDataFileWriter()
 {
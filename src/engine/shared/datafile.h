@@ -13,8 +13,16 @@ public:
 	~CDataFileReader() { Close(); }
 
 	bool IsOpen() const { return m_pDataFile != 0; }
+	void Swap(CDataFileReader *pOther) { struct CDatafile *pTemp = m_pDataFile; m_pDataFile = pOther->m_pDataFile; pOther->m_pDataFile = pTemp; }
 
-	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
+	/*
+		Function: Open
+			Opens a datafile. With InMemory the whole file is read in
+			one go and the handle is closed, the data items are then
+			decompressed from that copy on demand and the raw file is
+			available through FileData.
+	*/
+	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType, bool InMemory = false);
 	bool Close();
 
 	static bool GetCrcSize(class IStorage *pStorage, const char *pFilename, int StorageType, unsigned *pCrc, unsigned *pSize);
@@ -32,6 +40,10 @@ public:
 	void Unload();
 
 	unsigned Crc();
+
+	// the raw file, only when opened in memory
+	const unsigned char *FileData();
+	unsigned FileSize();
 };
 
 // write access
@@ -22,8 +22,28 @@ static const int gs_NumMarkersOffset = 176;
 CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_File = 0;
+	m_MapFile = 0;
 	m_LastTickMarker = -1;
 	m_pSnapshotDelta = pSnapshotDelta;
+	m_OutputSize = 0;
+	m_LastIndex = 0;
+
+	m_Threaded = true;
+	m_pThread = 0;
+	m_QueueLock = lock_create();
+	m_DataCond = condvar_create();
+	m_SpaceCond = condvar_create();
+	m_pQueue = 0;
+	m_NumStalls = 0;
+}
+
+CDemoRecorder::~CDemoRecorder()
+{
+	if(m_File)
+		Stop();
+	condvar_destroy(m_SpaceCond);
+	condvar_destroy(m_DataCond);
+	lock_destroy(m_QueueLock);
 }
 
 // Record
@@ -95,26 +115,38 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	io_write(DemoFile, &Header, sizeof(Header));
 	io_write(DemoFile, &TimelineMarkers, sizeof(TimelineMarkers)); // fill this on stop
 
-	// write map data
-	while(1)
-	{
-		unsigned char aChunk[1024*64];
-		int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
-		if(Bytes <= 0)
-			break;
-		io_write(DemoFile, &aChunk, Bytes);
-	}
-	io_close(MapFile);
-
+	m_File = DemoFile;
+	m_MapFile = MapFile;
+	m_OutputSize = 0;
 	m_LastKeyFrame = -1;
 	m_LastTickMarker = -1;
+	m_EncodedTickMarker = -1;
 	m_FirstTick = -1;
 	m_NumTimelineMarkers = 0;
+	m_NumStalls = 0;
+
+	// the map data is copied by the writer thread as well
+	m_pThread = 0;
+	if(m_Threaded)
+	{
+		m_pQueue = (char *)mem_alloc(QUEUE_SIZE, 4);
+		m_ReadPos = 0;
+		m_WritePos = 0;
+		m_QueueUsed = 0;
+		m_StopWriter = false;
+		m_pThread = thread_init(WriterThread, this);
+		if(!m_pThread)
+		{
+			mem_free(m_pQueue);
+			m_pQueue = 0;
+		}
+	}
+	if(!m_pThread)
+		WriteMap();
 
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "Recording to '%s'", pFilename);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
-	m_File = DemoFile;
 
 	return 0;
 }
@@ -147,9 +179,114 @@ enum
 	CHUNKFLAG_BIGSIZE = 0x10
 };
 
+void CDemoRecorder::WriterThread(void *pUser)
+{
+	CDemoRecorder *pSelf = (CDemoRecorder *)pUser;
+	pSelf->WriteMap();
+
+	lock_wait(pSelf->m_QueueLock);
+	while(1)
+	{
+		while(!pSelf->m_QueueUsed && !pSelf->m_StopWriter)
+			condvar_wait(pSelf->m_DataCond, pSelf->m_QueueLock);
+		if(!pSelf->m_QueueUsed)
+			break;
+
+		// skip the end of the queue if the record didn't fit there
+		if(QUEUE_SIZE-pSelf->m_ReadPos < (int)sizeof(CRecord) || ((CRecord *)(pSelf->m_pQueue+pSelf->m_ReadPos))->m_Type == RECORD_WRAP)
+		{
+			pSelf->m_QueueUsed -= QUEUE_SIZE-pSelf->m_ReadPos;
+			pSelf->m_ReadPos = 0;
+		}
+		CRecord *pRecord = (CRecord *)(pSelf->m_pQueue+pSelf->m_ReadPos);
+		int RecordSize = sizeof(CRecord)+((pRecord->m_Size+3)&~3);
+		lock_unlock(pSelf->m_QueueLock);
+
+		if(pRecord->m_Type == RECORD_MESSAGE)
+			pSelf->Write(CHUNKTYPE_MESSAGE, pRecord+1, pRecord->m_Size);
+		else
+			pSelf->EncodeSnapshot(pRecord->m_Tick, pRecord->m_Type == RECORD_KEYFRAME, pRecord+1, pRecord->m_Size);
+
+		lock_wait(pSelf->m_QueueLock);
+		pSelf->m_ReadPos = (pSelf->m_ReadPos+RecordSize)%QUEUE_SIZE;
+		pSelf->m_QueueUsed -= RecordSize;
+		condvar_signal(pSelf->m_SpaceCond);
+	}
+	lock_unlock(pSelf->m_QueueLock);
+}
+
+void CDemoRecorder::Queue(int Type, int Tick, const void *pData, int Size)
+{
+	int RecordSize = sizeof(CRecord)+((Size+3)&~3);
+
+	lock_wait(m_QueueLock);
+
+	// records are never split, the end of the queue is skipped if one doesn't fit there
+	int Skip = m_WritePos+RecordSize > QUEUE_SIZE ? QUEUE_SIZE-m_WritePos : 0;
+	if(m_QueueUsed+Skip+RecordSize > QUEUE_SIZE)
+	{
+		m_NumStalls++;
+		while(m_QueueUsed+Skip+RecordSize > QUEUE_SIZE)
+			condvar_wait(m_SpaceCond, m_QueueLock);
+	}
+	if(Skip)
+	{
+		if(Skip >= (int)sizeof(CRecord))
+			((CRecord *)(m_pQueue+m_WritePos))->m_Type = RECORD_WRAP;
+		m_QueueUsed += Skip;
+		m_WritePos = 0;
+	}
+
+	CRecord *pRecord = (CRecord *)(m_pQueue+m_WritePos);
+	pRecord->m_Type = Type;
+	pRecord->m_Tick = Tick;
+	pRecord->m_Size = Size;
+	mem_copy(pRecord+1, pData, Size);
+	m_WritePos = (m_WritePos+RecordSize)%QUEUE_SIZE;
+	m_QueueUsed += RecordSize;
+
+	// the messages of a tick are picked up together with the next snapshot
+	if(Type != RECORD_MESSAGE || m_QueueUsed > QUEUE_SIZE/2)
+		condvar_signal(m_DataCond);
+	lock_unlock(m_QueueLock);
+}
+
+void CDemoRecorder::WriteMap()
+{
+	while(1)
+	{
+		int Bytes = io_read(m_MapFile, m_aOutput, sizeof(m_aOutput));
+		if(Bytes <= 0)
+			break;
+		io_write(m_File, m_aOutput, Bytes);
+	}
+	io_close(m_MapFile);
+	m_MapFile = 0;
+}
+
+void CDemoRecorder::WriteOutput(const void *pData, int Size)
+{
+	if(m_OutputSize+Size > OUTPUT_SIZE)
+		FlushOutput();
+	if(Size > OUTPUT_SIZE)
+	{
+		io_write(m_File, pData, Size);
+		return;
+	}
+	mem_copy(m_aOutput+m_OutputSize, pData, Size);
+	m_OutputSize += Size;
+}
+
+void CDemoRecorder::FlushOutput()
+{
+	if(m_OutputSize)
+		io_write(m_File, m_aOutput, m_OutputSize);
+	m_OutputSize = 0;
+}
+
 void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 {
-	if(m_LastTickMarker == -1 || Tick-m_LastTickMarker > 63 || Keyframe)
+	if(m_EncodedTickMarker == -1 || Tick-m_EncodedTickMarker > 63 || Keyframe)
 	{
 		unsigned char aChunk[5];
 		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER;
@@ -161,43 +298,36 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 		if(Keyframe)
 			aChunk[0] |= CHUNKTICKFLAG_KEYFRAME;
 
-		io_write(m_File, aChunk, sizeof(aChunk));
+		WriteOutput(aChunk, sizeof(aChunk));
 	}
 	else
 	{
 		unsigned char aChunk[1];
-		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_LastTickMarker);
-		io_write(m_File, aChunk, sizeof(aChunk));
+		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_EncodedTickMarker);
+		WriteOutput(aChunk, sizeof(aChunk));
 	}
 
-	m_LastTickMarker = Tick;
-	if(m_FirstTick < 0)
-		m_FirstTick = Tick;
+	m_EncodedTickMarker = Tick;
 }
 
 void CDemoRecorder::Write(int Type, const void *pData, int Size)
 {
-	char aBuffer[64*1024];
-	char aBuffer2[64*1024];
 	unsigned char aChunk[3];
 
-	if(!m_File)
-		return;
-
 	/* pad the data with 0 so we get an alignment of 4,
 	else the compression won't work and miss some bytes */
-	mem_copy(aBuffer2, pData, Size);
+	mem_copy(m_aPackBuffer, pData, Size);
 	while(Size&3)
-		aBuffer2[Size++] = 0;
-	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer); // buffer2 -> buffer
-	Size = CNetBase::Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
+		m_aPackBuffer[Size++] = 0;
+	Size = CVariableInt::Compress(m_aPackBuffer, Size, m_aCompressBuffer); // pack -> compress
+	Size = CNetBase::Compress(m_aCompressBuffer, Size, m_aPackBuffer, sizeof(m_aPackBuffer)); // compress -> pack
 
 
 	aChunk[0] = ((Type&0x3)<<5);
 	if(Size < 30)
 	{
 		aChunk[0] |= Size;
-		io_write(m_File, aChunk, 1);
+		WriteOutput(aChunk, 1);
 	}
 	else
 	{
@@ -205,23 +335,23 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 		{
 			aChunk[0] |= 30;
 			aChunk[1] = Size&0xff;
-			io_write(m_File, aChunk, 2);
+			WriteOutput(aChunk, 2);
 		}
 		else
 		{
 			aChunk[0] |= 31;
 			aChunk[1] = Size&0xff;
 			aChunk[2] = Size>>8;
-			io_write(m_File, aChunk, 3);
+			WriteOutput(aChunk, 3);
 		}
 	}
 
-	io_write(m_File, aBuffer2, Size);
+	WriteOutput(m_aPackBuffer, Size);
 }
 
-void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+void CDemoRecorder::EncodeSnapshot(int Tick, int Keyframe, const void *pData, int Size)
 {
-	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
+	if(Keyframe)
 	{
 		// write full tickmarker
 		WriteTickMarker(Tick, 1);
@@ -229,31 +359,56 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 		// write snapshot
 		Write(CHUNKTYPE_SNAPSHOT, pData, Size);
 
-		m_LastKeyFrame = Tick;
 		mem_copy(m_aLastSnapshotData, pData, Size);
+		m_aIndices[m_LastIndex].Index()->Build((CSnapshot*)m_aLastSnapshotData);
 	}
 	else
 	{
 		// create delta, prepend tick
-		char aDeltaData[CSnapshot::MAX_SIZE+sizeof(int)];
 		int DeltaSize;
 
 		// write tickmarker
 		WriteTickMarker(Tick, 0);
 
-		DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aDeltaData);
+		DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, m_aDeltaData,
+			m_aIndices[m_LastIndex].Index(), &m_aIndices[m_LastIndex^1]);
 		if(DeltaSize)
 		{
-			// record delta
-			Write(CHUNKTYPE_DELTA, aDeltaData, DeltaSize);
+			// record delta, the index of the new snapshot fits the copy
+			Write(CHUNKTYPE_DELTA, m_aDeltaData, DeltaSize);
 			mem_copy(m_aLastSnapshotData, pData, Size);
+			m_LastIndex ^= 1;
 		}
 	}
 }
 
+void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+{
+	if(!m_File)
+		return;
+
+	int Keyframe = m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5;
+	if(Keyframe)
+		m_LastKeyFrame = Tick;
+	m_LastTickMarker = Tick;
+	if(m_FirstTick < 0)
+		m_FirstTick = Tick;
+
+	if(m_pThread)
+		Queue(Keyframe ? RECORD_KEYFRAME : RECORD_SNAPSHOT, Tick, pData, Size);
+	else
+		EncodeSnapshot(Tick, Keyframe, pData, Size);
+}
+
 void CDemoRecorder::RecordMessage(const void *pData, int Size)
 {
-	Write(CHUNKTYPE_MESSAGE, pData, Size);
+	if(!m_File)
+		return;
+
+	if(m_pThread)
+		Queue(RECORD_MESSAGE, 0, pData, Size);
+	else
+		Write(CHUNKTYPE_MESSAGE, pData, Size);
 }
 
 int CDemoRecorder::Stop()
@@ -261,6 +416,20 @@ int CDemoRecorder::Stop()
 	if(!m_File)
 		return -1;
 
+	// let the writer thread finish the queue
+	if(m_pThread)
+	{
+		lock_wait(m_QueueLock);
+		m_StopWriter = true;
+		condvar_signal(m_DataCond);
+		lock_unlock(m_QueueLock);
+		thread_wait(m_pThread);
+		m_pThread = 0;
+		mem_free(m_pQueue);
+		m_pQueue = 0;
+	}
+	FlushOutput();
+
 	// add the demo length to the header
 	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
 	int DemoLength = Length();
@@ -8,22 +8,78 @@
 
 #include "snapshot.h"
 
+/*
+	Class: CDemoRecorder
+		Records snapshots and messages to a demo file. By default the
+		recorder only copies them into a queue, a writer thread makes
+		the deltas, compresses them and writes the file in large blocks.
+*/
 class CDemoRecorder : public IDemoRecorder
 {
+	enum
+	{
+		QUEUE_SIZE=2*1024*1024,
+		OUTPUT_SIZE=64*1024,
+
+		RECORD_SNAPSHOT=0,
+		RECORD_KEYFRAME,
+		RECORD_MESSAGE,
+		RECORD_WRAP,
+	};
+
+	struct CRecord
+	{
+		int m_Type;
+		int m_Tick;
+		int m_Size;
+	};
+
 	class IConsole *m_pConsole;
 	IOHANDLE m_File;
 	int m_LastTickMarker;
-	int m_LastKeyFrame;
 	int m_FirstTick;
-	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
-	class CSnapshotDelta *m_pSnapshotDelta;
+	int m_LastKeyFrame;
 	int m_NumTimelineMarkers;
 	int m_aTimelineMarkers[MAX_TIMELINE_MARKERS];
 
+	// encoder state, owned by the writer thread while it runs
+	IOHANDLE m_MapFile;
+	int m_EncodedTickMarker;
+	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
+	CSnapshotIndexBuffer m_aIndices[2]; // of the last snapshot and of the one that is encoded
+	int m_LastIndex;
+	char m_aDeltaData[CSnapshot::MAX_SIZE+sizeof(int)];
+	char m_aPackBuffer[CSnapshot::MAX_SIZE*2];
+	char m_aCompressBuffer[CSnapshot::MAX_SIZE*2];
+	unsigned char m_aOutput[OUTPUT_SIZE];
+	int m_OutputSize;
+	class CSnapshotDelta *m_pSnapshotDelta;
+
+	// queue between the recording thread and the writer thread
+	bool m_Threaded;
+	void *m_pThread;
+	LOCK m_QueueLock;
+	CONDVAR m_DataCond;
+	CONDVAR m_SpaceCond;
+	char *m_pQueue;
+	int m_ReadPos;
+	int m_WritePos;
+	int m_QueueUsed;
+	bool m_StopWriter;
+	int m_NumStalls;
+
+	static void WriterThread(void *pUser);
+	void Queue(int Type, int Tick, const void *pData, int Size);
+
+	void WriteMap();
+	void WriteOutput(const void *pData, int Size);
+	void FlushOutput();
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
+	void EncodeSnapshot(int Tick, int Keyframe, const void *pData, int Size);
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
+	~CDemoRecorder();
 
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, unsigned MapCrc, const char *pType);
 	int Stop();
@@ -35,6 +91,20 @@ public:
 	bool IsRecording() const { return m_File != 0; }
 
 	int Length() const { return (m_LastTickMarker - m_FirstTick)/SERVER_TICK_SPEED; }
+
+	/*
+		Function: SetThreaded
+			Selects whether the next recording encodes on the writer
+			thread or on the calling one.
+	*/
+	void SetThreaded(bool Threaded) { if(!m_File) m_Threaded = Threaded; }
+
+	/*
+		Function: NumStalls
+			Returns how often the current recording had to wait for the
+			writer thread because the queue was full.
+	*/
+	int NumStalls() const { return m_NumStalls; }
 };
 
 class CDemoPlayer : public IDemoPlayer
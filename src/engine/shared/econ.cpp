@@ -160,6 +160,12 @@ void CEcon::Update()
 	}
 }
 
+void CEcon::SetWait(NETWAIT *pWait)
+{
+	if(m_Ready)
+		m_NetConsole.SetWait(pWait);
+}
+
 void CEcon::Send(int ClientID, const char *pLine)
 {
 	if(!m_Ready)
@@ -46,6 +46,7 @@ public:
 
 	void Init(IConsole *pConsole, class CNetBan *pNetBan);
 	void Update();
+	void SetWait(NETWAIT *pWait);
 	void Send(int ClientID, const char *pLine);
 	void Shutdown();
 };
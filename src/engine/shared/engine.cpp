@@ -98,6 +98,9 @@ public:
 		// open logfile if needed
 		if(g_Config.m_Logfile[0])
 			dbg_logger_file(g_Config.m_Logfile);
+
+		if(g_Config.m_LogAsync)
+			dbg_logger_async();
 	}
 
 	void HostLookup(CHostLookup *pLookup, const char *pHostname, int Nettype)
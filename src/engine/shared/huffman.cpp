@@ -1,5 +1,8 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <string.h>
+
+#include <base/math.h>
 #include <base/system.h>
 #include "huffman.h"
 
@@ -129,154 +132,254 @@ void CHuffman::Init(const unsigned *pFrequencies)
 			m_apDecodeLut[i] = pNode;
 	}
 
+	// flat encode tables
+	for(i = 0; i < HUFFMAN_MAX_SYMBOLS; i++)
+	{
+		dbg_assert(m_aNodes[i].m_NumBits <= 24, "huffman code too long");
+		m_aEncodeBits[i] = m_aNodes[i].m_Bits;
+		m_aEncodeNumBits[i] = m_aNodes[i].m_NumBits;
+	}
+
+	BuildDecodeTable();
 }
 
-//***************************************************************
-int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+void CHuffman::BuildDecodeTable()
 {
-	// this macro loads a symbol for a byte into bits and bitcount
-#define HUFFMAN_MACRO_LOADSYMBOL(Sym) \
-	Bits |= m_aNodes[Sym].m_Bits << Bitcount; \
-	Bitcount += m_aNodes[Sym].m_NumBits;
-
-	// this macro writes the symbol stored in bits and bitcount to the dst pointer
-#define HUFFMAN_MACRO_WRITE() \
-	while(Bitcount >= 8) \
-	{ \
-		*pDst++ = (unsigned char)(Bits&0xff); \
-		if(pDst == pDstEnd) \
-			return -1; \
-		Bits >>= 8; \
-		Bitcount -= 8; \
+	for(int i = 0; i < HUFFMAN_DECODE_SIZE; i++)
+	{
+		CDecodeEntry *pEntry = &m_aDecodeTable[i];
+		mem_zero(pEntry, sizeof(*pEntry));
+
+		// take complete symbols until the bits run out
+		unsigned Bits = i;
+		int BitsLeft = HUFFMAN_DECODE_BITS;
+		while(pEntry->m_NumSymbols < HUFFMAN_DECODE_SYMBOLS && !pEntry->m_Eof)
+		{
+			CNode *pNode = m_pStartNode;
+			int NumBits = 0;
+			while(!pNode->m_NumBits && NumBits < BitsLeft)
+			{
+				pNode = &m_aNodes[pNode->m_aLeafs[(Bits>>NumBits)&1]];
+				NumBits++;
+			}
+			if(!pNode->m_NumBits)
+				break;
+
+			if(pNode == &m_aNodes[HUFFMAN_EOF_SYMBOL])
+				pEntry->m_Eof = 1;
+			else
+				pEntry->m_aSymbols[pEntry->m_NumSymbols++] = pNode->m_Symbol;
+			pEntry->m_NumBits += NumBits;
+			Bits >>= NumBits;
+			BitsLeft -= NumBits;
+		}
 	}
+}
 
-	// setup buffer pointers
+typedef unsigned long long BITBUFFER;
+
+// memcpy instead of mem_copy, so the compiler turns these into single loads and stores
+static inline BITBUFFER LoadBits(const unsigned char *pSrc)
+{
+#if defined(CONF_ARCH_ENDIAN_LITTLE)
+	BITBUFFER Bits;
+	memcpy(&Bits, pSrc, sizeof(Bits));
+	return Bits;
+#else
+	BITBUFFER Bits = 0;
+	for(int i = 7; i >= 0; i--)
+		Bits = (Bits<<8)|pSrc[i];
+	return Bits;
+#endif
+}
+
+static inline void StoreBits(unsigned char *pDst, BITBUFFER Bits)
+{
+#if defined(CONF_ARCH_ENDIAN_LITTLE)
+	memcpy(pDst, &Bits, sizeof(Bits));
+#else
+	for(int i = 0; i < 8; i++, Bits >>= 8)
+		pDst[i] = (unsigned char)Bits;
+#endif
+}
+
+//***************************************************************
+int CHuffman::Compress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
+{
 	const unsigned char *pSrc = (const unsigned char *)pInput;
 	const unsigned char *pSrcEnd = pSrc + InputSize;
 	unsigned char *pDst = (unsigned char *)pOutput;
 	unsigned char *pDstEnd = pDst + OutputSize;
 
-	// symbol variables
-	unsigned Bits = 0;
+	// codes are at most 24 bits, so the buffer never holds more than 55
+	BITBUFFER Bits = 0;
 	unsigned Bitcount = 0;
 
-	// make sure that we have data that we want to compress
-	if(InputSize)
+	while(pSrc != pSrcEnd)
 	{
-		// {A} load the first symbol
 		int Symbol = *pSrc++;
+		Bits |= (BITBUFFER)m_aEncodeBits[Symbol] << Bitcount;
+		Bitcount += m_aEncodeNumBits[Symbol];
+		if(Bitcount < 32)
+			continue;
 
-		while(pSrc != pSrcEnd)
+		if(pDstEnd-pDst > 8)
 		{
-			// {B} load the symbol
-			HUFFMAN_MACRO_LOADSYMBOL(Symbol)
-
-			// {C} fetch next symbol, this is done here because it will reduce dependency in the code
-			Symbol = *pSrc++;
-
-			// {B} write the symbol loaded at
-			HUFFMAN_MACRO_WRITE()
+			// write 64 bits, keep the incomplete byte
+			StoreBits(pDst, Bits);
+			pDst += Bitcount>>3;
+			Bits >>= Bitcount&~7;
+			Bitcount &= 7;
+		}
+		else
+		{
+			// same as the reference: fail as soon as the output is full
+			while(Bitcount >= 8)
+			{
+				*pDst++ = (unsigned char)(Bits&0xff);
+				if(pDst == pDstEnd)
+					return -1;
+				Bits >>= 8;
+				Bitcount -= 8;
+			}
 		}
-
-		// write the last symbol loaded from {C} or {A} in the case of only 1 byte input buffer
-		HUFFMAN_MACRO_LOADSYMBOL(Symbol)
-		HUFFMAN_MACRO_WRITE()
 	}
 
-	// write EOF symbol
-	HUFFMAN_MACRO_LOADSYMBOL(HUFFMAN_EOF_SYMBOL)
-	HUFFMAN_MACRO_WRITE()
-
-	// write out the last bits
-	*pDst++ = Bits;
+	// write EOF symbol and the rest
+	Bits |= (BITBUFFER)m_aEncodeBits[HUFFMAN_EOF_SYMBOL] << Bitcount;
+	Bitcount += m_aEncodeNumBits[HUFFMAN_EOF_SYMBOL];
+	while(Bitcount >= 8)
+	{
+		*pDst++ = (unsigned char)(Bits&0xff);
+		if(pDst == pDstEnd)
+			return -1;
+		Bits >>= 8;
+		Bitcount -= 8;
+	}
+	*pDst++ = (unsigned char)Bits;
 
-	// return the size of the output
 	return (int)(pDst - (const unsigned char *)pOutput);
-
-	// remove macros
-#undef HUFFMAN_MACRO_LOADSYMBOL
-#undef HUFFMAN_MACRO_WRITE
 }
 
 //***************************************************************
 int CHuffman::Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize)
 {
-	// setup buffer pointers
 	unsigned char *pDst = (unsigned char *)pOutput;
-	unsigned char *pSrc = (unsigned char *)pInput;
+	const unsigned char *pSrc = (const unsigned char *)pInput;
 	unsigned char *pDstEnd = pDst + OutputSize;
-	unsigned char *pSrcEnd = pSrc + InputSize;
+	const unsigned char *pSrcEnd = pSrc + InputSize;
 
-	unsigned Bits = 0;
+	// bits past the end of the input read as zeros
+	BITBUFFER Bits = 0;
 	unsigned Bitcount = 0;
 
-	CNode *pEof = &m_aNodes[HUFFMAN_EOF_SYMBOL];
-	CNode *pNode = 0;
+	// input bits that are not consumed yet, negative after reading past the end
+	int64 Remaining = (int64)InputSize*8;
 
-	while(1)
+	// this macro fills the buffer up to at least 56 bits
+#define HUFFMAN_MACRO_REFILL() \
+	if(Bitcount < 32) \
+	{ \
+		if(pSrcEnd-pSrc >= 8) \
+		{ \
+			Bits |= LoadBits(pSrc) << Bitcount; \
+			pSrc += (63-Bitcount)>>3; \
+			Bitcount |= 56; \
+		} \
+		else \
+		{ \
+			while(Bitcount <= 56 && pSrc != pSrcEnd) \
+			{ \
+				Bits |= (BITBUFFER)(*pSrc++) << Bitcount; \
+				Bitcount += 8; \
+			} \
+			if(pSrc == pSrcEnd) \
+				Bitcount = 64; \
+		} \
+	}
+
+	// {A} the reference only fails on long codes within the last 24 bits, before
+	// that it is plain prefix decoding and the table can take several symbols at once
+	while(Remaining >= 32)
 	{
-		// {A} try to load a node now, this will reduce dependency at location {D}
-		pNode = 0;
-		if(Bitcount >= HUFFMAN_LUTBITS)
-			pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
+		HUFFMAN_MACRO_REFILL()
 
-		// {B} fill with new bits
-		while(Bitcount < 24 && pSrc != pSrcEnd)
+		const CDecodeEntry *pEntry = &m_aDecodeTable[Bits&HUFFMAN_DECODE_MASK];
+		if(pEntry->m_NumBits)
 		{
-			Bits |= (*pSrc++) << Bitcount;
-			Bitcount += 8;
+			if(pDstEnd-pDst >= (int)sizeof(*pEntry))
+				memcpy(pDst, pEntry, sizeof(*pEntry)); // the bytes after the symbols are overwritten later
+			else if(pDstEnd-pDst >= pEntry->m_NumSymbols)
+				mem_copy(pDst, pEntry->m_aSymbols, pEntry->m_NumSymbols);
+			else
+				return -1;
+			pDst += pEntry->m_NumSymbols;
+
+			Bits >>= pEntry->m_NumBits;
+			Bitcount -= pEntry->m_NumBits;
+			Remaining -= pEntry->m_NumBits;
+			if(pEntry->m_Eof)
+				return (int)(pDst - (const unsigned char *)pOutput);
+			continue;
 		}
 
-		// {C} load symbol now if we didn't that earlier at location {A}
-		if(!pNode)
-			pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
-
-		if(!pNode)
-			return -1;
-
-		// {D} check if we hit a symbol already
-		if(pNode->m_NumBits)
+		// a code longer than the table, walk the tree from where the lut leaves off
+		CNode *pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
+		unsigned NumBits = HUFFMAN_LUTBITS;
+		while(!pNode->m_NumBits)
 		{
-			// remove the bits for that symbol
-			Bits >>= pNode->m_NumBits;
-			Bitcount -= pNode->m_NumBits;
+			pNode = &m_aNodes[pNode->m_aLeafs[(Bits>>NumBits)&1]];
+			NumBits++;
 		}
-		else
-		{
-			// remove the bits that the lut checked up for us
-			Bits >>= HUFFMAN_LUTBITS;
-			Bitcount -= HUFFMAN_LUTBITS;
+		Bits >>= NumBits;
+		Bitcount -= NumBits;
+		Remaining -= NumBits;
 
-			// walk the tree bit by bit
-			while(1)
-			{
-				// traverse tree
-				pNode = &m_aNodes[pNode->m_aLeafs[Bits&1]];
+		if(pNode == &m_aNodes[HUFFMAN_EOF_SYMBOL])
+			return (int)(pDst - (const unsigned char *)pOutput);
+		if(pDst == pDstEnd)
+			return -1;
+		*pDst++ = pNode->m_Symbol;
+	}
 
-				// remove bit
-				Bitcount--;
-				Bits >>= 1;
+	// {B} the end of the input, symbol by symbol like the reference
+	while(1)
+	{
+		HUFFMAN_MACRO_REFILL()
 
-				// check if we hit a symbol
-				if(pNode->m_NumBits)
-					break;
+		CNode *pNode = m_apDecodeLut[Bits&HUFFMAN_LUTMASK];
+		unsigned NumBits = pNode->m_NumBits;
+		if(!NumBits)
+		{
+			NumBits = HUFFMAN_LUTBITS;
+			while(!pNode->m_NumBits)
+			{
+				pNode = &m_aNodes[pNode->m_aLeafs[(Bits>>NumBits)&1]];
+				NumBits++;
+			}
 
-				// no more bits, decoding error
-				if(Bitcount == 0)
+			// the reference fails when the bits it buffered run out in the
+			// middle of a long code, it buffers at least 24 bits or all that is left
+			if(Remaining > HUFFMAN_LUTBITS)
+			{
+				int64 Consumed = (int64)InputSize*8-Remaining;
+				int64 Buffered = min((int64)InputSize*8, (Consumed+24+7)/8*8)-Consumed;
+				if(Buffered > HUFFMAN_LUTBITS && Buffered < NumBits)
 					return -1;
 			}
 		}
+		Bits >>= NumBits;
+		Bitcount -= NumBits;
+		Remaining -= NumBits;
 
-		// check for eof
-		if(pNode == pEof)
+		if(pNode == &m_aNodes[HUFFMAN_EOF_SYMBOL])
 			break;
-
-		// output character
 		if(pDst == pDstEnd)
 			return -1;
 		*pDst++ = pNode->m_Symbol;
 	}
 
-	// return the size of the decompressed buffer
+#undef HUFFMAN_MACRO_REFILL
+
 	return (int)(pDst - (const unsigned char *)pOutput);
 }
@@ -16,7 +16,13 @@ class CHuffman
 
 		HUFFMAN_LUTBITS = 10,
 		HUFFMAN_LUTSIZE = (1<<HUFFMAN_LUTBITS),
-		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1)
+		HUFFMAN_LUTMASK = (HUFFMAN_LUTSIZE-1),
+
+		// the decode table resolves several symbols at once
+		HUFFMAN_DECODE_BITS = 12,
+		HUFFMAN_DECODE_SIZE = (1<<HUFFMAN_DECODE_BITS),
+		HUFFMAN_DECODE_MASK = (HUFFMAN_DECODE_SIZE-1),
+		HUFFMAN_DECODE_SYMBOLS = 5,
 	};
 
 	struct CNode
@@ -32,13 +38,26 @@ class CHuffman
 		unsigned char m_Symbol;
 	};
 
+	struct CDecodeEntry
+	{
+		unsigned char m_aSymbols[HUFFMAN_DECODE_SYMBOLS];
+		unsigned char m_NumSymbols;
+		unsigned char m_NumBits; // of the symbols and the eof symbol, 0 if the first code is longer than the table
+		unsigned char m_Eof; // the eof symbol follows the symbols
+	};
+
 	CNode m_aNodes[HUFFMAN_MAX_NODES];
 	CNode *m_apDecodeLut[HUFFMAN_LUTSIZE];
 	CNode *m_pStartNode;
 	int m_NumNodes;
 
+	CDecodeEntry m_aDecodeTable[HUFFMAN_DECODE_SIZE];
+	unsigned m_aEncodeBits[HUFFMAN_MAX_SYMBOLS];
+	unsigned char m_aEncodeNumBits[HUFFMAN_MAX_SYMBOLS];
+
 	void Setbits_r(CNode *pNode, int Bits, unsigned Depth);
 	void ConstructTree(const unsigned *pFrequencies);
+	void BuildDecodeTable();
 
 public:
 	/*
@@ -86,6 +105,5 @@ public:
 			Returns the size of the uncompressed data. Negative value on failure.
 	*/
 	int Decompress(const void *pInput, int InputSize, void *pOutput, int OutputSize);
-
 };
 #endif // __HUFFMAN_HEADER__
@@ -1,75 +1,332 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "jobs.h"
 
+#if defined(CONF_FAMILY_WINDOWS) && !defined(__GNUC__)
+	#define JOBS_THREAD_LOCAL __declspec(thread)
+#else
+	#define JOBS_THREAD_LOCAL __thread
+#endif
+
+// worker of the pool the current thread belongs to, if any
+static JOBS_THREAD_LOCAL void *s_pCurrentWorker = 0;
+
+// Chase-Lev deque: the owner works at the bottom, thieves take from the top
+bool CJobPool::CDeque::Push(CJob *pJob)
+{
+	int64 Bottom = atomic_get64(&m_Bottom);
+	int64 Top = atomic_get64(&m_Top);
+	if(Bottom-Top >= DEQUE_SIZE)
+		return false;
+
+	atomic_set_ptr(&m_apJobs[Bottom&(DEQUE_SIZE-1)], pJob);
+	atomic_set64(&m_Bottom, Bottom+1);
+	return true;
+}
+
+CJob *CJobPool::CDeque::Pop()
+{
+	int64 Bottom = atomic_get64(&m_Bottom)-1;
+	atomic_set64(&m_Bottom, Bottom);
+	int64 Top = atomic_get64(&m_Top);
+
+	if(Top > Bottom)
+	{
+		// empty
+		atomic_set64(&m_Bottom, Bottom+1);
+		return 0;
+	}
+
+	CJob *pJob = (CJob *)atomic_get_ptr(&m_apJobs[Bottom&(DEQUE_SIZE-1)]);
+	if(Top == Bottom)
+	{
+		// last one, race the thieves for it
+		if(!atomic_compare_swap64(&m_Top, Top, Top+1))
+			pJob = 0;
+		atomic_set64(&m_Bottom, Bottom+1);
+	}
+	return pJob;
+}
+
+CJob *CJobPool::CDeque::Steal()
+{
+	int64 Top = atomic_get64(&m_Top);
+	int64 Bottom = atomic_get64(&m_Bottom);
+	if(Top >= Bottom)
+		return 0;
+
+	CJob *pJob = (CJob *)atomic_get_ptr(&m_apJobs[Top&(DEQUE_SIZE-1)]);
+	if(!atomic_compare_swap64(&m_Top, Top, Top+1))
+		return 0;
+	return pJob;
+}
+
 CJobPool::CJobPool()
 {
+	m_NumThreads = 0;
+
 	// empty the pool
 	m_Lock = lock_create();
 	m_pFirstJob = 0;
 	m_pLastJob = 0;
+	m_NumShared = 0;
+
+	m_WorkCond = condvar_create();
+	m_DoneCond = condvar_create();
+	m_NumQueued = 0;
+	m_NumSleeping = 0;
+	m_NumSearching = 0;
+	m_NumWaiting = 0;
+	m_Shutdown = 0;
+}
+
+CJobPool::~CJobPool()
+{
+	atomic_set(&m_Shutdown, 1);
+	lock_wait(m_Lock);
+	condvar_broadcast(m_WorkCond);
+	lock_unlock(m_Lock);
+
+	for(int i = 0; i < m_NumThreads; i++)
+		thread_wait(m_aWorkers[i].m_pThread);
+
+	condvar_destroy(m_WorkCond);
+	condvar_destroy(m_DoneCond);
+	lock_destroy(m_Lock);
+}
+
+CJobPool::CWorker *CJobPool::CurrentWorker()
+{
+	CWorker *pWorker = (CWorker *)s_pCurrentWorker;
+	return pWorker && pWorker->m_pPool == this ? pWorker : 0;
+}
+
+CJob *CJobPool::Take(CWorker *pSelf)
+{
+	CJob *pJob = 0;
+
+	// own work first, newest first while it is still in the cache
+	if(pSelf)
+		pJob = pSelf->m_Deque.Pop();
+
+	// then the jobs from outside, oldest first
+	if(!pJob && atomic_get(&m_NumShared) > 0)
+	{
+		lock_wait(m_Lock);
+		if(m_pFirstJob)
+		{
+			pJob = m_pFirstJob;
+			m_pFirstJob = m_pFirstJob->m_pNext;
+			if(!m_pFirstJob)
+				m_pLastJob = 0;
+			atomic_add(&m_NumShared, -1);
+		}
+		lock_unlock(m_Lock);
+	}
+
+	// then steal, starting at a random victim so that thieves spread out
+	if(!pJob && m_NumThreads)
+	{
+		int Start = 0;
+		if(pSelf)
+		{
+			pSelf->m_Seed = pSelf->m_Seed*1103515245+12345;
+			Start = (pSelf->m_Seed>>16)%m_NumThreads;
+		}
+		for(int i = 0; i < m_NumThreads && !pJob; i++)
+		{
+			CWorker *pVictim = &m_aWorkers[(Start+i)%m_NumThreads];
+			if(pVictim != pSelf)
+				pJob = pVictim->m_Deque.Steal();
+		}
+	}
+
+	if(pJob)
+		atomic_add(&m_NumQueued, -1);
+	return pJob;
+}
+
+void CJobPool::Execute(CJob *pJob)
+{
+	// the job may be reused as soon as it is marked done
+	CJobCounter *pCounter = pJob->m_pCounter;
+
+	atomic_set(&pJob->m_Status, CJob::STATE_RUNNING);
+	pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
+	atomic_set(&pJob->m_Status, CJob::STATE_DONE);
+
+	if(pCounter && atomic_add(&pCounter->m_Count, -1) == 0 && atomic_get(&m_NumWaiting) > 0)
+	{
+		lock_wait(m_Lock);
+		condvar_broadcast(m_DoneCond);
+		lock_unlock(m_Lock);
+	}
+}
+
+void CJobPool::WakeWorker()
+{
+	lock_wait(m_Lock);
+	condvar_signal(m_WorkCond);
+	lock_unlock(m_Lock);
 }
 
 void CJobPool::WorkerThread(void *pUser)
 {
-	CJobPool *pPool = (CJobPool *)pUser;
+	CWorker *pSelf = (CWorker *)pUser;
+	CJobPool *pPool = pSelf->m_pPool;
+	s_pCurrentWorker = pSelf;
 
+	// a worker is searching from when it wakes up until it finds a job or sleeps again
+	atomic_add(&pPool->m_NumSearching, 1);
 	while(1)
 	{
-		CJob *pJob = 0;
-
-		// fetch job from queue
-		lock_wait(pPool->m_Lock);
-		if(pPool->m_pFirstJob)
+		CJob *pJob = pPool->Take(pSelf);
+		for(int i = 0; !pJob && i < SPIN_COUNT && atomic_get(&pPool->m_NumQueued) > 0; i++)
 		{
-			pJob = pPool->m_pFirstJob;
-			pPool->m_pFirstJob = pPool->m_pFirstJob->m_pNext;
-			if(pPool->m_pFirstJob)
-				pPool->m_pFirstJob->m_pPrev = 0;
-			else
-				pPool->m_pLastJob = 0;
+			// a job is on its way or a thief won the race, retry a little before sleeping
+			thread_yield();
+			pJob = pPool->Take(pSelf);
 		}
-		lock_unlock(pPool->m_Lock);
 
-		// do the job if we have one
 		if(pJob)
 		{
-			pJob->m_Status = CJob::STATE_RUNNING;
-			pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
-			pJob->m_Status = CJob::STATE_DONE;
+			// the last searcher hands the search over before it gets busy
+			if(atomic_add(&pPool->m_NumSearching, -1) == 0 && atomic_get(&pPool->m_NumQueued) > 0 && atomic_get(&pPool->m_NumSleeping) > 0)
+				pPool->WakeWorker();
+			pPool->Execute(pJob);
+			atomic_add(&pPool->m_NumSearching, 1);
+			continue;
 		}
-		else
-			thread_sleep(10);
-	}
 
+		lock_wait(pPool->m_Lock);
+		atomic_add(&pPool->m_NumSleeping, 1);
+		atomic_add(&pPool->m_NumSearching, -1);
+		while(atomic_get(&pPool->m_NumQueued) <= 0 && !atomic_get(&pPool->m_Shutdown))
+			condvar_wait(pPool->m_WorkCond, pPool->m_Lock);
+		atomic_add(&pPool->m_NumSearching, 1);
+		atomic_add(&pPool->m_NumSleeping, -1);
+		lock_unlock(pPool->m_Lock);
+
+		if(atomic_get(&pPool->m_Shutdown) && atomic_get(&pPool->m_NumQueued) <= 0)
+			break;
+	}
 }
 
 int CJobPool::Init(int NumThreads)
 {
 	// start threads
+	NumThreads = clamp(NumThreads, 0, (int)MAX_THREADS);
+	for(int i = 0; i < NumThreads; i++)
+	{
+		m_aWorkers[i].m_pPool = this;
+		m_aWorkers[i].m_Seed = i+1;
+	}
 	for(int i = 0; i < NumThreads; i++)
-		thread_init(WorkerThread, this);
+		m_aWorkers[i].m_pThread = thread_init(WorkerThread, &m_aWorkers[i]);
+	m_NumThreads = NumThreads;
 	return 0;
 }
 
-int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
+int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, CJobCounter *pCounter)
 {
 	mem_zero(pJob, sizeof(CJob));
 	pJob->m_pfnFunc = pfnFunc;
 	pJob->m_pFuncData = pData;
+	pJob->m_pCounter = pCounter;
+	pJob->m_Status = CJob::STATE_PENDING;
 
-	lock_wait(m_Lock);
+	if(pCounter)
+		atomic_add(&pCounter->m_Count, 1);
+
+	CWorker *pSelf = CurrentWorker();
+	if(!pSelf || !pSelf->m_Deque.Push(pJob))
+	{
+		lock_wait(m_Lock);
 
-	// add job to queue
-	pJob->m_pPrev = m_pLastJob;
-	if(m_pLastJob)
-		m_pLastJob->m_pNext = pJob;
-	m_pLastJob = pJob;
-	if(!m_pFirstJob)
-		m_pFirstJob = pJob;
+		// add job to queue
+		if(m_pLastJob)
+			m_pLastJob->m_pNext = pJob;
+		m_pLastJob = pJob;
+		if(!m_pFirstJob)
+			m_pFirstJob = pJob;
+		atomic_add(&m_NumShared, 1);
 
-	lock_unlock(m_Lock);
+		lock_unlock(m_Lock);
+	}
+
+	// the sleepers check the queued count under the lock, so one of both sides sees the other.
+	// a worker that is still searching will pick the job up and wake the next one if needed
+	atomic_add(&m_NumQueued, 1);
+	if(atomic_get(&m_NumSleeping) > 0 && atomic_get(&m_NumSearching) == 0)
+		WakeWorker();
 	return 0;
 }
 
+void CJobPool::Wait(CJobCounter *pCounter)
+{
+	CWorker *pSelf = CurrentWorker();
+	while(atomic_get(&pCounter->m_Count) > 0)
+	{
+		CJob *pJob = Take(pSelf);
+		if(pJob)
+		{
+			Execute(pJob);
+			continue;
+		}
+
+		// the rest is running on the workers
+		lock_wait(m_Lock);
+		atomic_add(&m_NumWaiting, 1);
+		while(atomic_get(&pCounter->m_Count) > 0 && atomic_get(&m_NumQueued) <= 0)
+			condvar_wait(m_DoneCond, m_Lock);
+		atomic_add(&m_NumWaiting, -1);
+		lock_unlock(m_Lock);
+	}
+}
+
+struct CRangeJobData
+{
+	JOBRANGEFUNC m_pfnFunc;
+	void *m_pData;
+	int m_Begin;
+	int m_End;
+};
+
+static int RangeJob(void *pData)
+{
+	CRangeJobData *pRange = (CRangeJobData *)pData;
+	pRange->m_pfnFunc(pRange->m_pData, pRange->m_Begin, pRange->m_End);
+	return 0;
+}
+
+void CJobPool::ParallelFor(int Num, JOBRANGEFUNC pfnFunc, void *pData, int Grain)
+{
+	if(Num <= 0)
+		return;
+
+	// a few ranges per thread so that stealing can even out uneven ranges
+	int NumRanges = min(min((Num+Grain-1)/max(Grain, 1), (m_NumThreads+1)*4), (int)MAX_RANGES);
+	if(NumRanges <= 1 || !m_NumThreads)
+	{
+		pfnFunc(pData, 0, Num);
+		return;
+	}
+
+	CRangeJobData aRanges[MAX_RANGES];
+	CJob aJobs[MAX_RANGES];
+	CJobCounter Counter;
+	for(int i = 0; i < NumRanges; i++)
+	{
+		aRanges[i].m_pfnFunc = pfnFunc;
+		aRanges[i].m_pData = pData;
+		aRanges[i].m_Begin = (int)((int64)Num*i/NumRanges);
+		aRanges[i].m_End = (int)((int64)Num*(i+1)/NumRanges);
+	}
+	for(int i = 1; i < NumRanges; i++)
+		Add(&aJobs[i], RangeJob, &aRanges[i], &Counter);
+
+	pfnFunc(pData, aRanges[0].m_Begin, aRanges[0].m_End);
+	Wait(&Counter);
+}
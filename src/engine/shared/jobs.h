@@ -2,17 +2,36 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef ENGINE_SHARED_JOBS_H
 #define ENGINE_SHARED_JOBS_H
+
+#include <base/system.h>
+
 typedef int (*JOBFUNC)(void *pData);
+typedef void (*JOBRANGEFUNC)(void *pData, int Begin, int End);
 
 class CJobPool;
 
+/*
+	Class: CJobCounter
+		Counts the jobs of a group that have not finished yet.
+		<CJobPool::Wait> returns when it drops to zero.
+*/
+class CJobCounter
+{
+	friend class CJobPool;
+
+	volatile int m_Count;
+public:
+	CJobCounter() { m_Count = 0; }
+
+	int Pending() { return atomic_get(&m_Count); }
+};
+
 class CJob
 {
 	friend class CJobPool;
 
-	CJobPool *m_pPool;
-	CJob *m_pPrev;
 	CJob *m_pNext;
+	CJobCounter *m_pCounter;
 
 	volatile int m_Status;
 	volatile int m_Result;
@@ -37,18 +56,108 @@ public:
 	int Result() const {return m_Result; }
 };
 
+/*
+	Class: CJobPool
+		Work-stealing scheduler. Every worker owns a lock-free deque:
+		jobs added by a worker go to the bottom of its own deque and
+		are taken from there again, idle workers steal from the top of
+		the others. Jobs added by any other thread go through a shared
+		queue. Workers without work sleep on a condition variable and
+		are woken as soon as a job is added.
+*/
 class CJobPool
 {
+public:
+	enum
+	{
+		MAX_THREADS=16,
+		MAX_RANGES=64,
+	};
+
+private:
+	enum
+	{
+		DEQUE_SIZE=256, // power of two, overflows go to the shared queue
+		SPIN_COUNT=64,
+	};
+
+	class CDeque
+	{
+		volatile int64 m_Top;
+		volatile int64 m_Bottom;
+		void *volatile m_apJobs[DEQUE_SIZE];
+	public:
+		CDeque() { m_Top = 0; m_Bottom = 0; }
+
+		// owner only
+		bool Push(CJob *pJob);
+		CJob *Pop();
+
+		// any thread
+		CJob *Steal();
+	};
+
+	class CWorker
+	{
+	public:
+		CJobPool *m_pPool;
+		void *m_pThread;
+		unsigned m_Seed;
+		CDeque m_Deque;
+	};
+
+	CWorker m_aWorkers[MAX_THREADS];
+	int m_NumThreads;
+
+	// jobs from threads outside of the pool
 	LOCK m_Lock;
 	CJob *m_pFirstJob;
 	CJob *m_pLastJob;
+	volatile int m_NumShared;
+
+	CONDVAR m_WorkCond;
+	CONDVAR m_DoneCond;
+	volatile int m_NumQueued;
+	volatile int m_NumSleeping;
+	volatile int m_NumSearching;
+	volatile int m_NumWaiting;
+	volatile int m_Shutdown;
 
 	static void WorkerThread(void *pUser);
 
+	CWorker *CurrentWorker();
+	CJob *Take(CWorker *pSelf);
+	void WakeWorker();
+	void Execute(CJob *pJob);
+
 public:
 	CJobPool();
+	~CJobPool();
 
 	int Init(int NumThreads);
-	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData);
+	int NumThreads() const { return m_NumThreads; }
+
+	/*
+		Function: Add
+			Queues a job. If a counter is given it is raised now and
+			lowered again when the job is done.
+	*/
+	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, CJobCounter *pCounter = 0);
+
+	/*
+		Function: Wait
+			Returns when all jobs of the counter are done. The calling
+			thread runs queued jobs meanwhile and sleeps when there are
+			none left.
+	*/
+	void Wait(CJobCounter *pCounter);
+
+	/*
+		Function: ParallelFor
+			Splits [0, Num) into ranges of at least Grain items and runs
+			them on the pool. The calling thread takes the first range
+			and returns when all of them are done.
+	*/
+	void ParallelFor(int Num, JOBRANGEFUNC pfnFunc, void *pData, int Grain = 1);
 };
 #endif
@@ -8,6 +8,7 @@
 class CMap : public IEngineMap
 {
 	CDataFileReader m_DataFile;
+	CDataFileReader m_PreparedFile;
 public:
 	CMap() {}
 
@@ -41,6 +42,41 @@ public:
 	{
 		return m_DataFile.Crc();
 	}
+
+	virtual bool Prepare(const char *pMapName)
+	{
+		IStorage *pStorage = Kernel()->RequestInterface<IStorage>();
+		if(!pStorage)
+			return false;
+		m_PreparedFile.Close();
+		return m_PreparedFile.Open(pStorage, pMapName, IStorage::TYPE_ALL, true);
+	}
+
+	virtual unsigned PreparedCrc()
+	{
+		return m_PreparedFile.Crc();
+	}
+
+	virtual unsigned PreparedSize()
+	{
+		return m_PreparedFile.FileSize();
+	}
+
+	virtual const unsigned char *PreparedData()
+	{
+		return m_PreparedFile.FileData();
+	}
+
+	virtual void CommitPrepared()
+	{
+		m_DataFile.Swap(&m_PreparedFile);
+		m_PreparedFile.Close();
+	}
+
+	virtual void DiscardPrepared()
+	{
+		m_PreparedFile.Close();
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
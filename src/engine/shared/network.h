@@ -168,6 +168,7 @@ private:
 	bool m_UnknownSeq;
 
 	TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> m_Buffer;
+	int m_BufferSize; // bytes of vital chunks waiting for their ack
 
 	int64 m_LastUpdateTime;
 	int64 m_LastRecvTime;
@@ -223,6 +224,7 @@ public:
 	int64 ConnectTime() const { return m_LastUpdateTime; }
 
 	int AckSequence() const { return m_Ack; }
+	int ResendBufferSize() const { return m_BufferSize; }
 
 	// anti spoof
 	void DirectInit(NETADDR &Addr, SECURITY_TOKEN SecurityToken);
@@ -254,6 +256,7 @@ public:
 	int State() const { return m_State; }
 	const NETADDR *PeerAddress() const { return &m_PeerAddr; }
 	const char *ErrorString() const { return m_aErrorString; }
+	NETSOCKET Socket() const { return m_Socket; }
 
 	void Reset();
 	int Update();
@@ -282,10 +285,22 @@ public:
 // server side
 class CNetServer
 {
+	enum
+	{
+		ADDR_HASH_SIZE=256, // power of two
+	};
+
 	struct CSlot
 	{
 	public:
 		CNetConnection m_Connection;
+
+		// chains of the address indices
+		bool m_Hashed;
+		unsigned m_AddrBucket;
+		unsigned m_IpBucket;
+		int m_AddrHashNext;
+		int m_IpHashNext;
 	};
 
 	NETSOCKET m_Socket;
@@ -294,6 +309,14 @@ class CNetServer
 	int m_MaxClients;
 	int m_MaxClientsPerIP;
 
+	// slots by full address and by ip only, kept in sync on accept and drop
+	int m_aAddrHash[ADDR_HASH_SIZE];
+	int m_aIpHash[ADDR_HASH_SIZE];
+
+	static unsigned AddrHash(const NETADDR &Addr, bool WithPort);
+	void HashSlot(int Slot);
+	void UnhashSlot(int Slot);
+
 	NETFUNC_NEWCLIENT m_pfnNewClient;
 	NETFUNC_NEWCLIENT_NOAUTH m_pfnNewClientNoAuth;
 	NETFUNC_DELCLIENT m_pfnDelClient;
@@ -312,6 +335,13 @@ class CNetServer
 
 	unsigned char m_SecurityTokenSeed[16];
 
+	// batched socket io
+	bool m_Batching;
+	NETRECVBATCH *m_pRecvBatch;
+	int m_NumRecvBatch;
+	int m_RecvBatchPos;
+	NETSENDBATCH *m_pSendBatch;
+
 	void OnConnCtrlMsg(NETADDR &Addr, int ClientID, int ControlMsg, const CNetPacketConstruct &Packet);
 	void OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketConstruct &Packet);
 	void OnPreConnMsg(NETADDR &Addr, const CNetPacketConstruct &Packet);
@@ -338,10 +368,12 @@ public:
 
 	//
 	int Drop(int ClientID, const char *pReason);
+	int Flush(int ClientID) { return m_aSlots[ClientID].m_Connection.Flush(); }
 
 	// status requests
 	const NETADDR *ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
 	bool HasSecurityToken(int ClientID) const { return m_aSlots[ClientID].m_Connection.SecurityToken() != NET_SECURITY_TOKEN_UNSUPPORTED; }	
+	int ResendBufferSize(int ClientID) const { return m_aSlots[ClientID].m_Connection.ResendBufferSize(); }
 	NETSOCKET Socket() const { return m_Socket; }
 	class CNetBan *NetBan() const { return m_pNetBan; }
 	int NetType() const { return m_Socket.type; }
@@ -350,6 +382,11 @@ public:
 	//
 	void SetMaxClientsPerIP(int Max);
 
+	// batched socket io, a send batch collects all packets until it ends
+	void SetBatching(bool Batching) { m_Batching = Batching; }
+	void BeginSendBatch();
+	void EndSendBatch();
+
 	// anti spoof
 	SECURITY_TOKEN GetToken(const NETADDR &Addr);
 	// vanilla token/gametick shouldn't be negative
@@ -366,6 +403,7 @@ class CNetConsole
 	NETSOCKET m_Socket;
 	class CNetBan *m_pNetBan;
 	CSlot m_aSlots[NET_MAX_CONSOLE_CLIENTS];
+	NETWAIT *m_pWait;
 
 	NETFUNC_NEWCLIENT m_pfnNewClient;
 	NETFUNC_DELCLIENT m_pfnDelClient;
@@ -389,6 +427,10 @@ public:
 	int AcceptClient(NETSOCKET Socket, const NETADDR *pAddr);
 	int Drop(int ClientID, const char *pReason);
 
+	// watches the listening socket and the client sockets, they are
+	// added when accepted and removed before they are closed
+	void SetWait(NETWAIT *pWait);
+
 	// status requests
 	const NETADDR *ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
 	class CNetBan *NetBan() const { return m_pNetBan; }
@@ -400,7 +442,13 @@ class CNetBase
 	static IOHANDLE ms_DataLogSent;
 	static IOHANDLE ms_DataLogRecv;
 	static CHuffman ms_Huffman;
+	static NETSENDBATCH *ms_pSendBatch;
+
+	static void SendRaw(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize);
 public:
+	// while a batch is set, packets are queued in it instead of being sent right away
+	static void SetSendBatch(NETSENDBATCH *pBatch) { ms_pSendBatch = pBatch; }
+
 	static void OpenLog(IOHANDLE DataLogSent, IOHANDLE DataLogRecv);
 	static void CloseLog();
 	static void Init();
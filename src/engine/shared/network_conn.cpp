@@ -39,6 +39,7 @@ void CNetConnection::Reset(bool Rejoin)
 	m_UnknownSeq = false;
 
 	m_Buffer.Init();
+	m_BufferSize = 0;
 
 	mem_zero(&m_Construct, sizeof(m_Construct));
 }
@@ -71,7 +72,10 @@ void CNetConnection::AckChunks(int Ack)
 			break;
 
 		if(CNetBase::IsSeqInBackroom(pResend->m_Sequence, Ack))
+		{
+			m_BufferSize -= sizeof(CNetChunkResend)+pResend->m_DataSize;
 			m_Buffer.PopFirst();
+		}
 		else
 			break;
 	}
@@ -137,6 +141,7 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 			pResend->m_FirstSendTime = time_get();
 			pResend->m_LastSendTime = pResend->m_FirstSendTime;
 			mem_copy(pResend->m_pData, pData, DataSize);
+			m_BufferSize += sizeof(CNetChunkResend)+DataSize;
 		}
 		else
 		{
@@ -40,6 +40,8 @@ void CNetConsole::SetCallbacks(NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT
 
 int CNetConsole::Close()
 {
+	SetWait(0);
+
 	for(int i = 0; i < NET_MAX_CONSOLE_CLIENTS; i++)
 		m_aSlots[i].m_Connection.Disconnect("closing console");
 
@@ -48,11 +50,38 @@ int CNetConsole::Close()
 	return 0;
 }
 
+void CNetConsole::SetWait(NETWAIT *pWait)
+{
+	if(m_pWait)
+	{
+		net_wait_remove(m_pWait, m_Socket);
+		for(int i = 0; i < NET_MAX_CONSOLE_CLIENTS; i++)
+		{
+			if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE)
+				net_wait_remove(m_pWait, m_aSlots[i].m_Connection.Socket());
+		}
+	}
+
+	m_pWait = pWait;
+
+	if(m_pWait)
+	{
+		net_wait_add(m_pWait, m_Socket);
+		for(int i = 0; i < NET_MAX_CONSOLE_CLIENTS; i++)
+		{
+			if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE)
+				net_wait_add(m_pWait, m_aSlots[i].m_Connection.Socket());
+		}
+	}
+}
+
 int CNetConsole::Drop(int ClientID, const char *pReason)
 {
 	if(m_pfnDelClient)
 		m_pfnDelClient(ClientID, pReason, m_UserPtr);
 
+	if(m_pWait && m_aSlots[ClientID].m_Connection.State() != NET_CONNSTATE_OFFLINE)
+		net_wait_remove(m_pWait, m_aSlots[ClientID].m_Connection.Socket());
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
 
 	return 0;
@@ -82,6 +111,8 @@ int CNetConsole::AcceptClient(NETSOCKET Socket, const NETADDR *pAddr)
 	if(!aError[0] && FreeSlot != -1)
 	{
 		m_aSlots[FreeSlot].m_Connection.Init(Socket, pAddr);
+		if(m_pWait)
+			net_wait_add(m_pWait, Socket);
 		if(m_pfnNewClient)
 			m_pfnNewClient(FreeSlot, m_UserPtr);
 		return 0;
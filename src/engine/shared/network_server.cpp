@@ -51,12 +51,75 @@ bool CNetServer::Open(NETADDR BindAddr, CNetBan *pNetBan, int MaxClients, int Ma
 
 	secure_random_fill(m_SecurityTokenSeed, sizeof(m_SecurityTokenSeed));	
 
+	m_Batching = true;
+	m_pRecvBatch = net_udp_recv_batch_create(NET_MAX_PACKETSIZE);
+	m_pSendBatch = net_udp_send_batch_create(NET_MAX_PACKETSIZE);
+
+	for(int i = 0; i < ADDR_HASH_SIZE; i++)
+	{
+		m_aAddrHash[i] = -1;
+		m_aIpHash[i] = -1;
+	}
+
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
+	{
 		m_aSlots[i].m_Connection.Init(m_Socket, true);
+		m_aSlots[i].m_Hashed = false;
+	}
 
 	return true;
 }
 
+unsigned CNetServer::AddrHash(const NETADDR &Addr, bool WithPort)
+{
+	// fnv-1a over the fields that net_addr_comp looks at
+	unsigned Hash = 2166136261u;
+	Hash = (Hash^Addr.type)*16777619u;
+	for(int i = 0; i < (int)sizeof(Addr.ip); i++)
+		Hash = (Hash^Addr.ip[i])*16777619u;
+	if(WithPort)
+	{
+		Hash = (Hash^(Addr.port&0xff))*16777619u;
+		Hash = (Hash^(Addr.port>>8))*16777619u;
+	}
+	return Hash&(ADDR_HASH_SIZE-1);
+}
+
+void CNetServer::HashSlot(int Slot)
+{
+	if(m_aSlots[Slot].m_Hashed)
+		UnhashSlot(Slot);
+
+	// remember the buckets, the peer address can change before the slot is unhashed
+	CSlot *pSlot = &m_aSlots[Slot];
+	pSlot->m_AddrBucket = AddrHash(*pSlot->m_Connection.PeerAddress(), true);
+	pSlot->m_IpBucket = AddrHash(*pSlot->m_Connection.PeerAddress(), false);
+
+	pSlot->m_AddrHashNext = m_aAddrHash[pSlot->m_AddrBucket];
+	m_aAddrHash[pSlot->m_AddrBucket] = Slot;
+	pSlot->m_IpHashNext = m_aIpHash[pSlot->m_IpBucket];
+	m_aIpHash[pSlot->m_IpBucket] = Slot;
+	pSlot->m_Hashed = true;
+}
+
+void CNetServer::UnhashSlot(int Slot)
+{
+	if(!m_aSlots[Slot].m_Hashed)
+		return;
+
+	int *pLink = &m_aAddrHash[m_aSlots[Slot].m_AddrBucket];
+	while(*pLink != Slot)
+		pLink = &m_aSlots[*pLink].m_AddrHashNext;
+	*pLink = m_aSlots[Slot].m_AddrHashNext;
+
+	pLink = &m_aIpHash[m_aSlots[Slot].m_IpBucket];
+	while(*pLink != Slot)
+		pLink = &m_aSlots[*pLink].m_IpHashNext;
+	*pLink = m_aSlots[Slot].m_IpHashNext;
+
+	m_aSlots[Slot].m_Hashed = false;
+}
+
 int CNetServer::SetCallbacks(NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser)
 {
 	m_pfnNewClient = pfnNewClient;
@@ -77,9 +140,27 @@ int CNetServer::SetCallbacks(NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_NEWCLIENT_N
 int CNetServer::Close()
 {
 	// TODO: implement me
+	if(m_pRecvBatch)
+		net_udp_recv_batch_destroy(m_pRecvBatch);
+	if(m_pSendBatch)
+		net_udp_send_batch_destroy(m_pSendBatch);
+	m_pRecvBatch = 0;
+	m_pSendBatch = 0;
 	return 0;
 }
 
+void CNetServer::BeginSendBatch()
+{
+	if(m_Batching)
+		CNetBase::SetSendBatch(m_pSendBatch);
+}
+
+void CNetServer::EndSendBatch()
+{
+	CNetBase::SetSendBatch(0);
+	net_udp_send_batch_flush(m_pSendBatch);
+}
+
 int CNetServer::Drop(int ClientID, const char *pReason)
 {
 	// TODO: insert lots of checks here
@@ -94,6 +175,7 @@ int CNetServer::Drop(int ClientID, const char *pReason)
 		m_pfnDelClient(ClientID, pReason, m_UserPtr);
 
 	m_aSlots[ClientID].m_Connection.Disconnect(pReason);
+	UnhashSlot(ClientID);
 
 	return 0;
 }
@@ -151,7 +233,7 @@ int CNetServer::NumClientsWithAddr(NETADDR Addr)
 	int FoundAddr = 0;
 	ThisAddr.port = 0;
 
-	for(int i = 0; i < MaxClients(); ++i)
+	for(int i = m_aIpHash[AddrHash(Addr, false)]; i >= 0; i = m_aSlots[i].m_IpHashNext)
 	{
 		if(m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE ||
 			m_aSlots[i].m_Connection.State() == NET_CONNSTATE_ERROR)
@@ -198,6 +280,7 @@ int CNetServer::TryAcceptClient(NETADDR &Addr, SECURITY_TOKEN SecurityToken, boo
 
 	// init connection slot
 	m_aSlots[Slot].m_Connection.DirectInit(Addr, SecurityToken);
+	HashSlot(Slot);
 
 	if (VanillaAuth)
 	{
@@ -493,18 +576,17 @@ void CNetServer::OnTokenCtrlMsg(NETADDR &Addr, int ControlMsg, const CNetPacketC
 
 int CNetServer::GetClientSlot(const NETADDR &Addr)
 {
-	int Slot = -1;
-	for(int i = 0; i < MaxClients(); i++)
+	for(int i = m_aAddrHash[AddrHash(Addr, true)]; i >= 0; i = m_aSlots[i].m_AddrHashNext)
 	{
 		if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE &&
 			m_aSlots[i].m_Connection.State() != NET_CONNSTATE_ERROR &&
 			net_addr_comp(m_aSlots[i].m_Connection.PeerAddress(), &Addr) == 0)
 		{
-			Slot = i;
+			return i;
 		}
 	}
 
-	return Slot;
+	return -1;
 }
 
 static bool IsDDNetControlMsg(const CNetPacketConstruct *pPacket)
@@ -543,8 +625,23 @@ int CNetServer::Recv(CNetChunk *pChunk)
 		if(m_RecvUnpacker.FetchChunk(pChunk))
 			return 1;
 
-		// TODO: empty the recvinfo
-		int Bytes = net_udp_recv(m_Socket, &Addr, m_RecvUnpacker.m_aBuffer, NET_MAX_PACKETSIZE);
+		int Bytes;
+		unsigned char *pData;
+		if(m_Batching || m_RecvBatchPos < m_NumRecvBatch)
+		{
+			// drain the socket in batches
+			if(m_RecvBatchPos >= m_NumRecvBatch)
+			{
+				m_NumRecvBatch = net_udp_recv_batch(m_Socket, m_pRecvBatch);
+				m_RecvBatchPos = 0;
+			}
+			Bytes = net_udp_recv_batch_get(m_pRecvBatch, m_RecvBatchPos++, &Addr, &pData);
+		}
+		else
+		{
+			Bytes = net_udp_recv(m_Socket, &Addr, m_RecvUnpacker.m_aBuffer, NET_MAX_PACKETSIZE);
+			pData = m_RecvUnpacker.m_aBuffer;
+		}
 
 		// no more packets for now
 		if(Bytes <= 0)
@@ -559,7 +656,7 @@ int CNetServer::Recv(CNetChunk *pChunk)
 			continue;
 		} */
 				
-		if(CNetBase::UnpackPacket(m_RecvUnpacker.m_aBuffer, Bytes, &m_RecvUnpacker.m_Data) == 0)
+		if(CNetBase::UnpackPacket(pData, Bytes, &m_RecvUnpacker.m_Data) == 0)
 		{
 			if(m_RecvUnpacker.m_Data.m_Flags&NET_PACKETFLAG_CONNLESS)
 			{
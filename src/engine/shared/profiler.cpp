@@ -0,0 +1,100 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <algorithm>
+
+#include "profiler.h"
+
+CProfiler g_Profiler;
+
+static const struct
+{
+	const char *m_pName;
+	int m_Parent;
+} s_aScopeInfo[CProfiler::NUM_SCOPES] = {
+	{"network", -1},
+	{"tick", -1},
+	{"world", CProfiler::SCOPE_TICK},
+	{"controller", CProfiler::SCOPE_TICK},
+	{"players", CProfiler::SCOPE_TICK},
+	{"voting", CProfiler::SCOPE_TICK},
+	{"snapshot", -1},
+	{"build", CProfiler::SCOPE_SNAP},
+	{"delta", CProfiler::SCOPE_SNAP},
+	{"compress", CProfiler::SCOPE_SNAP},
+	{"send", CProfiler::SCOPE_SNAP},
+	{"demo", CProfiler::SCOPE_SNAP},
+	{"rconcmds", -1},
+};
+
+CProfiler::CProfiler()
+{
+	Reset();
+}
+
+void CProfiler::Reset()
+{
+	for(int i = 0; i < NUM_SCOPES; i++)
+	{
+		m_aScopes[i].m_Start = 0;
+		m_aScopes[i].m_Accum = 0;
+		m_aScopes[i].m_Ran = false;
+		m_aScopes[i].m_NumSamples = 0;
+		m_aScopes[i].m_NextSample = 0;
+	}
+}
+
+void CProfiler::NextFrame()
+{
+	int64 Freq = time_freq();
+	for(int i = 0; i < NUM_SCOPES; i++)
+	{
+		CScope *pScope = &m_aScopes[i];
+		if(!pScope->m_Ran)
+			continue;
+
+		pScope->m_aSamples[pScope->m_NextSample] = (int)(pScope->m_Accum*1000000/Freq);
+		pScope->m_NextSample = (pScope->m_NextSample+1)%NUM_SAMPLES;
+		if(pScope->m_NumSamples < NUM_SAMPLES)
+			pScope->m_NumSamples++;
+
+		pScope->m_Accum = 0;
+		pScope->m_Ran = false;
+	}
+}
+
+void CProfiler::GetStats(int Scope, CStats *pStats) const
+{
+	const CScope *pScope = &m_aScopes[Scope];
+	pStats->m_NumSamples = pScope->m_NumSamples;
+	if(!pScope->m_NumSamples)
+	{
+		pStats->m_P50 = pStats->m_P99 = pStats->m_Max = 0;
+		return;
+	}
+
+	int aSorted[NUM_SAMPLES];
+	mem_copy(aSorted, pScope->m_aSamples, pScope->m_NumSamples*sizeof(int));
+	std::sort(aSorted, aSorted+pScope->m_NumSamples);
+
+	pStats->m_P50 = aSorted[(pScope->m_NumSamples-1)*50/100];
+	pStats->m_P99 = aSorted[(pScope->m_NumSamples-1)*99/100];
+	pStats->m_Max = aSorted[pScope->m_NumSamples-1];
+}
+
+const char *CProfiler::ScopeName(int Scope)
+{
+	return s_aScopeInfo[Scope].m_pName;
+}
+
+int CProfiler::ScopeParent(int Scope)
+{
+	return s_aScopeInfo[Scope].m_Parent;
+}
+
+int CProfiler::ScopeDepth(int Scope)
+{
+	int Depth = 0;
+	for(int p = s_aScopeInfo[Scope].m_Parent; p >= 0; p = s_aScopeInfo[p].m_Parent)
+		Depth++;
+	return Depth;
+}
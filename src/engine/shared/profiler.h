@@ -0,0 +1,97 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_PROFILER_H
+#define ENGINE_SHARED_PROFILER_H
+
+#include <base/system.h>
+
+/*
+	Class: CProfiler
+		Measures the phases of the server tick. Time spent in a scope is
+		summed up over one frame (one server tick, including the network
+		pumping since the previous one) and stored as one sample when the
+		frame ends. Percentiles are taken over the last NUM_SAMPLES frames
+		in which the scope ran.
+
+		Only the tick thread may use Begin/End/Add. A scope must not be
+		begun again before it ended.
+*/
+class CProfiler
+{
+public:
+	enum
+	{
+		NUM_SAMPLES=512, // ~10 seconds at 50 ticks per second
+	};
+
+	enum
+	{
+		SCOPE_NETWORK=0,
+		SCOPE_TICK,
+		SCOPE_TICK_WORLD,
+		SCOPE_TICK_CONTROLLER,
+		SCOPE_TICK_PLAYERS,
+		SCOPE_TICK_VOTING,
+		SCOPE_SNAP,
+		SCOPE_SNAP_BUILD,
+		SCOPE_SNAP_DELTA,
+		SCOPE_SNAP_COMPRESS,
+		SCOPE_SNAP_SEND,
+		SCOPE_SNAP_DEMO,
+		SCOPE_RCONCMDS,
+		NUM_SCOPES
+	};
+
+	class CStats
+	{
+	public:
+		int m_NumSamples;
+		int m_P50; // all times in microseconds
+		int m_P99;
+		int m_Max;
+	};
+
+private:
+	class CScope
+	{
+	public:
+		int64 m_Start;
+		int64 m_Accum;
+		bool m_Ran;
+
+		int m_aSamples[NUM_SAMPLES];
+		int m_NumSamples;
+		int m_NextSample;
+	};
+
+	CScope m_aScopes[NUM_SCOPES];
+
+public:
+	CProfiler();
+
+	void Reset();
+
+	void Begin(int Scope) { m_aScopes[Scope].m_Start = time_get(); }
+	void End(int Scope) { Add(Scope, time_get()-m_aScopes[Scope].m_Start); }
+	void Add(int Scope, int64 Time)
+	{
+		m_aScopes[Scope].m_Accum += Time;
+		m_aScopes[Scope].m_Ran = true;
+	}
+
+	/*
+		Function: NextFrame
+			Closes the current frame and stores the summed up times.
+	*/
+	void NextFrame();
+
+	void GetStats(int Scope, CStats *pStats) const;
+
+	static const char *ScopeName(int Scope);
+	static int ScopeParent(int Scope);
+	static int ScopeDepth(int Scope);
+};
+
+extern CProfiler g_Profiler;
+
+#endif
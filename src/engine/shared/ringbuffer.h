@@ -65,4 +65,20 @@ public:
 	T *Last() { return (T*)CRingBufferBase::Last(); }
 };
 
+// same as above, but on memory that the owner provides (and may replace)
+template<typename T, int TFLAGS=0>
+class TExternalRingBuffer : public CRingBufferBase
+{
+public:
+	void Init(void *pMemory, int Size) { CRingBufferBase::Init(pMemory, Size, TFLAGS); }
+
+	T *Allocate(int Size) { return (T*)CRingBufferBase::Allocate(Size); }
+	int PopFirst() { return CRingBufferBase::PopFirst(); }
+
+	T *Prev(T *pCurrent) { return (T*)CRingBufferBase::Prev(pCurrent); }
+	T *Next(T *pCurrent) { return (T*)CRingBufferBase::Next(pCurrent); }
+	T *First() { return (T*)CRingBufferBase::First(); }
+	T *Last() { return (T*)CRingBufferBase::Last(); }
+};
+
 #endif
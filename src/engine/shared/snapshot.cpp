@@ -1,8 +1,17 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+
 #include "snapshot.h"
 #include "compression.h"
 
+#if defined(CONF_SSE2)
+	#include <emmintrin.h>
+#endif
+#if defined(CONF_AVX2)
+	#include <immintrin.h>
+#endif
+
 // CSnapshot
 
 CSnapshotItem *CSnapshot::GetItem(int Index)
@@ -57,51 +66,55 @@ void CSnapshot::DebugDump()
 }
 
 
-// CSnapshotDelta
+// CSnapshotIndex
 
-struct CItemList
+int CSnapshotIndex::NumBits(int NumItems)
 {
-	int m_Num;
-	int m_aKeys[64];
-	int m_aIndex[64];
-};
+	// at most half of the slots are used
+	int Bits = 1;
+	while((1<<Bits) < NumItems*2)
+		Bits++;
+	return Bits;
+}
 
-enum
+int CSnapshotIndex::MemSize(int NumItems)
 {
-	HASHLIST_SIZE = 256,
-};
+	return sizeof(CSnapshotIndex) + (1<<NumBits(NumItems))*sizeof(short);
+}
 
-static void GenerateHash(CItemList *pHashlist, CSnapshot *pSnapshot)
+void CSnapshotIndex::Build(CSnapshot *pSnap)
 {
-	for(int i = 0; i < HASHLIST_SIZE; i++)
-		pHashlist[i].m_Num = 0;
+	m_Bits = NumBits(pSnap->NumItems());
+	short *pSlots = Slots();
+	int Mask = (1<<m_Bits)-1;
+	for(int i = 0; i <= Mask; i++)
+		pSlots[i] = -1;
 
-	for(int i = 0; i < pSnapshot->NumItems(); i++)
+	for(int i = 0; i < pSnap->NumItems(); i++)
 	{
-		int Key = pSnapshot->GetItem(i)->Key();
-		int HashID = ((Key>>12)&0xf0) | (Key&0xf);
-		if(pHashlist[HashID].m_Num != 64)
-		{
-			pHashlist[HashID].m_aIndex[pHashlist[HashID].m_Num] = i;
-			pHashlist[HashID].m_aKeys[pHashlist[HashID].m_Num] = Key;
-			pHashlist[HashID].m_Num++;
-		}
+		int s = Slot(pSnap->GetItem(i)->Key());
+		while(pSlots[s] != -1)
+			s = (s+1)&Mask;
+		pSlots[s] = i;
 	}
 }
 
-static int GetItemIndexHashed(int Key, const CItemList *pHashlist)
+int CSnapshotIndex::GetItemIndex(CSnapshot *pSnap, int Key) const
 {
-		int HashID = ((Key>>12)&0xf0) | (Key&0xf);
-		for(int i = 0; i < pHashlist[HashID].m_Num; i++)
-		{
-			if(pHashlist[HashID].m_aKeys[i] == Key)
-				return pHashlist[HashID].m_aIndex[i];
+	const short *pSlots = Slots();
+	int Mask = (1<<m_Bits)-1;
+	for(int s = Slot(Key); pSlots[s] != -1; s = (s+1)&Mask)
+	{
+		if(pSnap->GetItem(pSlots[s])->Key() == Key)
+			return pSlots[s];
 	}
-
 	return -1;
 }
 
-static int DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
+
+// CSnapshotDelta
+
+static int DiffItemScalar(const int *pPast, const int *pCurrent, int *pOut, int Size)
 {
 	int Needed = 0;
 	while(Size)
@@ -117,6 +130,80 @@ static int DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
 	return Needed;
 }
 
+#if defined(CONF_SSE2)
+static int DiffItemSSE2(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	__m128i Needed = _mm_setzero_si128();
+	int i = 0;
+	for(; i+4 <= Size; i += 4)
+	{
+		__m128i Diff = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(pCurrent+i)), _mm_loadu_si128((const __m128i *)(pPast+i)));
+		_mm_storeu_si128((__m128i *)(pOut+i), Diff);
+		Needed = _mm_or_si128(Needed, Diff);
+	}
+	Needed = _mm_or_si128(Needed, _mm_srli_si128(Needed, 8));
+	Needed = _mm_or_si128(Needed, _mm_srli_si128(Needed, 4));
+	return _mm_cvtsi128_si32(Needed) | DiffItemScalar(pPast+i, pCurrent+i, pOut+i, Size-i);
+}
+#endif
+
+#if defined(CONF_AVX2)
+CONF_TARGET_AVX2 static int DiffItemAVX2(const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	// most items are shorter than 16 ints, take the rest in one 128 bit step
+	__m256i Needed8 = _mm256_setzero_si256();
+	int i = 0;
+	for(; i+8 <= Size; i += 8)
+	{
+		__m256i Diff = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(pCurrent+i)), _mm256_loadu_si256((const __m256i *)(pPast+i)));
+		_mm256_storeu_si256((__m256i *)(pOut+i), Diff);
+		Needed8 = _mm256_or_si256(Needed8, Diff);
+	}
+	__m128i Needed = _mm_or_si128(_mm256_castsi256_si128(Needed8), _mm256_extracti128_si256(Needed8, 1));
+	_mm256_zeroupper(); // the callers are non-vex sse code, which is slow with dirty upper halves
+	if(i+4 <= Size)
+	{
+		__m128i Diff = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(pCurrent+i)), _mm_loadu_si128((const __m128i *)(pPast+i)));
+		_mm_storeu_si128((__m128i *)(pOut+i), Diff);
+		Needed = _mm_or_si128(Needed, Diff);
+		i += 4;
+	}
+	Needed = _mm_or_si128(Needed, _mm_srli_si128(Needed, 8));
+	Needed = _mm_or_si128(Needed, _mm_srli_si128(Needed, 4));
+	int Result = _mm_cvtsi128_si32(Needed);
+	for(; i < Size; i++)
+	{
+		pOut[i] = pCurrent[i]-pPast[i];
+		Result |= pOut[i];
+	}
+	return Result;
+}
+#endif
+
+typedef int (*DIFFITEMFUNC)(const int *pPast, const int *pCurrent, int *pOut, int Size);
+
+static const DIFFITEMFUNC s_apfnDiffItem[CVariableInt::NUM_KERNELS] = {
+	DiffItemScalar,
+#if defined(CONF_SSE2)
+	DiffItemSSE2,
+#else
+	0,
+#endif
+#if defined(CONF_AVX2)
+	DiffItemAVX2,
+#else
+	0,
+#endif
+};
+
+// the same kernel as the variable int packing
+static const DIFFITEMFUNC s_pfnDiffItem = s_apfnDiffItem[CVariableInt::BestKernel()];
+
+int CSnapshotDelta::DiffItem(int Kernel, const int *pPast, const int *pCurrent, int *pOut, int Size)
+{
+	return s_apfnDiffItem[Kernel](pPast, pCurrent, pOut, Size);
+}
+
 void CSnapshotDelta::UndiffItem(int *pPast, int *pDiff, int *pOut, int Size)
 {
 	while(Size)
@@ -158,8 +245,7 @@ CSnapshotDelta::CData *CSnapshotDelta::EmptyDelta()
 	return &m_Empty;
 }
 
-// TODO: OPT: this should be made much faster
-int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData)
+int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData, const CSnapshotIndex *pFromIndex, CSnapshotIndexBuffer *pToIndexBuffer)
 {
 	CData *pDelta = (CData *)pDstData;
 	int *pData = (int *)pDelta->m_pData;
@@ -167,21 +253,21 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 	CSnapshotItem *pFromItem;
 	CSnapshotItem *pCurItem;
 	CSnapshotItem *pPastItem;
-	int Count = 0;
-	int SizeCount = 0;
 
 	pDelta->m_NumDeletedItems = 0;
 	pDelta->m_NumUpdateItems = 0;
 	pDelta->m_NumTempItems = 0;
 
-	CItemList Hashlist[HASHLIST_SIZE];
-	GenerateHash(Hashlist, pTo);
+	// the new snapshot is indexed here, the old one comes with its index
+	dbg_assert(pFromIndex || !pFrom->NumItems(), "delta from a snapshot without an index");
+	CSnapshotIndex *pToIndex = pToIndexBuffer->Index();
+	pToIndex->Build(pTo);
 
 	// pack deleted stuff
 	for(i = 0; i < pFrom->NumItems(); i++)
 	{
 		pFromItem = pFrom->GetItem(i);
-		if(GetItemIndexHashed(pFromItem->Key(), Hashlist) == -1)
+		if(pToIndex->GetItemIndex(pTo, pFromItem->Key()) == -1)
 		{
 			// deleted
 			pDelta->m_NumDeletedItems++;
@@ -190,24 +276,12 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 		}
 	}
 
-	GenerateHash(Hashlist, pFrom);
-	int aPastIndecies[1024];
-
-	// fetch previous indices
-	// we do this as a separate pass because it helps the cache
-	const int NumItems = pTo->NumItems();
-	for(i = 0; i < NumItems; i++)
-	{
-		pCurItem = pTo->GetItem(i); // O(1) .. O(n)
-		aPastIndecies[i] = GetItemIndexHashed(pCurItem->Key(), Hashlist); // O(n) .. O(n^n)
-	}
-
-	for(i = 0; i < NumItems; i++)
+	for(i = 0; i < pTo->NumItems(); i++)
 	{
 		// do delta
-		ItemSize = pTo->GetItemSize(i); // O(1) .. O(n)
-		pCurItem = pTo->GetItem(i); // O(1) .. O(n)
-		PastIndex = aPastIndecies[i];
+		ItemSize = pTo->GetItemSize(i);
+		pCurItem = pTo->GetItem(i);
+		PastIndex = pFromIndex ? pFromIndex->GetItemIndex(pFrom, pCurItem->Key()) : -1;
 
 		if(PastIndex != -1)
 		{
@@ -218,7 +292,7 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 			if(m_aItemSizes[pCurItem->Type()])
 				pItemDataDst = pData+2;
 
-			if(DiffItem((int*)pPastItem->Data(), (int*)pCurItem->Data(), pItemDataDst, ItemSize/4))
+			if(s_pfnDiffItem(pPastItem->Data(), pCurItem->Data(), pItemDataDst, ItemSize/4))
 			{
 
 				*pData++ = pCurItem->Type();
@@ -237,32 +311,11 @@ int CSnapshotDelta::CreateDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pDstData
 				*pData++ = ItemSize/4;
 
 			mem_copy(pData, pCurItem->Data(), ItemSize);
-			SizeCount += ItemSize;
 			pData += ItemSize/4;
 			pDelta->m_NumUpdateItems++;
-			Count++;
 		}
 	}
 
-	if(0)
-	{
-		dbg_msg("snapshot", "%d %d %d",
-			pDelta->m_NumDeletedItems,
-			pDelta->m_NumUpdateItems,
-			pDelta->m_NumTempItems);
-	}
-
-	/*
-	// TODO: pack temp stuff
-
-	// finish
-	//mem_copy(pDelta->offsets, deleted, pDelta->num_deleted_items*sizeof(int));
-	//mem_copy(&(pDelta->offsets[pDelta->num_deleted_items]), update, pDelta->num_update_items*sizeof(int));
-	//mem_copy(&(pDelta->offsets[pDelta->num_deleted_items+pDelta->num_update_items]), temp, pDelta->num_temp_items*sizeof(int));
-	//mem_copy(pDelta->data_start(), data, data_size);
-	//pDelta->data_size = data_size;
-	* */
-
 	if(!pDelta->m_NumDeletedItems && !pDelta->m_NumUpdateItems && !pDelta->m_NumTempItems)
 		return 0;
 
@@ -378,81 +431,140 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 
 // CSnapshotStorage
 
-void CSnapshotStorage::Init()
+CSnapshotStorage::CSnapshotStorage()
 {
-	m_pFirst = 0;
-	m_pLast = 0;
+	m_pArenaMemory = 0;
+	m_ArenaSize = 0;
+	m_NumGrows = 0;
+	Init();
 }
 
-void CSnapshotStorage::PurgeAll()
+CSnapshotStorage::~CSnapshotStorage()
 {
-	CHolder *pHolder = m_pFirst;
-	CHolder *pNext;
+	mem_free(m_pArenaMemory);
+}
 
-	while(pHolder)
+int CSnapshotStorage::HolderSize(int DataSize, int NumItems, int CreateAlt)
+{
+	// holder + snapshot_data (+ alt snapshot_data) + index
+	int TotalSize = sizeof(CHolder)+DataSize;
+	if(CreateAlt)
+		TotalSize += DataSize;
+	return TotalSize + CSnapshotIndex::MemSize(NumItems);
+}
+
+void CSnapshotStorage::SetupHolder(CHolder *pHolder, int DataSize, int CreateAlt)
+{
+	pHolder->m_SnapSize = DataSize;
+	pHolder->m_pSnap = (CSnapshot*)(pHolder+1);
+	pHolder->m_pAltSnap = CreateAlt ? (CSnapshot*)(((char *)pHolder->m_pSnap) + DataSize) : 0;
+	pHolder->m_pIndex = (CSnapshotIndex *)(((char *)pHolder->m_pSnap) + (CreateAlt ? 2*DataSize : DataSize));
+}
+
+void CSnapshotStorage::GrowArena(int MinSize)
+{
+	// the stored snapshots take up at most the old size, so they and
+	// the new one fit into the new block without wrapping around
+	int NewSize = max(m_ArenaSize*2, (int)ARENA_START_SIZE);
+	while(NewSize < m_ArenaSize+MinSize*2)
+		NewSize *= 2;
+
+	void *pNewMemory = mem_alloc(NewSize, 1);
+	TExternalRingBuffer<CHolder> NewArena;
+	NewArena.Init(pNewMemory, NewSize);
+
+	// move the snapshots over in order and fix up their pointers
+	CHolder *pPrev = 0;
+	for(CHolder *pHolder = m_pFirst; pHolder; pHolder = pHolder->m_pNext)
 	{
-		pNext = pHolder->m_pNext;
-		mem_free(pHolder);
-		pHolder = pNext;
+		int Size = HolderSize(pHolder->m_SnapSize, pHolder->m_pSnap->NumItems(), pHolder->m_pAltSnap != 0);
+		CHolder *pNew = NewArena.Allocate(Size);
+		dbg_assert(pNew != 0, "snapshot arena too small after growing");
+		mem_copy(pNew, pHolder, Size);
+		SetupHolder(pNew, pHolder->m_SnapSize, pHolder->m_pAltSnap != 0);
+
+		pNew->m_pNext = 0;
+		pNew->m_pPrev = pPrev;
+		if(pPrev)
+			pPrev->m_pNext = pNew;
+		else
+			m_pFirst = pNew;
+		pPrev = pNew;
 	}
+	m_pLast = pPrev;
 
-	// no more snapshots in storage
-	m_pFirst = 0;
-	m_pLast = 0;
+	mem_free(m_pArenaMemory);
+	m_pArenaMemory = pNewMemory;
+	m_ArenaSize = NewSize;
+	m_Arena = NewArena;
+	m_NumGrows++;
 }
 
-void CSnapshotStorage::PurgeUntil(int Tick)
+CSnapshotStorage::CHolder *CSnapshotStorage::AllocHolder(int Size)
 {
-	CHolder *pHolder = m_pFirst;
-	CHolder *pNext;
-
-	while(pHolder)
+	CHolder *pHolder = m_pArenaMemory ? m_Arena.Allocate(Size) : 0;
+	if(!pHolder)
 	{
-		pNext = pHolder->m_pNext;
-		if(pHolder->m_Tick >= Tick)
-			return; // no more to remove
-		mem_free(pHolder);
-
-		// did we come to the end of the list?
-		if (!pNext)
-			break;
+		GrowArena(Size);
+		pHolder = m_Arena.Allocate(Size);
+	}
+	m_UsedSize += Size;
+	m_NumSnapshots++;
+	return pHolder;
+}
 
-		m_pFirst = pNext;
-		pNext->m_pPrev = 0x0;
+void CSnapshotStorage::Init()
+{
+	PurgeAll();
+}
 
-		pHolder = pNext;
-	}
+void CSnapshotStorage::PurgeAll()
+{
+	// keep the arena for the next client in this slot
+	if(m_pArenaMemory)
+		m_Arena.Init(m_pArenaMemory, m_ArenaSize);
 
 	// no more snapshots in storage
 	m_pFirst = 0;
 	m_pLast = 0;
+	m_UsedSize = 0;
+	m_NumSnapshots = 0;
 }
 
-void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt)
+void CSnapshotStorage::PurgeUntil(int Tick)
 {
-	// allocate memory for holder + snapshot_data
-	int TotalSize = sizeof(CHolder)+DataSize;
+	// the oldest snapshot is always the first one in the arena
+	while(m_pFirst && m_pFirst->m_Tick < Tick)
+	{
+		CHolder *pNext = m_pFirst->m_pNext;
+		m_UsedSize -= HolderSize(m_pFirst->m_SnapSize, m_pFirst->m_pSnap->NumItems(), m_pFirst->m_pAltSnap != 0);
+		m_NumSnapshots--;
+		m_Arena.PopFirst();
 
-	if(CreateAlt)
-		TotalSize += DataSize;
+		m_pFirst = pNext;
+		if(pNext)
+			pNext->m_pPrev = 0x0;
+		else
+			m_pLast = 0; // no more snapshots in storage
+	}
+}
 
-	CHolder *pHolder = (CHolder *)mem_alloc(TotalSize, 1);
+void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt)
+{
+	int NumItems = ((CSnapshot *)pData)->NumItems();
+	CHolder *pHolder = AllocHolder(HolderSize(DataSize, NumItems, CreateAlt));
 
 	// set data
 	pHolder->m_Tick = Tick;
 	pHolder->m_Tagtime = Tagtime;
-	pHolder->m_SnapSize = DataSize;
-	pHolder->m_pSnap = (CSnapshot*)(pHolder+1);
+	SetupHolder(pHolder, DataSize, CreateAlt);
 	mem_copy(pHolder->m_pSnap, pData, DataSize);
 
 	if(CreateAlt) // create alternative if wanted
-	{
-		pHolder->m_pAltSnap = (CSnapshot*)(((char *)pHolder->m_pSnap) + DataSize);
 		mem_copy(pHolder->m_pAltSnap, pData, DataSize);
-	}
-	else
-		pHolder->m_pAltSnap = 0;
 
+	// index it once for all the deltas made against it
+	pHolder->m_pIndex->Build(pHolder->m_pSnap);
 
 	// link
 	pHolder->m_pNext = 0;
@@ -464,7 +576,7 @@ void CSnapshotStorage::Add(int Tick, int64 Tagtime, int DataSize, void *pData, i
 	m_pLast = pHolder;
 }
 
-int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData)
+int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData, CSnapshotIndex **ppIndex)
 {
 	CHolder *pHolder = m_pFirst;
 
@@ -478,6 +590,8 @@ int CSnapshotStorage::Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapsh
 				*ppData = pHolder->m_pSnap;
 			if(ppAltData)
 				*ppAltData = pHolder->m_pAltSnap;
+			if(ppIndex)
+				*ppIndex = pHolder->m_pIndex;
 			return pHolder->m_SnapSize;
 		}
 
@@ -5,6 +5,8 @@
 
 #include <base/system.h>
 
+#include "ringbuffer.h"
+
 // CSnapshot
 
 class CSnapshotItem
@@ -46,6 +48,51 @@ public:
 };
 
 
+// CSnapshotIndex
+
+/*
+	Class: CSnapshotIndex
+		Finds the items of one snapshot by key in constant time. The
+		snapshot storage keeps one next to every stored snapshot, so
+		deltas against it don't have to look its items up again.
+*/
+class CSnapshotIndex
+{
+	int m_Bits;
+
+	// followed by 1<<m_Bits item indices, -1 for a free slot
+	short *Slots() { return (short *)(this+1); }
+	const short *Slots() const { return (const short *)(this+1); }
+
+	static int NumBits(int NumItems);
+	int Slot(int Key) const { return (int)(((unsigned)Key*2654435761u)>>(32-m_Bits)); }
+
+public:
+	enum
+	{
+		MAX_ITEMS = CSnapshot::MAX_SIZE/8, // an item takes at least its offset and key
+		MAX_SIZE = sizeof(int) + MAX_ITEMS*2*sizeof(short), // m_Bits and the slots
+	};
+
+	static int MemSize(int NumItems);
+	void Build(CSnapshot *pSnap);
+	int GetItemIndex(CSnapshot *pSnap, int Key) const;
+};
+
+/*
+	Class: CSnapshotIndexBuffer
+		Room for the index of any snapshot. Whoever creates deltas
+		keeps one for <CSnapshotDelta::CreateDelta>, so that it is not
+		on the stack of every call.
+*/
+class CSnapshotIndexBuffer
+{
+	int m_aData[CSnapshotIndex::MAX_SIZE/sizeof(int)];
+public:
+	CSnapshotIndex *Index() { return (CSnapshotIndex *)m_aData; }
+};
+
+
 // CSnapshotDelta
 
 class CSnapshotDelta
@@ -76,8 +123,24 @@ public:
 	int GetDataUpdates(int Index) { return m_aSnapshotDataUpdates[Index]; }
 	void SetStaticsize(int ItemType, int Size);
 	CData *EmptyDelta();
-	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
+
+	/*
+		Function: CreateDelta
+			Writes the delta from pFrom to pTo to pData and returns its
+			size, 0 when they are the same. pFromIndex is the index of
+			pFrom and may only be 0 when pFrom has no items. The index of
+			pTo is built in pToIndexBuffer.
+	*/
+	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, const CSnapshotIndex *pFromIndex, CSnapshotIndexBuffer *pToIndexBuffer);
 	int UnpackDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, int DataSize);
+
+	/*
+		Function: DiffItem
+			Writes pCurrent-pPast of Size ints to pOut with the given
+			<CVariableInt> kernel and returns nonzero when they differ.
+			Deltas use the best kernel this machine supports.
+	*/
+	static int DiffItem(int Kernel, const int *pPast, const int *pCurrent, int *pOut, int Size);
 };
 
 
@@ -98,17 +161,52 @@ public:
 		int m_SnapSize;
 		CSnapshot *m_pSnap;
 		CSnapshot *m_pAltSnap;
+		CSnapshotIndex *m_pIndex;
+	};
+
+
+	enum
+	{
+		ARENA_START_SIZE=64*1024,
 	};
 
+private:
+	/*
+		Snapshots are added and purged in tick order, so they live in a
+		ring on one block of memory. The block is only replaced by one
+		twice as big when a snapshot does not fit; after a few seconds
+		of play it covers the retention window and the general allocator
+		is not used anymore.
+	*/
+	TExternalRingBuffer<CHolder> m_Arena;
+	void *m_pArenaMemory;
+	int m_ArenaSize;
+	int m_UsedSize;
+	int m_NumSnapshots;
+	int m_NumGrows;
+
+	static int HolderSize(int DataSize, int NumItems, int CreateAlt);
+	static void SetupHolder(CHolder *pHolder, int DataSize, int CreateAlt);
+	CHolder *AllocHolder(int Size);
+	void GrowArena(int MinSize);
 
+public:
 	CHolder *m_pFirst;
 	CHolder *m_pLast;
 
+	CSnapshotStorage();
+	~CSnapshotStorage();
+
 	void Init();
 	void PurgeAll();
 	void PurgeUntil(int Tick);
 	void Add(int Tick, int64 Tagtime, int DataSize, void *pData, int CreateAlt);
-	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData);
+	int Get(int Tick, int64 *pTagtime, CSnapshot **ppData, CSnapshot **ppAltData, CSnapshotIndex **ppIndex = 0);
+
+	int NumSnapshots() const { return m_NumSnapshots; }
+	int ArenaSize() const { return m_ArenaSize; }
+	int UsedSize() const { return m_UsedSize; }
+	int NumGrows() const { return m_NumGrows; }
 };
 
 class CSnapshotBuilder
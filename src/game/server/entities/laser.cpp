@@ -4,6 +4,8 @@
 #include <game/server/gamecontext.h>
 #include "laser.h"
 
+MACRO_ALLOC_POOL_IMPL(CLaser, 64)
+
 CLaser::CLaser(CGameWorld *pGameWorld, vec2 Pos, vec2 Direction, float StartEnergy, int Owner)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_LASER)
 {
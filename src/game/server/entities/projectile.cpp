@@ -4,13 +4,197 @@
 #include <game/server/gamecontext.h>
 #include "projectile.h"
 
+MACRO_ALLOC_POOL_IMPL(CProjectile, 256)
+
+/*
+	Class: Projectile batch
+		Flight state of all projectiles as flat arrays. Slots are
+		appended on creation and compacted once per tick, so the
+		slot order is the creation order and the positions of every
+		projectile can be evaluated in one tight loop.
+*/
+class CProjectileBatch
+{
+	template<typename T>
+	static void Grow(T **ppData, int Num, int Capacity)
+	{
+		T *pNew = (T *)mem_alloc(sizeof(T)*Capacity, sizeof(void *));
+		if(*ppData)
+		{
+			mem_copy(pNew, *ppData, sizeof(T)*Num);
+			mem_free(*ppData);
+		}
+		*ppData = pNew;
+	}
+
+public:
+	enum
+	{
+		FIELD_POSX=0,
+		FIELD_POSY,
+		FIELD_DIRX,
+		FIELD_DIRY,
+		FIELD_CURVATURE,
+		FIELD_SPEED,
+		FIELD_PREVX,
+		FIELD_PREVY,
+		FIELD_CURX,
+		FIELD_CURY,
+		NUM_FIELDS
+	};
+
+	float *m_apFields[NUM_FIELDS];
+	int *m_pStartTick;
+	int *m_pType;
+	CProjectile **m_ppProjectiles;
+	int m_Num;
+	int m_Capacity;
+	bool m_HasHoles;
+
+	// tuning that the curvature and speed fields were filled from
+	float m_aCurvature[NUM_WEAPONS];
+	float m_aSpeed[NUM_WEAPONS];
+
+	CProjectileBatch()
+	{
+		for(int f = 0; f < NUM_FIELDS; f++)
+			m_apFields[f] = 0;
+		m_pStartTick = 0;
+		m_pType = 0;
+		m_ppProjectiles = 0;
+		m_Num = 0;
+		m_Capacity = 0;
+		m_HasHoles = false;
+		mem_zero(m_aCurvature, sizeof(m_aCurvature));
+		mem_zero(m_aSpeed, sizeof(m_aSpeed));
+	}
+
+	~CProjectileBatch()
+	{
+		for(int f = 0; f < NUM_FIELDS; f++)
+			mem_free(m_apFields[f]);
+		mem_free(m_pStartTick);
+		mem_free(m_pType);
+		mem_free(m_ppProjectiles);
+	}
+
+	vec2 Get(int FieldX, int Index) const { return vec2(m_apFields[FieldX][Index], m_apFields[FieldX+1][Index]); }
+	void Set(int FieldX, int Index, vec2 Value) { m_apFields[FieldX][Index] = Value.x; m_apFields[FieldX+1][Index] = Value.y; }
+
+	int Add(CProjectile *pProj, int Type, vec2 Pos, vec2 Dir, int StartTick)
+	{
+		if(m_Num == m_Capacity)
+		{
+			int Capacity = max(256, m_Capacity*2);
+			for(int f = 0; f < NUM_FIELDS; f++)
+				Grow(&m_apFields[f], m_Num, Capacity);
+			Grow(&m_pStartTick, m_Num, Capacity);
+			Grow(&m_pType, m_Num, Capacity);
+			Grow(&m_ppProjectiles, m_Num, Capacity);
+			m_Capacity = Capacity;
+		}
+
+		int Index = m_Num++;
+		Set(FIELD_POSX, Index, Pos);
+		Set(FIELD_DIRX, Index, Dir);
+		m_apFields[FIELD_CURVATURE][Index] = m_aCurvature[Type];
+		m_apFields[FIELD_SPEED][Index] = m_aSpeed[Type];
+		m_pStartTick[Index] = StartTick;
+		m_pType[Index] = Type;
+		m_ppProjectiles[Index] = pProj;
+		return Index;
+	}
+
+	void Remove(int Index)
+	{
+		// keep the creation order, the hole is closed on the next tick
+		m_ppProjectiles[Index] = 0;
+		m_HasHoles = true;
+	}
+
+	void Compact()
+	{
+		if(!m_HasHoles)
+			return;
+
+		int Num = 0;
+		for(int i = 0; i < m_Num; i++)
+		{
+			if(!m_ppProjectiles[i])
+				continue;
+			if(Num != i)
+			{
+				for(int f = 0; f < NUM_FIELDS; f++)
+					m_apFields[f][Num] = m_apFields[f][i];
+				m_pStartTick[Num] = m_pStartTick[i];
+				m_pType[Num] = m_pType[i];
+				m_ppProjectiles[Num] = m_ppProjectiles[i];
+				m_ppProjectiles[Num]->m_BatchIndex = Num;
+			}
+			Num++;
+		}
+		m_Num = Num;
+		m_HasHoles = false;
+	}
+
+	void UpdateTuning(CTuningParams *pTuning)
+	{
+		float aCurvature[NUM_WEAPONS] = {0};
+		float aSpeed[NUM_WEAPONS] = {0};
+		aCurvature[WEAPON_GRENADE] = pTuning->m_GrenadeCurvature;
+		aSpeed[WEAPON_GRENADE] = pTuning->m_GrenadeSpeed;
+		aCurvature[WEAPON_SHOTGUN] = pTuning->m_ShotgunCurvature;
+		aSpeed[WEAPON_SHOTGUN] = pTuning->m_ShotgunSpeed;
+		aCurvature[WEAPON_GUN] = pTuning->m_GunCurvature;
+		aSpeed[WEAPON_GUN] = pTuning->m_GunSpeed;
+
+		if(mem_comp(aCurvature, m_aCurvature, sizeof(aCurvature)) == 0 && mem_comp(aSpeed, m_aSpeed, sizeof(aSpeed)) == 0)
+			return;
+
+		// projectiles in flight follow tuning changes right away
+		mem_copy(m_aCurvature, aCurvature, sizeof(aCurvature));
+		mem_copy(m_aSpeed, aSpeed, sizeof(aSpeed));
+		for(int i = 0; i < m_Num; i++)
+		{
+			m_apFields[FIELD_CURVATURE][i] = m_aCurvature[m_pType[i]];
+			m_apFields[FIELD_SPEED][i] = m_aSpeed[m_pType[i]];
+		}
+	}
+
+	void Advance(int Tick, int TickSpeed)
+	{
+		const float *pPosX = m_apFields[FIELD_POSX];
+		const float *pPosY = m_apFields[FIELD_POSY];
+		const float *pDirX = m_apFields[FIELD_DIRX];
+		const float *pDirY = m_apFields[FIELD_DIRY];
+		const float *pCurvature = m_apFields[FIELD_CURVATURE];
+		const float *pSpeed = m_apFields[FIELD_SPEED];
+		float *pPrevX = m_apFields[FIELD_PREVX];
+		float *pPrevY = m_apFields[FIELD_PREVY];
+		float *pCurX = m_apFields[FIELD_CURX];
+		float *pCurY = m_apFields[FIELD_CURY];
+
+		// same arithmetic as CalcPos, but branch free so that it vectorizes
+		for(int i = 0; i < m_Num; i++)
+		{
+			float Pt = (Tick-m_pStartTick[i]-1)/(float)TickSpeed*pSpeed[i];
+			float Ct = (Tick-m_pStartTick[i])/(float)TickSpeed*pSpeed[i];
+			pPrevX[i] = pPosX[i] + pDirX[i]*Pt;
+			pPrevY[i] = pPosY[i] + pDirY[i]*Pt + pCurvature[i]/10000*(Pt*Pt);
+			pCurX[i] = pPosX[i] + pDirX[i]*Ct;
+			pCurY[i] = pPosY[i] + pDirY[i]*Ct + pCurvature[i]/10000*(Ct*Ct);
+		}
+	}
+};
+
+static CProjectileBatch gs_ProjectileBatch;
+
 CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_PROJECTILE)
 {
 	m_Type = Type;
 	m_Pos = Pos;
-	m_Direction = Dir;
 	m_StartLifeSpan = Span;
 	m_LifeSpan = Span;
 	m_Owner = Owner;
@@ -19,12 +203,19 @@ CProjectile::CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos,
 	m_Damage = Damage;
 	m_SoundImpact = SoundImpact;
 	m_Weapon = Weapon;
-	m_StartTick = Server()->Tick();
 	m_Explosive = Explosive;
 
+	gs_ProjectileBatch.UpdateTuning(GameServer()->Tuning());
+	m_BatchIndex = gs_ProjectileBatch.Add(this, Type, Pos, Dir, Server()->Tick());
+
 	GameWorld()->InsertEntity(this);
 }
 
+CProjectile::~CProjectile()
+{
+	gs_ProjectileBatch.Remove(m_BatchIndex);
+}
+
 void CProjectile::Reset()
 {
 	GameServer()->m_World.DestroyEntity(this);
@@ -32,37 +223,29 @@ void CProjectile::Reset()
 
 vec2 CProjectile::GetPos(float Time)
 {
-	float Curvature = 0;
-	float Speed = 0;
+	return CalcPos(m_Pos, gs_ProjectileBatch.Get(CProjectileBatch::FIELD_DIRX, m_BatchIndex),
+		gs_ProjectileBatch.m_apFields[CProjectileBatch::FIELD_CURVATURE][m_BatchIndex],
+		gs_ProjectileBatch.m_apFields[CProjectileBatch::FIELD_SPEED][m_BatchIndex], Time);
+}
+
+void CProjectile::TickAll(CGameWorld *pGameWorld)
+{
+	CProjectileBatch *pBatch = &gs_ProjectileBatch;
 
-	switch(m_Type)
+	pBatch->Compact();
+	pBatch->UpdateTuning(pGameWorld->GameServer()->Tuning());
+	pBatch->Advance(pGameWorld->Server()->Tick(), pGameWorld->Server()->TickSpeed());
+
+	// newest first like the entity list, projectiles fired during this pass wait for the next tick
+	for(int i = pBatch->m_Num-1; i >= 0; i--)
 	{
-		case WEAPON_GRENADE:
-			Curvature = GameServer()->Tuning()->m_GrenadeCurvature;
-			Speed = GameServer()->Tuning()->m_GrenadeSpeed;
-			break;
-
-		case WEAPON_SHOTGUN:
-			Curvature = GameServer()->Tuning()->m_ShotgunCurvature;
-			Speed = GameServer()->Tuning()->m_ShotgunSpeed;
-			break;
-
-		case WEAPON_GUN:
-			Curvature = GameServer()->Tuning()->m_GunCurvature;
-			Speed = GameServer()->Tuning()->m_GunSpeed;
-			break;
+		if(pBatch->m_ppProjectiles[i])
+			pBatch->m_ppProjectiles[i]->HandleFlight(pBatch->Get(CProjectileBatch::FIELD_PREVX, i), pBatch->Get(CProjectileBatch::FIELD_CURX, i));
 	}
-
-	return CalcPos(m_Pos, m_Direction, Curvature, Speed, Time);
 }
 
-
-void CProjectile::Tick()
+void CProjectile::HandleFlight(vec2 PrevPos, vec2 CurPos)
 {
-	float Pt = (Server()->Tick()-m_StartTick-1)/(float)Server()->TickSpeed();
-	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
-	vec2 PrevPos = GetPos(Pt);
-	vec2 CurPos = GetPos(Ct);
 	int Collide = GameServer()->Collision()->IntersectLine(PrevPos, CurPos, &CurPos, 0);
 	CCharacter *OwnerChar = GameServer()->GetPlayerChar(m_Owner);
 	CCharacter *TargetChr = GameServer()->m_World.IntersectCharacter(PrevPos, CurPos, 6.0f, CurPos, OwnerChar);
@@ -84,7 +267,7 @@ void CProjectile::Tick()
 			GameServer()->CreateExplosion(CurPos, m_Owner, m_Weapon, false);
 
 			else if(TargetChr)
-				TargetChr->TakeDamage(m_Direction * max(0.001f, m_Force), m_Damage, m_Owner, m_Weapon);
+				TargetChr->TakeDamage(gs_ProjectileBatch.Get(CProjectileBatch::FIELD_DIRX, m_BatchIndex) * max(0.001f, m_Force), m_Damage, m_Owner, m_Weapon);
 
 			else if(TargetTower)
 				TargetTower->TakeDamage(m_Damage, m_Owner);
@@ -96,15 +279,15 @@ void CProjectile::Tick()
 
 void CProjectile::TickPaused()
 {
-	++m_StartTick;
+	++gs_ProjectileBatch.m_pStartTick[m_BatchIndex];
 }
 
 void CProjectile::DoBounce()
 {
-	float Pt = (Server()->Tick()-m_StartTick-1)/(float)Server()->TickSpeed();
-	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
-	vec2 PrevPos = GetPos(Pt);
-	vec2 CurPos = GetPos(Ct);
+	CProjectileBatch *pBatch = &gs_ProjectileBatch;
+	float Ct = (Server()->Tick()-pBatch->m_pStartTick[m_BatchIndex])/(float)Server()->TickSpeed();
+	vec2 PrevPos = pBatch->Get(CProjectileBatch::FIELD_PREVX, m_BatchIndex);
+	vec2 CurPos = pBatch->Get(CProjectileBatch::FIELD_CURX, m_BatchIndex);
 	vec2 CollisionPos;
 	CollisionPos.x = PrevPos.x;
 	CollisionPos.y = CurPos.y;
@@ -114,38 +297,36 @@ void CProjectile::DoBounce()
 	int CollideX = GameServer()->Collision()->IntersectLine(PrevPos, CollisionPos, NULL, NULL);
 	
 	m_Pos = PrevPos;
+	vec2 Direction = pBatch->Get(CProjectileBatch::FIELD_DIRX, m_BatchIndex);
 	vec2 vel;
-	float Curvature, Speed;
-	switch (m_Type)
-	{
-		case WEAPON_GUN: Curvature = GameServer()->Tuning()->m_GunCurvature; Speed = GameServer()->Tuning()->m_GunSpeed; break;
-		case WEAPON_SHOTGUN: Curvature = GameServer()->Tuning()->m_ShotgunCurvature; Speed = GameServer()->Tuning()->m_ShotgunSpeed; break;
-		case WEAPON_GRENADE: Curvature = GameServer()->Tuning()->m_GrenadeCurvature; Speed = GameServer()->Tuning()->m_GrenadeSpeed; break;
-	}
-	vel.x = m_Direction.x;
-	vel.y = m_Direction.y + 2*Curvature/10000*Ct*Speed;
+	float Curvature = pBatch->m_apFields[CProjectileBatch::FIELD_CURVATURE][m_BatchIndex];
+	float Speed = pBatch->m_apFields[CProjectileBatch::FIELD_SPEED][m_BatchIndex];
+	vel.x = Direction.x;
+	vel.y = Direction.y + 2*Curvature/10000*Ct*Speed;
 
 	if (CollideX && !CollideY)
 	{
-		m_Direction.x = -vel.x;
-		m_Direction.y = vel.y;
+		Direction.x = -vel.x;
+		Direction.y = vel.y;
 	}
 	else if (!CollideX && CollideY)
 	{
-		m_Direction.x = vel.x;
-		m_Direction.y = -vel.y;
+		Direction.x = vel.x;
+		Direction.y = -vel.y;
 	}
 	else
 	{
-		m_Direction.x = -vel.x;
-		m_Direction.y = -vel.y;
+		Direction.x = -vel.x;
+		Direction.y = -vel.y;
 	}
 	m_LifeSpan = m_StartLifeSpan/2;
 	m_StartLifeSpan /= 2;
 	
-	m_Direction.x *= (100 - 50) / 100.0;
-	m_Direction.y *= (100 - 50) / 100.0;
-	m_StartTick = Server()->Tick();
+	Direction.x *= (100 - 50) / 100.0;
+	Direction.y *= (100 - 50) / 100.0;
+	pBatch->Set(CProjectileBatch::FIELD_POSX, m_BatchIndex, m_Pos);
+	pBatch->Set(CProjectileBatch::FIELD_DIRX, m_BatchIndex, Direction);
+	pBatch->m_pStartTick[m_BatchIndex] = Server()->Tick();
 
 	m_Team = !m_Team;
 	m_Owner = m_Team ? CLIENTID_BLUE : CLIENTID_RED;
@@ -153,19 +334,24 @@ void CProjectile::DoBounce()
 
 void CProjectile::FillInfo(CNetObj_Projectile *pProj)
 {
+	vec2 Direction = gs_ProjectileBatch.Get(CProjectileBatch::FIELD_DIRX, m_BatchIndex);
 	pProj->m_X = (int)m_Pos.x;
 	pProj->m_Y = (int)m_Pos.y;
-	pProj->m_VelX = (int)(m_Direction.x*100.0f);
-	pProj->m_VelY = (int)(m_Direction.y*100.0f);
-	pProj->m_StartTick = m_StartTick;
+	pProj->m_VelX = (int)(Direction.x*100.0f);
+	pProj->m_VelY = (int)(Direction.y*100.0f);
+	pProj->m_StartTick = gs_ProjectileBatch.m_pStartTick[m_BatchIndex];
 	pProj->m_Type = m_Type;
 }
 
-void CProjectile::Snap(int SnappingClient)
+vec2 CProjectile::IndexPos()
 {
-	float Ct = (Server()->Tick()-m_StartTick)/(float)Server()->TickSpeed();
+	float Ct = (Server()->Tick()-gs_ProjectileBatch.m_pStartTick[m_BatchIndex])/(float)Server()->TickSpeed();
+	return GetPos(Ct);
+}
 
-	if(NetworkClipped(SnappingClient, GetPos(Ct)))
+void CProjectile::Snap(int SnappingClient)
+{
+	if(NetworkClipped(SnappingClient, IndexPos()))
 		return;
 
 	CNetObj_Projectile *pProj = static_cast<CNetObj_Projectile *>(Server()->SnapNewItem(NETOBJTYPE_PROJECTILE, m_ID, sizeof(CNetObj_Projectile)));
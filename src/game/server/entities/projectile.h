@@ -5,21 +5,36 @@
 
 class CProjectile : public CEntity
 {
+	MACRO_ALLOC_POOL()
+
+	friend class CProjectileBatch;
+
 public:
 	CProjectile(CGameWorld *pGameWorld, int Type, int Owner, vec2 Pos, vec2 Dir, int Span,
 		int Damage, bool Explosive, float Force, int SoundImpact, int Weapon);
+	virtual ~CProjectile();
 
 	vec2 GetPos(float Time);
 	void DoBounce();
 	void FillInfo(CNetObj_Projectile *pProj);
 
+	/*
+		Function: TickAll
+			Advances all projectiles of the world in one pass and
+			resolves their hits in the same order as the entity list.
+	*/
+	static void TickAll(CGameWorld *pGameWorld);
+
 	virtual void Reset();
-	virtual void Tick();
 	virtual void TickPaused();
 	virtual void Snap(int SnappingClient);
+	virtual vec2 IndexPos();
 
 private:
-	vec2 m_Direction;
+	void HandleFlight(vec2 PrevPos, vec2 CurPos);
+
+	// direction, start tick and flight path live in the projectile batch
+	int m_BatchIndex;
 	int m_StartLifeSpan;
 	int m_LifeSpan;
 	int m_Owner;
@@ -29,7 +44,6 @@ private:
 	int m_SoundImpact;
 	int m_Weapon;
 	float m_Force;
-	int m_StartTick;
 	bool m_Explosive;
 };
 
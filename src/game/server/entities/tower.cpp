@@ -5,6 +5,8 @@
 
 #include "tower.h"
 
+MACRO_ALLOC_POOL_IMPL(CTower, 4)
+
 CTower::CTower(CGameWorld *pGameWorld, vec2 Pos, int Team)
 : CEntity(pGameWorld, CGameWorld::ENTTYPE_TOWER)
 {
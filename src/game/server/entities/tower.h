@@ -9,6 +9,8 @@
 
 class CTower : public CEntity
 {
+	MACRO_ALLOC_POOL()
+
 public:
 	static const int ms_PhysSize = 128;
 
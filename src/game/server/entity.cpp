@@ -21,6 +21,9 @@ CEntity::CEntity(CGameWorld *pGameWorld, int ObjType)
 
 	m_pPrevTypeEntity = 0;
 	m_pNextTypeEntity = 0;
+	m_pPrevCellEntity = 0;
+	m_pNextCellEntity = 0;
+	m_GridCell = -1;
 }
 
 CEntity::~CEntity()
@@ -36,22 +39,82 @@ int CEntity::NetworkClipped(int SnappingClient)
 
 int CEntity::NetworkClipped(int SnappingClient, vec2 CheckPos)
 {
-	if(SnappingClient == -1)
-		return 0;
-
-	float dx = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos.x-CheckPos.x;
-	float dy = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos.y-CheckPos.y;
-
-	if(absolute(dx) > 1000.0f || absolute(dy) > 800.0f)
-		return 1;
-
-	if(distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, CheckPos) > 1100.0f)
-		return 1;
-	return 0;
+	return GameWorld()->NetworkClipped(SnappingClient, CheckPos);
 }
 
 bool CEntity::GameLayerClipped(vec2 CheckPos)
 {
 	return round_to_int(CheckPos.x)/32 < -200 || round_to_int(CheckPos.x)/32 > GameServer()->Collision()->GetWidth()+200 ||
 			round_to_int(CheckPos.y)/32 < -200 || round_to_int(CheckPos.y)/32 > GameServer()->Collision()->GetHeight()+200 ? true : false;
-}
\ No newline at end of file
+}
+//////////////////////////////////////////////////
+// Entity pool
+//////////////////////////////////////////////////
+CEntityPool *CEntityPool::ms_pFirstPool = 0;
+
+CEntityPool::CEntityPool(const char *pName, int ObjSize, int ChunkSize)
+{
+	m_pName = pName;
+	// free slots keep the next free slot in their first bytes
+	m_ObjSize = max(ObjSize, (int)sizeof(void *));
+	m_ChunkSize = ChunkSize;
+
+	m_pFirstChunk = 0;
+	m_pFirstFree = 0;
+
+	m_NumUsed = 0;
+	m_NumPeak = 0;
+	m_NumChunks = 0;
+	m_NumAllocs = 0;
+
+	m_pNextPool = ms_pFirstPool;
+	ms_pFirstPool = this;
+}
+
+CEntityPool::~CEntityPool()
+{
+	while(m_pFirstChunk)
+	{
+		CChunk *pChunk = m_pFirstChunk;
+		m_pFirstChunk = pChunk->m_pNext;
+		mem_free(pChunk);
+	}
+}
+
+void *CEntityPool::Alloc()
+{
+	if(!m_pFirstFree)
+	{
+		// out of slots, grab a new chunk and thread it into the free list
+		CChunk *pChunk = (CChunk *)mem_alloc(sizeof(CChunk)+m_ObjSize*m_ChunkSize, sizeof(void *));
+		pChunk->m_pNext = m_pFirstChunk;
+		m_pFirstChunk = pChunk;
+		m_NumChunks++;
+
+		char *pSlots = (char *)(pChunk+1);
+		for(int i = m_ChunkSize-1; i >= 0; i--)
+		{
+			*(void **)&pSlots[i*m_ObjSize] = m_pFirstFree;
+			m_pFirstFree = &pSlots[i*m_ObjSize];
+		}
+	}
+
+	void *pPtr = m_pFirstFree;
+	m_pFirstFree = *(void **)pPtr;
+
+	m_NumAllocs++;
+	m_NumUsed++;
+	if(m_NumUsed > m_NumPeak)
+		m_NumPeak = m_NumUsed;
+	return pPtr;
+}
+
+void CEntityPool::Free(void *pPtr)
+{
+	if(!pPtr)
+		return;
+
+	*(void **)pPtr = m_pFirstFree;
+	m_pFirstFree = pPtr;
+	m_NumUsed--;
+}
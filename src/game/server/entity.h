@@ -50,6 +50,73 @@
 		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
 	}
 
+/*
+	Class: Entity pool
+		Free list allocator for one entity type. Memory is taken
+		from the heap in chunks and never handed back, so entities
+		that are created and destroyed all the time only reuse
+		their old slots.
+*/
+class CEntityPool
+{
+	struct CChunk
+	{
+		CChunk *m_pNext;
+	};
+
+	const char *m_pName;
+	int m_ObjSize;
+	int m_ChunkSize;
+
+	CChunk *m_pFirstChunk;
+	void *m_pFirstFree;
+
+	int m_NumUsed;
+	int m_NumPeak;
+	int m_NumChunks;
+	int m_NumAllocs;
+
+	CEntityPool *m_pNextPool;
+	static CEntityPool *ms_pFirstPool;
+
+public:
+	CEntityPool(const char *pName, int ObjSize, int ChunkSize);
+	~CEntityPool();
+
+	void *Alloc();
+	void Free(void *pPtr);
+
+	static CEntityPool *First() { return ms_pFirstPool; }
+	CEntityPool *Next() const { return m_pNextPool; }
+
+	const char *Name() const { return m_pName; }
+	int NumUsed() const { return m_NumUsed; }
+	int NumPeak() const { return m_NumPeak; }
+	int Capacity() const { return m_NumChunks*m_ChunkSize; }
+	int NumChunks() const { return m_NumChunks; }
+	int NumAllocs() const { return m_NumAllocs; }
+};
+
+#define MACRO_ALLOC_POOL() \
+	public: \
+	void *operator new(size_t Size); \
+	void operator delete(void *p); \
+	private:
+
+#define MACRO_ALLOC_POOL_IMPL(POOLTYPE, ChunkSize) \
+	static CEntityPool gs_Pool##POOLTYPE(#POOLTYPE, sizeof(POOLTYPE), ChunkSize); \
+	void *POOLTYPE::operator new(size_t Size) \
+	{ \
+		dbg_assert(sizeof(POOLTYPE) == Size, "size error"); \
+		void *p = gs_Pool##POOLTYPE.Alloc(); \
+		mem_zero(p, Size); \
+		return p; \
+	} \
+	void POOLTYPE::operator delete(void *p) \
+	{ \
+		gs_Pool##POOLTYPE.Free(p); \
+	}
+
 /*
 	Class: Entity
 		Basic entity class.
@@ -61,6 +128,9 @@ class CEntity
 	friend class CGameWorld;	// entity list handling
 	CEntity *m_pPrevTypeEntity;
 	CEntity *m_pNextTypeEntity;
+	CEntity *m_pPrevCellEntity;
+	CEntity *m_pNextCellEntity;
+	int m_GridCell;
 
 	class CGameWorld *m_pGameWorld;
 protected:
@@ -143,6 +213,14 @@ public:
 
 	bool GameLayerClipped(vec2 CheckPos);
 
+	/*
+		Function: index_pos
+			Position the entity is filed under in the world grid.
+			Entities that are not drawn at m_Pos override it, so
+			that the snapshot finds them where the clients see them.
+	*/
+	virtual vec2 IndexPos() { return m_Pos; }
+
 	/*
 		Variable: proximity_radius
 			Contains the physical size of the entity.
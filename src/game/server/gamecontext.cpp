@@ -3,6 +3,7 @@
 #include <new>
 #include <base/math.h>
 #include <engine/shared/config.h>
+#include <engine/shared/profiler.h>
 #include <engine/map.h>
 #include <engine/console.h>
 #include "gamecontext.h"
@@ -268,7 +269,7 @@ void CGameContext::SendChatTarget(int To, const char *pText, ...)
 		if(m_apPlayers[i])
 		{
 			Buffer.clear();
-			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguage(), pText, VarArgs);
+			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguageHandle(), pText, VarArgs);
 			
 			Msg.m_pMessage = Buffer.buffer();
 			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
@@ -362,7 +363,7 @@ void CGameContext::SendBroadcast_VL(const char *pText, int ClientID, ...)
 		if(m_apPlayers[i])
 		{
 			Buffer.clear();
-			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguage(), _(pText), VarArgs);
+			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguageHandle(), _(pText), VarArgs);
 			
 			Msg.m_pMessage = Buffer.buffer();
 			Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
@@ -488,11 +489,16 @@ void CGameContext::OnTick()
 
 	// copy tuning
 	m_World.m_Core.m_Tuning = m_Tuning;
+	g_Profiler.Begin(CProfiler::SCOPE_TICK_WORLD);
 	m_World.Tick();
+	g_Profiler.End(CProfiler::SCOPE_TICK_WORLD);
 
 	//if(world.paused) // make sure that the game object always updates
+	g_Profiler.Begin(CProfiler::SCOPE_TICK_CONTROLLER);
 	m_pController->Tick();
+	g_Profiler.End(CProfiler::SCOPE_TICK_CONTROLLER);
 
+	g_Profiler.Begin(CProfiler::SCOPE_TICK_PLAYERS);
 	for(int i = 0; i < MAX_CLIENTS; i++)
 	{
 		if(m_apPlayers[i])
@@ -506,8 +512,10 @@ void CGameContext::OnTick()
 			m_DmgSound[i] = false;
 		}
 	}
+	g_Profiler.End(CProfiler::SCOPE_TICK_PLAYERS);
 
 	// update voting
+	g_Profiler.Begin(CProfiler::SCOPE_TICK_VOTING);
 	if(m_VoteCloseTime)
 	{
 		// abort the kick-vote on player-leave
@@ -591,6 +599,7 @@ void CGameContext::OnTick()
 			}
 		}
 	}
+	g_Profiler.End(CProfiler::SCOPE_TICK_VOTING);
 
 
 #ifdef CONF_DEBUG
@@ -1187,6 +1196,19 @@ void CGameContext::ConTuneDump(IConsole::IResult *pResult, void *pUserData)
 	}
 }
 
+void CGameContext::ConDumpEntityPools(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	for(CEntityPool *pPool = CEntityPool::First(); pPool; pPool = pPool->Next())
+	{
+		str_format(aBuf, sizeof(aBuf), "%s used=%d peak=%d capacity=%d chunks=%d allocs=%d (%d without heap allocation)",
+			pPool->Name(), pPool->NumUsed(), pPool->NumPeak(), pPool->Capacity(), pPool->NumChunks(),
+			pPool->NumAllocs(), pPool->NumAllocs()-pPool->NumChunks());
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "pools", aBuf);
+	}
+}
+
 void CGameContext::ConPause(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
@@ -1682,7 +1704,7 @@ void CGameContext::AddVote_VL(int To, const char* aCmd, const char* pText, ...)
 		if(m_apPlayers[i])
 		{
 			Buffer.clear();
-			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguage(), pText, VarArgs);
+			Server()->Localization()->Format_VL(Buffer, m_apPlayers[i]->GetLanguageHandle(), pText, VarArgs);
 			AddVote(Buffer.buffer(), aCmd, i);
 		}
 	}
@@ -1775,6 +1797,7 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("tune", "si", CFGFLAG_SERVER, ConTuneParam, this, "Tune variable to value");
 	Console()->Register("tune_reset", "", CFGFLAG_SERVER, ConTuneReset, this, "Reset tuning");
 	Console()->Register("tune_dump", "", CFGFLAG_SERVER, ConTuneDump, this, "Dump tuning");
+	Console()->Register("dump_entity_pools", "", CFGFLAG_SERVER, ConDumpEntityPools, this, "Dump occupancy of the entity pools");
 
 	Console()->Register("pause", "", CFGFLAG_SERVER, ConPause, this, "Pause/unpause game");
 	Console()->Register("change_map", "?r", CFGFLAG_SERVER|CFGFLAG_STORE, ConChangeMap, this, "Change map");
@@ -1811,6 +1834,7 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 
 	m_Layers.Init(Kernel());
 	m_Collision.Init(&m_Layers);
+	m_World.InitGrid(m_Collision.GetWidth(), m_Collision.GetHeight());
 
 	// reset everything here
 	//world = new GAMEWORLD;
@@ -1892,7 +1916,10 @@ void CGameContext::OnSnap(int ClientID)
 			m_apPlayers[i]->Snap(ClientID);
 	}
 }
-void CGameContext::OnPreSnap() {}
+void CGameContext::OnPreSnap()
+{
+	m_World.PreSnap();
+}
 void CGameContext::OnPostSnap()
 {
 	m_Events.Clear();
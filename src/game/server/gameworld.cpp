@@ -4,6 +4,7 @@
 #include "gameworld.h"
 #include "entity.h"
 #include "gamecontext.h"
+#include "entities/projectile.h"
 
 #include <algorithm>
 #include <utility>
@@ -20,7 +21,14 @@ CGameWorld::CGameWorld()
 	m_Paused = false;
 	m_ResetRequested = false;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
+	{
 		m_apFirstEntityTypes[i] = 0;
+		m_aGridMaxRadius[i] = 0;
+	}
+
+	m_apGridCells = 0;
+	m_GridWidth = 0;
+	m_GridHeight = 0;
 }
 
 CGameWorld::~CGameWorld()
@@ -29,6 +37,9 @@ CGameWorld::~CGameWorld()
 	for(int i = 0; i < NUM_ENTTYPES; i++)
 		while(m_apFirstEntityTypes[i])
 			delete m_apFirstEntityTypes[i];
+
+	if(m_apGridCells)
+		mem_free(m_apGridCells);
 }
 
 void CGameWorld::SetGameServer(CGameContext *pGameServer)
@@ -42,23 +53,105 @@ CEntity *CGameWorld::FindFirst(int Type)
 	return Type < 0 || Type >= NUM_ENTTYPES ? 0 : m_apFirstEntityTypes[Type];
 }
 
+void CGameWorld::InitGrid(int Width, int Height)
+{
+	if(m_apGridCells)
+		mem_free(m_apGridCells);
+
+	// entities outside of the map end up in the border cells
+	m_GridWidth = max(1, (Width*32+GRID_CELLSIZE-1)/GRID_CELLSIZE);
+	m_GridHeight = max(1, (Height*32+GRID_CELLSIZE-1)/GRID_CELLSIZE);
+
+	int Size = sizeof(CEntity *)*NUM_ENTTYPES*m_GridWidth*m_GridHeight;
+	m_apGridCells = (CEntity **)mem_alloc(Size, 1);
+	mem_zero(m_apGridCells, Size);
+}
+
+int CGameWorld::GridCell(vec2 Pos)
+{
+	int x = clamp((int)(Pos.x/GRID_CELLSIZE), 0, m_GridWidth-1);
+	int y = clamp((int)(Pos.y/GRID_CELLSIZE), 0, m_GridHeight-1);
+	return y*m_GridWidth+x;
+}
+
+void CGameWorld::GridArea(vec2 Min, vec2 Max, int *pX0, int *pY0, int *pX1, int *pY1)
+{
+	*pX0 = clamp((int)(Min.x/GRID_CELLSIZE), 0, m_GridWidth-1);
+	*pY0 = clamp((int)(Min.y/GRID_CELLSIZE), 0, m_GridHeight-1);
+	*pX1 = clamp((int)(Max.x/GRID_CELLSIZE), 0, m_GridWidth-1);
+	*pY1 = clamp((int)(Max.y/GRID_CELLSIZE), 0, m_GridHeight-1);
+}
+
+void CGameWorld::GridInsert(CEntity *pEnt, int Cell)
+{
+	CEntity **ppFirst = &m_apGridCells[Cell*NUM_ENTTYPES+pEnt->m_ObjType];
+	if(*ppFirst)
+		(*ppFirst)->m_pPrevCellEntity = pEnt;
+	pEnt->m_pNextCellEntity = *ppFirst;
+	pEnt->m_pPrevCellEntity = 0;
+	pEnt->m_GridCell = Cell;
+	*ppFirst = pEnt;
+
+	m_aGridMaxRadius[pEnt->m_ObjType] = max(m_aGridMaxRadius[pEnt->m_ObjType], pEnt->m_ProximityRadius);
+}
+
+void CGameWorld::GridRemove(CEntity *pEnt)
+{
+	if(pEnt->m_GridCell < 0)
+		return;
+
+	if(pEnt->m_pPrevCellEntity)
+		pEnt->m_pPrevCellEntity->m_pNextCellEntity = pEnt->m_pNextCellEntity;
+	else
+		m_apGridCells[pEnt->m_GridCell*NUM_ENTTYPES+pEnt->m_ObjType] = pEnt->m_pNextCellEntity;
+	if(pEnt->m_pNextCellEntity)
+		pEnt->m_pNextCellEntity->m_pPrevCellEntity = pEnt->m_pPrevCellEntity;
+
+	pEnt->m_pNextCellEntity = 0;
+	pEnt->m_pPrevCellEntity = 0;
+	pEnt->m_GridCell = -1;
+}
+
+void CGameWorld::UpdateGrid()
+{
+	// entities only move their position, so just refile the ones that changed cell
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+		{
+			int Cell = GridCell(pEnt->IndexPos());
+			if(Cell != pEnt->m_GridCell)
+			{
+				GridRemove(pEnt);
+				GridInsert(pEnt, Cell);
+			}
+			else
+				m_aGridMaxRadius[i] = max(m_aGridMaxRadius[i], pEnt->m_ProximityRadius);
+		}
+}
+
 int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
 {
 	if(Type < 0 || Type >= NUM_ENTTYPES)
 		return 0;
 
 	int Num = 0;
-	for(CEntity *pEnt = m_apFirstEntityTypes[Type];	pEnt; pEnt = pEnt->m_pNextTypeEntity)
-	{
-		if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
-		{
-			if(ppEnts)
-				ppEnts[Num] = pEnt;
-			Num++;
-			if(Num == Max)
-				break;
-		}
-	}
+	int x0, y0, x1, y1;
+	float Range = Radius+m_aGridMaxRadius[Type];
+	GridArea(Pos-vec2(Range, Range), Pos+vec2(Range, Range), &x0, &y0, &x1, &y1);
+
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(CEntity *pEnt = m_apGridCells[(y*m_GridWidth+x)*NUM_ENTTYPES+Type]; pEnt; pEnt = pEnt->m_pNextCellEntity)
+			{
+				if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
+				{
+					if(ppEnts)
+						ppEnts[Num] = pEnt;
+					Num++;
+					if(Num == Max)
+						return Num;
+				}
+			}
 
 	return Num;
 }
@@ -69,6 +162,7 @@ void CGameWorld::InsertEntity(CEntity *pEnt)
 	for(CEntity *pCur = m_apFirstEntityTypes[pEnt->m_ObjType]; pCur; pCur = pCur->m_pNextTypeEntity)
 		dbg_assert(pCur != pEnt, "err");
 #endif
+	dbg_assert(m_apGridCells != 0, "entity grid not initialized");
 
 	// insert it
 	if(m_apFirstEntityTypes[pEnt->m_ObjType])
@@ -76,6 +170,8 @@ void CGameWorld::InsertEntity(CEntity *pEnt)
 	pEnt->m_pNextTypeEntity = m_apFirstEntityTypes[pEnt->m_ObjType];
 	pEnt->m_pPrevTypeEntity = 0x0;
 	m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt;
+
+	GridInsert(pEnt, GridCell(pEnt->IndexPos()));
 }
 
 void CGameWorld::DestroyEntity(CEntity *pEnt)
@@ -103,18 +199,53 @@ void CGameWorld::RemoveEntity(CEntity *pEnt)
 
 	pEnt->m_pNextTypeEntity = 0;
 	pEnt->m_pPrevTypeEntity = 0;
+
+	GridRemove(pEnt);
+}
+
+bool CGameWorld::NetworkClipped(int SnappingClient, vec2 Pos)
+{
+	if(SnappingClient == -1)
+		return false;
+
+	vec2 ViewPos = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos;
+	if(absolute(ViewPos.x-Pos.x) > VIEW_RANGE_X || absolute(ViewPos.y-Pos.y) > VIEW_RANGE_Y)
+		return true;
+
+	return distance(ViewPos, Pos) > VIEW_DISTANCE;
 }
 
 //
 void CGameWorld::Snap(int SnappingClient)
 {
+	// demos get everything
+	if(SnappingClient == -1)
+	{
+		for(int i = 0; i < NUM_ENTTYPES; i++)
+			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+				pEnt->Snap(SnappingClient);
+		return;
+	}
+
+	vec2 ViewPos = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos;
+	int x0, y0, x1, y1;
+	GridArea(ViewPos-vec2(VIEW_RANGE_X, VIEW_RANGE_Y), ViewPos+vec2(VIEW_RANGE_X, VIEW_RANGE_Y), &x0, &y0, &x1, &y1);
+
 	for(int i = 0; i < NUM_ENTTYPES; i++)
-		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
+	{
+		// lasers are sent to their owner wherever they are, there are only a few of them
+		if(i == ENTTYPE_LASER)
 		{
-			m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
-			pEnt->Snap(SnappingClient);
-			pEnt = m_pNextTraverseEntity;
+			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+				pEnt->Snap(SnappingClient);
+			continue;
 		}
+
+		for(int y = y0; y <= y1; y++)
+			for(int x = x0; x <= x1; x++)
+				for(CEntity *pEnt = m_apGridCells[(y*m_GridWidth+x)*NUM_ENTTYPES+i]; pEnt; pEnt = pEnt->m_pNextCellEntity)
+					pEnt->Snap(SnappingClient);
+	}
 }
 
 void CGameWorld::Reset()
@@ -156,18 +287,32 @@ void CGameWorld::Tick()
 	if(m_ResetRequested)
 		Reset();
 
+	// pick up positions that were changed outside of the world tick
+	UpdateGrid();
+
 	if(!m_Paused)
 	{
 		if(GameServer()->m_pController->IsForceBalanced())
 			GameServer()->SendChat(-1, CGameContext::CHAT_ALL, "Teams have been balanced");
 		// update all objects
 		for(int i = 0; i < NUM_ENTTYPES; i++)
+		{
+			// projectiles are advanced as one batch
+			if(i == ENTTYPE_PROJECTILE)
+			{
+				CProjectile::TickAll(this);
+				continue;
+			}
+
 			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
 			{
 				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
 				pEnt->Tick();
 				pEnt = m_pNextTraverseEntity;
 			}
+		}
+
+		UpdateGrid();
 
 		for(int i = 0; i < NUM_ENTTYPES; i++)
 			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
@@ -176,6 +321,8 @@ void CGameWorld::Tick()
 				pEnt->TickDefered();
 				pEnt = m_pNextTraverseEntity;
 			}
+
+		UpdateGrid();
 	}
 	else
 	{
@@ -202,25 +349,35 @@ CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, v
 	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
- 	{
-		if(p == pNotThis)
-			continue;
+	int x0, y0, x1, y1;
+	float Range = Radius+m_aGridMaxRadius[ENTTYPE_CHARACTER];
+	GridArea(vec2(min(Pos0.x, Pos1.x)-Range, min(Pos0.y, Pos1.y)-Range),
+		vec2(max(Pos0.x, Pos1.x)+Range, max(Pos0.y, Pos1.y)+Range), &x0, &y0, &x1, &y1);
 
-		vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
-		float Len = distance(p->m_Pos, IntersectPos);
-		if(Len < p->m_ProximityRadius+Radius)
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
 		{
-			Len = distance(Pos0, IntersectPos);
-			if(Len < ClosestLen)
+			CEntity *pEnt = m_apGridCells[(y*m_GridWidth+x)*NUM_ENTTYPES+ENTTYPE_CHARACTER];
+			for(; pEnt; pEnt = pEnt->m_pNextCellEntity)
 			{
-				NewPos = IntersectPos;
-				ClosestLen = Len;
-				pClosest = p;
+				if(pEnt == pNotThis)
+					continue;
+
+				CCharacter *p = (CCharacter *)pEnt;
+				vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
+				float Len = distance(p->m_Pos, IntersectPos);
+				if(Len < p->m_ProximityRadius+Radius)
+				{
+					Len = distance(Pos0, IntersectPos);
+					if(Len < ClosestLen)
+					{
+						NewPos = IntersectPos;
+						ClosestLen = Len;
+						pClosest = p;
+					}
+				}
 			}
 		}
-	}
 
 	return pClosest;
 }
@@ -231,25 +388,35 @@ CTower *CGameWorld::IntersectTower(vec2 Pos0, vec2 Pos1, float Radius, vec2& New
 	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
 	CTower *pClosest = 0;
 
-	CTower *p = (CTower *)FindFirst(ENTTYPE_TOWER);
-	for(; p; p = (CTower *)p->TypeNext())
- 	{
-		if(p->m_Team == NotThis)
-			continue;
+	int x0, y0, x1, y1;
+	float Range = Radius+m_aGridMaxRadius[ENTTYPE_TOWER];
+	GridArea(vec2(min(Pos0.x, Pos1.x)-Range, min(Pos0.y, Pos1.y)-Range),
+		vec2(max(Pos0.x, Pos1.x)+Range, max(Pos0.y, Pos1.y)+Range), &x0, &y0, &x1, &y1);
 
-		vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
-		float Len = distance(p->m_Pos, IntersectPos);
-		if(Len < p->m_ProximityRadius+Radius)
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
 		{
-			Len = distance(Pos0, IntersectPos);
-			if(Len < ClosestLen)
+			CEntity *pEnt = m_apGridCells[(y*m_GridWidth+x)*NUM_ENTTYPES+ENTTYPE_TOWER];
+			for(; pEnt; pEnt = pEnt->m_pNextCellEntity)
 			{
-				NewPos = IntersectPos;
-				ClosestLen = Len;
-				pClosest = p;
+				CTower *p = (CTower *)pEnt;
+				if(p->m_Team == NotThis)
+					continue;
+
+				vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
+				float Len = distance(p->m_Pos, IntersectPos);
+				if(Len < p->m_ProximityRadius+Radius)
+				{
+					Len = distance(Pos0, IntersectPos);
+					if(Len < ClosestLen)
+					{
+						NewPos = IntersectPos;
+						ClosestLen = Len;
+						pClosest = p;
+					}
+				}
 			}
 		}
-	}
 
 	return pClosest;
 }
@@ -268,35 +435,33 @@ void CGameWorld::UpdatePlayerMaps()
 	{
 		if (!Server()->ClientIngame(i)) continue;
 		int* map = Server()->GetIdMap(i);
-
-		// compute distances
+		vec2 ViewPos = GameServer()->m_apPlayers[i]->m_ViewPos;
+
+		// collect the players around the view, always send the player himself
+		int NumDist = 0;
+		dist[NumDist++] = std::make_pair(0.0f, i);
+
+		int x0, y0, x1, y1;
+		GridArea(ViewPos-vec2(IDMAP_RANGE, IDMAP_RANGE), ViewPos+vec2(IDMAP_RANGE, IDMAP_RANGE), &x0, &y0, &x1, &y1);
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				for (CEntity *pEnt = m_apGridCells[(y*m_GridWidth+x)*NUM_ENTTYPES+ENTTYPE_CHARACTER]; pEnt; pEnt = pEnt->m_pNextCellEntity)
+				{
+					int k = ((CCharacter *)pEnt)->GetPlayer()->GetCID();
+					float d = distance(ViewPos, pEnt->m_Pos);
+					if (k != i && d < IDMAP_RANGE && Server()->ClientIngame(k))
+						dist[NumDist++] = std::make_pair(d, k);
+				}
+
+		// only the nearest ones get a slot
+		int Wanted = min(NumDist, (int)VANILLA_MAX_CLIENTS - 1);
+		std::partial_sort(&dist[1], &dist[Wanted], &dist[NumDist], distCompare);
+
+		int rank[MAX_CLIENTS];
 		for (int j = 0; j < MAX_CLIENTS; j++)
-		{
-			dist[j].second = j;
-			dist[j].first = 1e10;
-			if (!Server()->ClientIngame(j))
-				continue;
-			/*CCharacter* ch = GameServer()->m_apPlayers[j]->GetCharacter();
-			if (!ch)
-				continue;
-			// copypasted chunk from character.cpp Snap() follows
-			int SnappingClient = i;
-			CCharacter* SnapChar = GameServer()->GetPlayerChar(SnappingClient);
-			if(SnapChar &&
-				GameServer()->m_apPlayers[SnappingClient]->GetTeam() != -1 &&
-				!ch->CanCollide(SnappingClient) &&
-				(!GameServer()->m_apPlayers[SnappingClient]->m_IsUsingDDRaceClient ||
-					(GameServer()->m_apPlayers[SnappingClient]->m_IsUsingDDRaceClient &&
-					!GameServer()->m_apPlayers[SnappingClient]->m_ShowOthers
-                                	)
-				)
-                        ) continue;*/
-
-			dist[j].first = distance(GameServer()->m_apPlayers[i]->m_ViewPos, GameServer()->m_apPlayers[j]->m_ViewPos);
-		}
-
-		// always send the player himself
-		dist[i].first = 0;
+			rank[j] = -1;
+		for (int j = 0; j < NumDist; j++)
+			rank[dist[j].second] = j;
 
 		// compute reverse map
 		int rMap[MAX_CLIENTS];
@@ -307,30 +472,55 @@ void CGameWorld::UpdatePlayerMaps()
 		for (int j = 0; j < VANILLA_MAX_CLIENTS; j++)
 		{
 			if (map[j] == -1) continue;
-			if (dist[map[j]].first > 1e9) map[j] = -1;
+			if (!Server()->ClientIngame(map[j])) map[j] = -1;
 			else rMap[map[j]] = j;
 		}
 
-		std::nth_element(&dist[0], &dist[VANILLA_MAX_CLIENTS - 1], &dist[MAX_CLIENTS], distCompare);
-
 		int mapc = 0;
 		int demand = 0;
-		for (int j = 0; j < VANILLA_MAX_CLIENTS - 1; j++)
+		for (int j = 0; j < Wanted; j++)
 		{
 			int k = dist[j].second;
-			if (rMap[k] != -1 || dist[j].first > 1e9) continue;
+			if (rMap[k] != -1) continue;
 			while (mapc < VANILLA_MAX_CLIENTS && map[mapc] != -1) mapc++;
 			if (mapc < VANILLA_MAX_CLIENTS - 1)
+			{
 				map[mapc] = k;
+				rMap[k] = mapc;
+			}
 			else
-				if (dist[j].first < 1300) // dont bother freeing up space for players which are too far to be displayed anyway
-					demand++;
+				demand++;
 		}
-		for (int j = MAX_CLIENTS - 1; j > VANILLA_MAX_CLIENTS - 2; j--)
+
+		// hand out the free slots to the rest, they are too far to be displayed anyway
+		for (int k = 0; k < MAX_CLIENTS && mapc < VANILLA_MAX_CLIENTS - 1; k++)
+		{
+			if (rMap[k] != -1 || !Server()->ClientIngame(k)) continue;
+			while (mapc < VANILLA_MAX_CLIENTS && map[mapc] != -1) mapc++;
+			if (mapc < VANILLA_MAX_CLIENTS - 1)
+			{
+				map[mapc] = k;
+				rMap[k] = mapc;
+			}
+		}
+
+		// make room for the near ones that were left out, farthest first
+		for (int k = 0; k < MAX_CLIENTS && demand > 0; k++)
+		{
+			if (rMap[k] != -1 && rank[k] == -1)
+			{
+				map[rMap[k]] = -1;
+				demand--;
+			}
+		}
+		for (int j = NumDist - 1; j >= Wanted && demand > 0; j--)
 		{
 			int k = dist[j].second;
-			if (rMap[k] != -1 && demand-- > 0)
+			if (rMap[k] != -1)
+			{
 				map[rMap[k]] = -1;
+				demand--;
+			}
 		}
 		map[VANILLA_MAX_CLIENTS - 1] = -1; // player with empty name to say chat msgs
 	}
@@ -342,22 +532,31 @@ CCharacter *CGameWorld::ClosestCharacter(vec2 Pos, float Radius, CEntity *pNotTh
 	float ClosestRange = Radius*2;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)GameServer()->m_World.FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
- 	{
-		if(p == pNotThis)
-			continue;
+	int x0, y0, x1, y1;
+	float Range = Radius+m_aGridMaxRadius[ENTTYPE_CHARACTER];
+	GridArea(Pos-vec2(Range, Range), Pos+vec2(Range, Range), &x0, &y0, &x1, &y1);
 
-		float Len = distance(Pos, p->m_Pos);
-		if(Len < p->m_ProximityRadius+Radius)
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
 		{
-			if(Len < ClosestRange)
+			CEntity *pEnt = m_apGridCells[(y*m_GridWidth+x)*NUM_ENTTYPES+ENTTYPE_CHARACTER];
+			for(; pEnt; pEnt = pEnt->m_pNextCellEntity)
 			{
-				ClosestRange = Len;
-				pClosest = p;
+				if(pEnt == pNotThis)
+					continue;
+
+				CCharacter *p = (CCharacter *)pEnt;
+				float Len = distance(Pos, p->m_Pos);
+				if(Len < p->m_ProximityRadius+Radius)
+				{
+					if(Len < ClosestRange)
+					{
+						ClosestRange = Len;
+						pClosest = p;
+					}
+				}
 			}
 		}
-	}
 
 	return pClosest;
 }
@@ -25,7 +25,17 @@ public:
 		ENTTYPE_CHARACTER,
 
 		ENTTYPE_TOWER,
-		NUM_ENTTYPES
+		NUM_ENTTYPES,
+
+		GRID_CELLSIZE=256,
+
+		// what a client can see around its view position
+		VIEW_RANGE_X=1000,
+		VIEW_RANGE_Y=800,
+		VIEW_DISTANCE=1100,
+
+		// players closer than this compete for the vanilla id map
+		IDMAP_RANGE=1300,
 	};
 
 private:
@@ -35,6 +45,18 @@ private:
 	CEntity *m_pNextTraverseEntity;
 	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
 
+	// uniform grid over entity positions, one cell list per entity type
+	CEntity **m_apGridCells;
+	int m_GridWidth;
+	int m_GridHeight;
+	float m_aGridMaxRadius[NUM_ENTTYPES];
+
+	int GridCell(vec2 Pos);
+	void GridArea(vec2 Min, vec2 Max, int *pX0, int *pY0, int *pX1, int *pY1);
+	void GridInsert(CEntity *pEnt, int Cell);
+	void GridRemove(CEntity *pEnt);
+	void UpdateGrid();
+
 	class CGameContext *m_pGameServer;
 	class IServer *m_pServer;
 
@@ -53,6 +75,38 @@ public:
 
 	void SetGameServer(CGameContext *pGameServer);
 
+	/*
+		Function: pre_snap
+			Refiles entities that were moved after the world tick, so
+			that the grid is exact for the snapshots that follow.
+	*/
+	void PreSnap() { UpdateGrid(); }
+
+	/*
+		Function: network_clipped
+			Tests if a position is outside of what a client can see.
+
+		Arguments:
+			snapping_client - ID of the client which snapshot is
+				being generated, -1 for demo recording.
+			pos - Position to test.
+
+		Returns:
+			True if nothing at the position has to be in the snapshot.
+	*/
+	bool NetworkClipped(int SnappingClient, vec2 Pos);
+
+	/*
+		Function: init_grid
+			Sets up the spatial grid used by the entity queries.
+			Has to be called before the first entity is inserted.
+
+		Arguments:
+			width - Width of the map in tiles.
+			height - Height of the map in tiles.
+	*/
+	void InitGrid(int Width, int Height);
+
 	CEntity *FindFirst(int Type);
 
 	/*
@@ -147,8 +201,10 @@ public:
 
 	/*
 		Function: snap
-			Calls snap on all the entities in the world to create
-			the snapshot.
+			Calls snap on the entities in the world to create
+			the snapshot. Only the grid cells around the view of
+			the client are visited, so the cost follows the number
+			of entities close to it rather than the world size.
 
 		Arguments:
 			snapping_client - ID of the client which snapshot
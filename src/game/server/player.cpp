@@ -403,4 +403,5 @@ const char* CPlayer::GetLanguage()
 void CPlayer::SetLanguage(const char* pLanguage)
 {
 	str_copy(m_aLanguage, pLanguage, sizeof(m_aLanguage));
+	m_pLanguage = Server()->Localization()->GetLanguage(m_aLanguage);
 }
\ No newline at end of file
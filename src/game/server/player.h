@@ -38,6 +38,7 @@ public:
 	CCharacter *GetCharacter();
 
 	const char* GetLanguage();
+	CLocalization::CLanguage* GetLanguageHandle() { return m_pLanguage; }
 	void SetLanguage(const char* pLanguage);
 
 	//---------------------------------------------------------
@@ -116,6 +117,7 @@ private:
 	int m_Team;
 
 	char m_aLanguage[16];
+	CLocalization::CLanguage* m_pLanguage;
 
 	private:
 	CTuningParams m_PrevTuningParams;
@@ -5,11 +5,13 @@
 #include <engine/storage.h>
 #include <unicode/ushape.h>
 #include <unicode/ubidi.h>
+#include <stdint.h>
 /* END EDIT ***********************************************************/
 
 /* LANGUAGE ***********************************************************/
 
 CLocalization::CLanguage::CLanguage() :
+	m_pParent(NULL),
 	m_Loaded(false),
 	m_Direction(CLocalization::DIRECTION_LTR),
 	m_pPluralRules(NULL),
@@ -23,6 +25,7 @@ CLocalization::CLanguage::CLanguage() :
 }
 
 CLocalization::CLanguage::CLanguage(const char* pName, const char* pFilename, const char* pParentFilename) :
+	m_pParent(NULL),
 	m_Loaded(false),
 	m_Direction(CLocalization::DIRECTION_LTR),
 	m_pPluralRules(NULL),
@@ -110,6 +113,9 @@ CLocalization::CLanguage::~CLanguage()
 bool CLocalization::CLanguage::Load(CLocalization* pLocalization, CStorage* pStorage)
 /* END EDIT ***********************************************************/
 {
+	// only try once, a language without a file would be searched on the disk for every text otherwise
+	m_Loaded = true;
+	
 	// read file data into buffer
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "./server_lang/%s.json", m_aFilename);
@@ -219,8 +225,6 @@ bool CLocalization::CLanguage::Load(CLocalization* pLocalization, CStorage* pSto
 	json_value_free(pJsonData);
 	delete[] pFileData;
 	
-	m_Loaded = true;
-	
 	return true;
 }
 
@@ -275,7 +279,8 @@ CLocalization::CLocalization(class CStorage* pStorage) :
 	m_pMainLanguage(NULL),
 	m_pUtf8Converter(NULL)
 {
-	
+	m_pCache = new CCacheEntry[CACHE_SIZE];
+	ClearCache();
 }
 /* END EDIT ***********************************************************/
 
@@ -284,6 +289,8 @@ CLocalization::~CLocalization()
 	for(int i=0; i<m_pLanguages.size(); i++)
 		delete m_pLanguages[i];
 	
+	delete[] m_pCache;
+	
 	if(m_pUtf8Converter)
 		ucnv_close(m_pUtf8Converter);
 }
@@ -355,6 +362,9 @@ bool CLocalization::Init()
 			}
 		}
 	}
+	
+	for(int i=0; i<m_pLanguages.size(); i++)
+		m_pLanguages[i]->SetParent(GetLanguage(m_pLanguages[i]->GetParentFilename()));
 
 	// clean up
 	json_value_free(pJsonData);
@@ -395,6 +405,7 @@ bool CLocalization::PreUpdate()
 		if(m_pMainLanguage != pLanguage)
 		{
 			m_pMainLanguage = pLanguage;
+			ClearCache();
 			
 			for(int i=0; i<m_pListeners.size(); i++)
 				m_pListeners[i]->OnLocalizationModified();
@@ -577,21 +588,34 @@ const char *CLocalization::FallbackLanguageForIpCountryCode(int Country)
 	}
 }
 
-const char* CLocalization::LocalizeWithDepth(const char* pLanguageCode, const char* pText, int Depth)
+CLocalization::CLanguage* CLocalization::GetLanguage(const char* pLanguageCode)
 {
-	CLanguage* pLanguage = m_pMainLanguage;
-	if(pLanguageCode)
+	if(!pLanguageCode)
+		return NULL;
+	
+	for(int i=0; i<m_pLanguages.size(); i++)
 	{
-		for(int i=0; i<m_pLanguages.size(); i++)
-		{
-			if(str_comp(m_pLanguages[i]->GetFilename(), pLanguageCode) == 0)
-			{
-				pLanguage = m_pLanguages[i];
-				break;
-			}
-		}
+		if(str_comp(m_pLanguages[i]->GetFilename(), pLanguageCode) == 0)
+			return m_pLanguages[i];
 	}
 	
+	return NULL;
+}
+
+void CLocalization::ClearCache()
+{
+	for(int i=0; i<CACHE_SIZE; i++)
+	{
+		m_pCache[i].m_pText = NULL;
+		m_pCache[i].m_pLanguage = NULL;
+	}
+}
+
+const char* CLocalization::LocalizeWithDepth(CLanguage* pLanguage, const char* pText, int Depth)
+{
+	if(!pLanguage)
+		pLanguage = m_pMainLanguage;
+	
 	if(!pLanguage)
 		return pText;
 	
@@ -602,31 +626,47 @@ const char* CLocalization::LocalizeWithDepth(const char* pLanguageCode, const ch
 	if(pResult)
 		return pResult;
 	else if(pLanguage->GetParentFilename()[0] && Depth < 4)
-		return LocalizeWithDepth(pLanguage->GetParentFilename(), pText, Depth+1);
+		return LocalizeWithDepth(pLanguage->GetParent(), pText, Depth+1);
 	else
 		return pText;
 }
 
 const char* CLocalization::Localize(const char* pLanguageCode, const char* pText)
 {
-	return LocalizeWithDepth(pLanguageCode, pText, 0);
+	return Localize(GetLanguage(pLanguageCode), pText);
 }
 
-const char* CLocalization::LocalizeWithDepth_P(const char* pLanguageCode, int Number, const char* pText, int Depth)
+const char* CLocalization::Localize(CLanguage* pLanguage, const char* pText)
 {
-	CLanguage* pLanguage = m_pMainLanguage;
-	if(pLanguageCode)
+	if(!pLanguage)
+		pLanguage = m_pMainLanguage;
+	
+	if(!pLanguage)
+		return pText;
+	
+	CCacheEntry* pEntry = &m_pCache[(((uintptr_t)pText >> 2) ^ ((uintptr_t)pLanguage >> 4)) & (CACHE_SIZE-1)];
+	if(pEntry->m_pText == pText && pEntry->m_pLanguage == pLanguage && str_comp(pEntry->m_aText, pText) == 0)
+		return pEntry->m_pResult;
+	
+	const char* pResult = LocalizeWithDepth(pLanguage, pText, 0);
+	
+	//longer texts are looked up each time
+	if(str_length(pText) < CACHE_TEXT_LENGTH)
 	{
-		for(int i=0; i<m_pLanguages.size(); i++)
-		{
-			if(str_comp(m_pLanguages[i]->GetFilename(), pLanguageCode) == 0)
-			{
-				pLanguage = m_pLanguages[i];
-				break;
-			}
-		}
+		pEntry->m_pText = pText;
+		pEntry->m_pLanguage = pLanguage;
+		pEntry->m_pResult = pResult;
+		str_copy(pEntry->m_aText, pText, sizeof(pEntry->m_aText));
 	}
 	
+	return pResult;
+}
+
+const char* CLocalization::LocalizeWithDepth_P(CLanguage* pLanguage, int Number, const char* pText, int Depth)
+{
+	if(!pLanguage)
+		pLanguage = m_pMainLanguage;
+	
 	if(!pLanguage)
 		return pText;
 	
@@ -637,14 +677,19 @@ const char* CLocalization::LocalizeWithDepth_P(const char* pLanguageCode, int Nu
 	if(pResult)
 		return pResult;
 	else if(pLanguage->GetParentFilename()[0] && Depth < 4)
-		return LocalizeWithDepth_P(pLanguage->GetParentFilename(), Number, pText, Depth+1);
+		return LocalizeWithDepth_P(pLanguage->GetParent(), Number, pText, Depth+1);
 	else
 		return pText;
 }
 
 const char* CLocalization::Localize_P(const char* pLanguageCode, int Number, const char* pText)
 {
-	return LocalizeWithDepth_P(pLanguageCode, Number, pText, 0);
+	return LocalizeWithDepth_P(GetLanguage(pLanguageCode), Number, pText, 0);
+}
+
+const char* CLocalization::Localize_P(CLanguage* pLanguage, int Number, const char* pText)
+{
+	return LocalizeWithDepth_P(pLanguage, Number, pText, 0);
 }
 
 void CLocalization::AppendNumber(dynamic_string& Buffer, int& BufferIter, CLanguage* pLanguage, int Number)
@@ -731,18 +776,13 @@ void CLocalization::AppendDuration(dynamic_string& Buffer, int& BufferIter, CLan
 
 void CLocalization::Format_V(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, va_list VarArgs)
 {
-	CLanguage* pLanguage = m_pMainLanguage;	
-	if(pLanguageCode)
-	{
-		for(int i=0; i<m_pLanguages.size(); i++)
-		{
-			if(str_comp(m_pLanguages[i]->GetFilename(), pLanguageCode) == 0)
-			{
-				pLanguage = m_pLanguages[i];
-				break;
-			}
-		}
-	}
+	Format_V(Buffer, GetLanguage(pLanguageCode), pText, VarArgs);
+}
+
+void CLocalization::Format_V(dynamic_string& Buffer, CLanguage* pLanguage, const char* pText, va_list VarArgs)
+{
+	if(!pLanguage)
+		pLanguage = m_pMainLanguage;
 	if(!pLanguage)
 	{
 		Buffer.append(pText);
@@ -892,9 +932,14 @@ void CLocalization::Format(dynamic_string& Buffer, const char* pLanguageCode, co
 
 void CLocalization::Format_VL(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, va_list VarArgs)
 {
-	const char* pLocalText = Localize(pLanguageCode, pText);
+	Format_VL(Buffer, GetLanguage(pLanguageCode), pText, VarArgs);
+}
+
+void CLocalization::Format_VL(dynamic_string& Buffer, CLanguage* pLanguage, const char* pText, va_list VarArgs)
+{
+	const char* pLocalText = Localize(pLanguage, pText);
 	
-	Format_V(Buffer, pLanguageCode, pLocalText, VarArgs);
+	Format_V(Buffer, pLanguage, pLocalText, VarArgs);
 }
 
 void CLocalization::Format_L(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, ...)
@@ -909,9 +954,14 @@ void CLocalization::Format_L(dynamic_string& Buffer, const char* pLanguageCode,
 
 void CLocalization::Format_VLP(dynamic_string& Buffer, const char* pLanguageCode, int Number, const char* pText, va_list VarArgs)
 {
-	const char* pLocalText = Localize_P(pLanguageCode, Number, pText);
+	Format_VLP(Buffer, GetLanguage(pLanguageCode), Number, pText, VarArgs);
+}
+
+void CLocalization::Format_VLP(dynamic_string& Buffer, CLanguage* pLanguage, int Number, const char* pText, va_list VarArgs)
+{
+	const char* pLocalText = Localize_P(pLanguage, Number, pText);
 	
-	Format_V(Buffer, pLanguageCode, pLocalText, VarArgs);
+	Format_V(Buffer, pLanguage, pLocalText, VarArgs);
 }
 
 void CLocalization::Format_LP(dynamic_string& Buffer, const char* pLanguageCode, int Number, const char* pText, ...)
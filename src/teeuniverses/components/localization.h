@@ -82,6 +82,7 @@ public:
 		char m_aName[64];
 		char m_aFilename[64];
 		char m_aParentFilename[64];
+		CLanguage* m_pParent;
 		bool m_Loaded;
 		int m_Direction;
 		
@@ -99,6 +100,8 @@ public:
 		~CLanguage();
 		
 		inline const char* GetParentFilename() const { return m_aParentFilename; }
+		inline CLanguage* GetParent() const { return m_pParent; }
+		inline void SetParent(CLanguage* pParent) { m_pParent = pParent; }
 		inline const char* GetFilename() const { return m_aFilename; }
 		inline const char* GetName() const { return m_aName; }
 		inline int GetWritingDirection() const { return m_Direction; }
@@ -117,6 +120,24 @@ public:
 	};
 
 protected:
+	enum
+	{
+		CACHE_SIZE=1024, // power of two
+		CACHE_TEXT_LENGTH=128,
+	};
+	
+	//Localize results by address of the source text and language.
+	//The text is kept as well because callers may pass the same buffer with other content
+	struct CCacheEntry
+	{
+		const char* m_pText;
+		CLanguage* m_pLanguage;
+		const char* m_pResult;
+		char m_aText[CACHE_TEXT_LENGTH];
+	};
+	
+	CCacheEntry* m_pCache;
+	
 	CLanguage* m_pMainLanguage;
 	array<IListener*> m_pListeners;
 	bool m_UpdateListeners;
@@ -128,8 +149,9 @@ public:
 	fixed_string128 m_Cfg_MainLanguage;
 
 protected:
-	const char* LocalizeWithDepth(const char* pLanguageCode, const char* pText, int Depth);
-	const char* LocalizeWithDepth_P(const char* pLanguageCode, int Number, const char* pText, int Depth);
+	const char* LocalizeWithDepth(CLanguage* pLanguage, const char* pText, int Depth);
+	const char* LocalizeWithDepth_P(CLanguage* pLanguage, int Number, const char* pText, int Depth);
+	void ClearCache();
 	
 	void AppendNumber(dynamic_string& Buffer, int& BufferIter, CLanguage* pLanguage, int Number);
 	void AppendPercent(dynamic_string& Buffer, int& BufferIter, CLanguage* pLanguage, double Number);
@@ -152,19 +174,28 @@ public:
 	
 	inline bool GetWritingDirection() const { return (!m_pMainLanguage ? DIRECTION_LTR : m_pMainLanguage->GetWritingDirection()); }
 	
+	//find the language of a code once and pass it instead of the code.
+	//NULL (unknown code) stands for the main language, like an unknown code does
+	CLanguage* GetLanguage(const char* pLanguageCode);
+	
 	//localize
 	const char* Localize(const char* pLanguageCode, const char* pText);
+	const char* Localize(CLanguage* pLanguage, const char* pText);
 	//localize and find the appropriate plural form based on Number
 	const char* Localize_P(const char* pLanguageCode, int Number, const char* pText);
+	const char* Localize_P(CLanguage* pLanguage, int Number, const char* pText);
 	
 	//format
 	void Format_V(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, va_list VarArgs);
+	void Format_V(dynamic_string& Buffer, CLanguage* pLanguage, const char* pText, va_list VarArgs);
 	void Format(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, ...);
 	//localize, format
 	void Format_VL(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, va_list VarArgs);
+	void Format_VL(dynamic_string& Buffer, CLanguage* pLanguage, const char* pText, va_list VarArgs);
 	void Format_L(dynamic_string& Buffer, const char* pLanguageCode, const char* pText, ...);
 	//localize, find the appropriate plural form based on Number and format
 	void Format_VLP(dynamic_string& Buffer, const char* pLanguageCode, int Number, const char* pText, va_list VarArgs);
+	void Format_VLP(dynamic_string& Buffer, CLanguage* pLanguage, int Number, const char* pText, va_list VarArgs);
 	void Format_LP(dynamic_string& Buffer, const char* pLanguageCode, int Number, const char* pText, ...);
 	
 	void ArabicShaping(dynamic_string& Buffer, int BufferStart = 0);